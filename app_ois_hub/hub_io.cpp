@@ -0,0 +1,196 @@
+#include "hub_io.h"
+#include "../cpp/ois_queue.h"
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+bool VJoy_Init(char* out_error, int errorSize);
+void VJoy_Shutdown();
+void VJoy_Pause();
+void VJoy_Update( int numAxes, float* axes, int numButtons, bool* buttons );
+
+static OisTripleBuffer<HubSnapshot> s_snapshots;
+static OisSpscQueue<HubCommand, 64> s_commands;
+static std::thread                  s_thread;
+static std::atomic<bool>            s_quit;
+
+//Everything below is only touched by the I/O thread
+static bool s_enableVJoyOutput = false;
+static char s_vjoyError[1024] = {'\0'};
+static HubMapping s_mapping;
+static HubOutputState s_outputState;
+static bool s_outputResend = false;//vJoy needs the whole state after being (re)enabled
+
+static void DoVJoyUpdate(std::vector<OisDeviceEx*>& devices)
+{
+	bool changed = s_mapping.Update(devices, s_outputState);
+	if( !s_outputState.numButtons && !s_outputState.numAxes )
+		VJoy_Pause();
+	else if( changed || s_outputResend )
+		VJoy_Update(s_outputState.numAxes, s_outputState.axisValues, s_outputState.numButtons, s_outputState.buttonValues);
+	s_outputResend = false;
+}
+
+static const char* GetName(const OisDevice& d) { return d.GetDeviceName(); }
+static const char* GetName(const OisHost& d)   { return d.GetGameName().c_str(); }
+
+template<class T>
+static void SnapshotDevice(HubDeviceSnapshot& s, HubDeviceId id, IOisPort& port, const T& device, const std::vector<const char*>& eventLog)
+{
+	s.id = id;
+	s.name = GetName(device);
+	s.portName = port.Name();
+	if( device.Connected() )
+		s.state = HubDeviceSnapshot::Active;
+	else if( device.Connecting() )
+		s.state = HubDeviceSnapshot::Synchronisation;
+	else
+		s.state = HubDeviceSnapshot::Handshaking;
+	s.link = device.Link().Estimate();
+	s.inputs = device.DeviceInputs();
+	s.outputs = device.DeviceOutputs();
+	size_t first = eventLog.size() > InputOisEventLogSize ? eventLog.size() - InputOisEventLogSize : 0;
+	s.recentEvents.resize(eventLog.size() - first);
+	for( size_t i=0, end=s.recentEvents.size(); i!=end; ++i )
+		s.recentEvents[i] = eventLog[first + i];
+}
+
+static void Snapshot(HubSnapshot& s, const std::vector<OisDeviceEx*>& devices, const OisHostEx* outputDevice)
+{
+	s.inputs.resize(devices.size());
+	for( size_t i=0, end=devices.size(); i!=end; ++i )
+		SnapshotDevice(s.inputs[i], devices[i]->handle, *devices[i]->port, *devices[i]->device, devices[i]->eventLog);
+	s.hasOutput = outputDevice && outputDevice->device;
+	if( s.hasOutput )
+		SnapshotDevice(s.output, HubOutputDeviceId, *outputDevice->port, *outputDevice->device, outputDevice->eventLog);
+	s.vjoyEnabled = s_enableVJoyOutput;
+	s.vjoyError = s_vjoyError;
+	s.outputState = s_outputState;
+	s.mappingStatus = s_mapping.Status();
+	s.probes = InputOis_GetProbes();
+}
+
+static void Execute(const HubCommand& c, OisHostEx* outputDevice)
+{
+	OisDeviceEx* d = InputOis_Find(c.device);//null if it has disconnected since the GUI's snapshot
+	switch( c.type )
+	{
+	case HubCommand::ConnectInput:
+		InputOis_Connect(c.port);
+		break;
+	case HubCommand::ConnectOutput:
+		OutputOis_Connect(c.port);
+		break;
+	case HubCommand::Disconnect:
+		InputOis_Disconnect(c.device);
+		break;
+	case HubCommand::SetInput:
+		if( d )
+		{
+			for( auto& input : d->device->DeviceInputs() )
+			{
+				if( input.channel == c.channel )
+				{
+					d->device->SetInput(input, c.value);
+					break;
+				}
+			}
+		}
+		break;
+	case HubCommand::ClearEvents:
+		if( d )
+			d->eventLog.clear();
+		else if( outputDevice && c.device == HubOutputDeviceId )
+			outputDevice->eventLog.clear();
+		break;
+	case HubCommand::EnableVJoy:
+		if( !s_enableVJoyOutput )
+			s_enableVJoyOutput = s_outputResend = VJoy_Init(s_vjoyError, sizeof(s_vjoyError));
+		break;
+	case HubCommand::ReloadMapping:
+		s_mapping.Load(HubMappingFile);
+		break;
+	case HubCommand::DiscoverInputs:
+	{
+		OIS_PORT_LIST ports;
+		OIS_STRING_BUILDER sb;
+		SerialPort::EnumerateSerialPorts(ports, sb, -1);
+		if( outputDevice )
+			ports.erase(std::remove_if(ports.begin(), ports.end(), [&](const PortName& p) { return p.path == outputDevice->port->Name(); }), ports.end());
+		InputOis_Discover(ports, HubDiscoveryTimeout);
+		break;
+	}
+	case HubCommand::DisableVJoy:
+		if( s_enableVJoyOutput )
+		{
+			s_enableVJoyOutput = false;
+			VJoy_Shutdown();
+		}
+		break;
+	}
+}
+
+static void HubIo_Thread()
+{
+	std::vector<OisDeviceEx*> inputDevices;
+	OisHostEx* outputDevice = 0;
+
+	auto time = std::chrono::steady_clock::now();
+	float deltaTime = 0;
+	while( !s_quit.load(std::memory_order_relaxed) )
+	{
+		HubCommand command;
+		while( s_commands.Pop(command) )
+			Execute( command, outputDevice );
+		inputDevices.clear();
+
+		InputOis_Update( inputDevices, deltaTime );
+		OutputOis_Update( outputDevice, inputDevices, deltaTime );
+		DoVJoyUpdate( inputDevices );
+
+		//Only build a snapshot once the GUI has picked up the previous one
+		if( !s_snapshots.Pending() )
+		{
+			Snapshot( s_snapshots.Back(), inputDevices, outputDevice );
+			s_snapshots.Publish();
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<float> diff = end-time;
+		deltaTime = diff.count();
+		time = end;
+	}
+}
+
+void HubIo_Start()
+{
+	InputOis_Init();
+	s_mapping.Load(HubMappingFile);
+	s_quit = false;
+	s_thread = std::thread(&HubIo_Thread);
+}
+
+void HubIo_Stop()
+{
+	if( !s_thread.joinable() )
+		return;
+	s_quit = true;
+	s_thread.join();
+	InputOis_Shutdown();
+}
+
+const HubSnapshot& HubIo_Snapshot(bool* out_isNew)
+{
+	bool isNew = s_snapshots.Acquire();
+	if( out_isNew )
+		*out_isNew = isNew;
+	return s_snapshots.Front();
+}
+
+void HubIo_Send(const HubCommand& command)
+{
+	if( !s_commands.Push(command) )
+		OisLog("WARN", "GUI command queue is full, dropping command %d", (int)command.type);
+}
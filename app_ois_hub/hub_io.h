@@ -0,0 +1,71 @@
+#pragma once
+#include "hub_mapping.h"
+
+//------------------------------------------------------------------------------
+// All devices are polled on a dedicated I/O thread, along with forwarding to the output device and vJoy, so that a slow
+//  GUI redraw can't delay controller input or vJoy output.
+// The I/O thread publishes an immutable snapshot of everything the GUI displays through a triple buffer, which the GUI
+//  reads without locking. The GUI never touches the devices: edits are sent to the I/O thread as HubCommands.
+//------------------------------------------------------------------------------
+
+const char* const HubMappingFile = "ois_hub_mapping.txt";//relative to the working directory
+const float HubDiscoveryTimeout = 3.0f;//seconds; long enough for an Arduino to reboot when its port is opened
+
+typedef OisDeviceHandle HubDeviceId;
+const HubDeviceId HubOutputDeviceId = ~(HubDeviceId)0;
+
+struct HubDeviceSnapshot
+{
+	enum State { Handshaking, Synchronisation, Active };
+
+	HubDeviceId id = 0;
+	std::string name;
+	std::string portName;
+	State state = Handshaking;
+	OisLinkEstimate link = OisLinkEstimate();
+	std::vector<OisState::NumericValue> inputs;
+	std::vector<OisState::NumericValue> outputs;
+	std::vector<std::string> recentEvents;//oldest first
+};
+
+struct HubSnapshot
+{
+	std::vector<HubDeviceSnapshot> inputs;
+	bool hasOutput = false;
+	HubDeviceSnapshot output;
+	bool vjoyEnabled = false;
+	std::string vjoyError;
+	HubOutputState outputState;//after mapping, as sent to vJoy
+	std::string mappingStatus;
+	std::vector<InputOisProbe> probes;//from the last DiscoverInputs
+};
+
+struct HubCommand
+{
+	enum Type
+	{
+		ConnectInput,   //port
+		ConnectOutput,  //port
+		Disconnect,     //device
+		SetInput,       //device, channel, value
+		ClearEvents,    //device
+		EnableVJoy,
+		DisableVJoy,
+		ReloadMapping,  //re-read HubMappingFile
+		DiscoverInputs, //probe every serial port that isn't in use, see InputOis_Discover
+	};
+	Type type;
+	HubDeviceId device = 0;
+	unsigned channel = 0;
+	OisState::Value value = {};
+	PortName port;
+};
+
+void HubIo_Start();
+void HubIo_Stop();
+
+//GUI thread: returns the most recent snapshot. It remains valid until the next call.
+//`out_isNew`, if given, is set to false if it's the same snapshot as last time.
+const HubSnapshot& HubIo_Snapshot(bool* out_isNew = nullptr);
+//GUI thread: queue an edit to be applied by the I/O thread.
+void HubIo_Send(const HubCommand&);
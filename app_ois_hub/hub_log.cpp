@@ -0,0 +1,385 @@
+#include "hub_log.h"
+#include "../cpp/ois_queue.h"
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+
+struct HubLogRecord
+{
+	enum { MaxArgs = 8, TextSize = 128 };
+	union Arg
+	{
+		long long   integer;
+		double      number;
+		const void* pointer;
+		unsigned    text;//offset of a copied string
+	};
+	const char* fmt;
+	uint8_t category;
+	uint8_t level;
+	uint8_t argc;
+	uint8_t textUsed;
+	Arg args[MaxArgs];
+	char text[TextSize];
+};
+
+struct HubLogHistory
+{
+	HubLogRecord records[HubLog_HistorySize];
+	unsigned count = 0;
+	unsigned next = 0;
+};
+
+static OisMpscQueue<HubLogRecord, 1024> s_queue;
+static std::atomic<int>                 s_level[HubLog_NumCategories];
+static std::atomic<uint64_t>            s_dropped[HubLog_NumCategories];
+static HubLogHistory                    s_history[HubLog_NumCategories];//only used by the GUI thread
+
+//------------------------------------------------------------------------------
+// printf format parsing, shared by capturing the arguments and by formatting them later.
+
+struct FormatSpec
+{
+	enum Kind { Signed, Unsigned, Char, Float, String, WideString, Pointer, Count };
+	const char* begin;//the '%'
+	const char* length;//the length modifier, which ends at `conversion`
+	const char* conversion;
+	Kind kind;
+	int stars;//number of '*' widths / precisions, which each take an int argument
+	int precision;//-1 if not given, -2 if given by a '*' argument
+};
+
+static bool NextSpec(const char*& fmt, FormatSpec& s)
+{
+	for( ; *fmt; ++fmt )
+	{
+		if( fmt[0] != '%' )
+			continue;
+		if( fmt[1] == '%' )
+		{
+			++fmt;
+			continue;
+		}
+		const char* c = fmt + 1;
+		s.begin = fmt;
+		s.stars = 0;
+		s.precision = -1;
+		while( *c && strchr("-+ #0", *c) )
+			++c;
+		if( *c == '*' )
+		{
+			++s.stars;
+			++c;
+		}
+		while( *c >= '0' && *c <= '9' )
+			++c;
+		if( *c == '.' )
+		{
+			++c;
+			if( *c == '*' )
+			{
+				++s.stars;
+				s.precision = -2;
+				++c;
+			}
+			else
+			{
+				s.precision = 0;
+				while( *c >= '0' && *c <= '9' )
+					s.precision = s.precision * 10 + (*c++ - '0');
+			}
+		}
+		s.length = c;
+		while( *c && strchr("hljztLqI", *c) )
+			++c;
+		if( *(c-1) == 'I' && ((c[0] == '6' && c[1] == '4') || (c[0] == '3' && c[1] == '2')) )
+			c += 2;//MSVC's I64 / I32
+		s.conversion = c;
+		bool wide = c != s.length && *(c-1) == 'l';
+		switch( *c )
+		{
+		case 'd': case 'i':                     s.kind = FormatSpec::Signed; break;
+		case 'u': case 'o': case 'x': case 'X': s.kind = FormatSpec::Unsigned; break;
+		case 'c': case 'C':                     s.kind = FormatSpec::Char; break;
+		case 'f': case 'F': case 'e': case 'E':
+		case 'g': case 'G': case 'a': case 'A': s.kind = FormatSpec::Float; break;
+		case 's':                               s.kind = wide ? FormatSpec::WideString : FormatSpec::String; break;
+		case 'S':                               s.kind = FormatSpec::WideString; break;
+		case 'p':                               s.kind = FormatSpec::Pointer; break;
+		case 'n':                               s.kind = FormatSpec::Count; break;
+		default:
+			return false;//malformed; the rest is treated as text
+		}
+		fmt = c + 1;
+		return true;
+	}
+	return false;
+}
+
+static long long ReadInteger(const FormatSpec& s, va_list& v)
+{
+	const char* l = s.length;
+	size_t len = s.conversion - l;
+	bool isSigned = s.kind == FormatSpec::Signed;
+	if( len == 0 || l[0] == 'h' )
+		return isSigned ? (long long)va_arg(v, int) : (long long)va_arg(v, unsigned);
+	if( (len == 2 && l[0] == 'l') || l[0] == 'q' || (len == 3 && l[1] == '6') )
+		return isSigned ? va_arg(v, long long) : (long long)va_arg(v, unsigned long long);
+	if( l[0] == 'l' )
+		return isSigned ? (long long)va_arg(v, long) : (long long)va_arg(v, unsigned long);
+	if( l[0] == 'j' )
+		return (long long)va_arg(v, intmax_t);
+	if( l[0] == 'z' || l[0] == 't' || (l[0] == 'I' && len == 1) )
+		return isSigned ? (long long)va_arg(v, ptrdiff_t) : (long long)va_arg(v, size_t);
+	return isSigned ? (long long)va_arg(v, int) : (long long)va_arg(v, unsigned);//I32
+}
+
+//------------------------------------------------------------------------------
+// Producer side
+
+static void Capture(HubLogRecord& r, const char* fmt, va_list& v)
+{
+	r.argc = 0;
+	r.textUsed = 0;
+	FormatSpec s;
+	while( NextSpec(fmt, s) )
+	{
+		if( r.argc + s.stars + 1 > HubLogRecord::MaxArgs )
+			break;//the remaining specifiers will be displayed as-is
+		int precision = s.precision;
+		for( int i=0; i!=s.stars; ++i )
+		{
+			int value = va_arg(v, int);
+			r.args[r.argc++].integer = value;
+			if( s.precision == -2 )
+				precision = value;//the last star is the precision
+		}
+		HubLogRecord::Arg& arg = r.args[r.argc++];
+		switch( s.kind )
+		{
+		case FormatSpec::Signed:
+		case FormatSpec::Unsigned:
+			arg.integer = ReadInteger(s, v);
+			break;
+		case FormatSpec::Char:
+			arg.integer = va_arg(v, int);
+			break;
+		case FormatSpec::Float:
+			arg.number = *(s.conversion-1) == 'L' ? (double)va_arg(v, long double) : va_arg(v, double);
+			break;
+		case FormatSpec::Pointer:
+		case FormatSpec::Count:
+			arg.pointer = va_arg(v, void*);
+			break;
+		case FormatSpec::String:
+		case FormatSpec::WideString:
+		{
+			char* out = r.text + r.textUsed;
+			size_t space = HubLogRecord::TextSize - 1 - r.textUsed;
+			if( precision >= 0 && (size_t)precision < space )
+				space = precision;
+			size_t len = 0;
+			if( s.kind == FormatSpec::String )
+			{
+				const char* str = va_arg(v, const char*);
+				if( !str )
+					str = "(null)";
+				for( ; len != space && str[len]; ++len )
+					out[len] = str[len];
+			}
+			else
+			{
+				const wchar_t* str = va_arg(v, const wchar_t*);
+				if( !str )
+					str = L"(null)";
+				for( ; len != space && str[len]; ++len )
+					out[len] = str[len] < 128 ? (char)str[len] : '?';
+			}
+			out[len] = '\0';
+			arg.text = r.textUsed;
+			r.textUsed = (uint8_t)(r.textUsed + len + 1);
+			if( r.textUsed == HubLogRecord::TextSize )
+				--r.textUsed;//full; later strings share the final terminator
+			break;
+		}
+		}
+	}
+}
+
+bool HubLog_Enabled(HubLogCategory category, HubLogLevel level)
+{
+	return (int)level >= s_level[category].load(std::memory_order_relaxed);
+}
+
+void HubLog_WriteV(HubLogCategory category, HubLogLevel level, const char* fmt, va_list v)
+{
+	if( !HubLog_Enabled(category, level) )
+		return;
+	HubLogRecord r;
+	r.fmt = fmt;
+	r.category = (uint8_t)category;
+	r.level = (uint8_t)level;
+	va_list args;
+	va_copy(args, v);
+	Capture(r, fmt, args);
+	va_end(args);
+	if( !s_queue.Push(r) )
+		s_dropped[category].fetch_add(1, std::memory_order_relaxed);
+}
+
+void HubLog_Write(HubLogCategory category, HubLogLevel level, const char* fmt, ...)
+{
+	va_list v;
+	va_start(v, fmt);
+	HubLog_WriteV(category, level, fmt, v);
+	va_end(v);
+}
+
+void HubLog_SetLevel(HubLogCategory category, HubLogLevel minimum)
+{
+	s_level[category].store(minimum, std::memory_order_relaxed);
+}
+
+HubLogLevel HubLog_GetLevel(HubLogCategory category)
+{
+	return (HubLogLevel)s_level[category].load(std::memory_order_relaxed);
+}
+
+const char* HubLog_LevelName(HubLogLevel level)
+{
+	switch( level )
+	{
+	case HubLog_Info:  return "Info";
+	case HubLog_Warn:  return "Warning";
+	case HubLog_Error: return "Error";
+	default:           return "?";
+	}
+}
+
+uint64_t HubLog_Dropped(HubLogCategory category)
+{
+	return s_dropped[category].load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// Consumer side
+
+bool HubLog_Collect()
+{
+	bool any = false;
+	HubLogRecord r;
+	while( s_queue.Pop(r) )
+	{
+		any = true;
+		HubLogHistory& h = s_history[r.category];
+		h.records[h.next] = r;
+		h.next = (h.next + 1) % HubLog_HistorySize;
+		if( h.count < HubLog_HistorySize )
+			++h.count;
+	}
+	return any;
+}
+
+void HubLog_Clear(HubLogCategory category)
+{
+	s_history[category].count = 0;
+}
+
+unsigned HubLog_Count(HubLogCategory category)
+{
+	return s_history[category].count;
+}
+
+//Copy the text between specifiers, turning %% into %
+static void AppendText(char*& out, size_t& outSize, const char* text, const char* end)
+{
+	for( ; text != end && outSize > 1; ++text, ++out, --outSize )
+	{
+		if( text[0] == '%' && text + 1 != end && text[1] == '%' )
+			++text;
+		*out = *text;
+	}
+	*out = '\0';
+}
+
+template<class T>
+static int Print(char* out, size_t outSize, const char* spec, int numStars, const int* stars, T value)
+{
+	switch( numStars )
+	{
+	case 0:  return snprintf(out, outSize, spec, value);
+	case 1:  return snprintf(out, outSize, spec, stars[0], value);
+	default: return snprintf(out, outSize, spec, stars[0], stars[1], value);
+	}
+}
+
+void HubLog_Format(HubLogCategory category, unsigned index, char* out, size_t outSize)
+{
+	if( !outSize )
+		return;
+	*out = '\0';
+	const HubLogHistory& h = s_history[category];
+	if( index >= h.count )
+		return;
+	const HubLogRecord& r = h.records[(h.next + HubLog_HistorySize - h.count + index) % HubLog_HistorySize];
+
+	const char* fmt = r.fmt;
+	const char* text = fmt;
+	unsigned arg = 0;
+	FormatSpec s;
+	while( NextSpec(fmt, s) )
+	{
+		if( arg + s.stars + 1 > r.argc )
+			break;//arguments weren't captured; display the rest of the format string as-is
+		AppendText(out, outSize, text, s.begin);
+		text = fmt;
+
+		//Rebuild the specifier to match how the argument was stored
+		char spec[32];
+		size_t prefix = s.length - s.begin;
+		if( prefix + 4 > sizeof(spec) )
+		{
+			arg += s.stars + 1;
+			continue;
+		}
+		memcpy(spec, s.begin, prefix);
+		char* end = spec + prefix;
+		if( s.kind == FormatSpec::Signed || s.kind == FormatSpec::Unsigned )
+		{
+			*end++ = 'l';
+			*end++ = 'l';
+		}
+		*end++ = s.kind == FormatSpec::WideString ? 's' : s.kind == FormatSpec::Char ? 'c' : *s.conversion;
+		*end = '\0';
+
+		int stars[2] = {};
+		for( int i=0; i!=s.stars; ++i )
+			stars[i] = (int)r.args[arg++].integer;
+		const HubLogRecord::Arg& a = r.args[arg++];
+		int written = 0;
+		switch( s.kind )
+		{
+		case FormatSpec::Signed:
+		case FormatSpec::Unsigned:   written = Print(out, outSize, spec, s.stars, stars, a.integer);       break;
+		case FormatSpec::Char:       written = Print(out, outSize, spec, s.stars, stars, (int)a.integer);  break;
+		case FormatSpec::Float:      written = Print(out, outSize, spec, s.stars, stars, a.number);        break;
+		case FormatSpec::Pointer:    written = Print(out, outSize, spec, s.stars, stars, a.pointer);       break;
+		case FormatSpec::String:
+		case FormatSpec::WideString: written = Print(out, outSize, spec, s.stars, stars, r.text + a.text); break;
+		case FormatSpec::Count:                                                                            break;
+		}
+		if( written < 0 )
+			written = 0;
+		if( (size_t)written >= outSize )
+		{
+			out += outSize - 1;
+			outSize = 1;
+		}
+		else
+		{
+			out += written;
+			outSize -= written;
+		}
+	}
+	AppendText(out, outSize, text, text + strlen(text));
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+
+//------------------------------------------------------------------------------
+// The hub's logs. Messages can be written from any thread, and are displayed by the GUI thread.
+// Writing a message doesn't format it: the format pointer and the raw arguments are pushed onto a fixed-size lock-free
+//  queue, and the text is only produced when the GUI displays that line. String arguments are copied (up to 128 bytes
+//  per message) as they may not outlive the call, but the format string itself must be a literal.
+// If the GUI falls behind and the queue fills up, new messages are dropped and counted. The GUI keeps the most recent
+//  HubLog_HistorySize messages of each category.
+//------------------------------------------------------------------------------
+
+enum HubLogCategory
+{
+	HubLog_Ois,
+	HubLog_Webby,
+	HubLog_NumCategories
+};
+
+enum HubLogLevel
+{
+	HubLog_Info,
+	HubLog_Warn,
+	HubLog_Error,
+	HubLog_NumLevels
+};
+
+const unsigned HubLog_HistorySize = 1024;
+
+//Any thread:
+void HubLog_Write(HubLogCategory, HubLogLevel, const char* fmt, ...);
+void HubLog_WriteV(HubLogCategory, HubLogLevel, const char* fmt, va_list);
+bool HubLog_Enabled(HubLogCategory, HubLogLevel);
+//Messages below this level are discarded before anything is copied. Defaults to HubLog_Info.
+void HubLog_SetLevel(HubLogCategory, HubLogLevel minimum);
+HubLogLevel HubLog_GetLevel(HubLogCategory);
+const char* HubLog_LevelName(HubLogLevel);
+//The number of messages that have been discarded because the queue was full.
+uint64_t HubLog_Dropped(HubLogCategory);
+
+//GUI thread: move new messages from the queue into the history. Call regularly, even when the logs aren't visible.
+//Returns true if there were any.
+bool HubLog_Collect();
+void HubLog_Clear(HubLogCategory);
+unsigned HubLog_Count(HubLogCategory);
+//Format the message at `index` in the history (0 is the oldest).
+void HubLog_Format(HubLogCategory, unsigned index, char* out, size_t outSize);
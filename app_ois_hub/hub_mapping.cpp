@@ -0,0 +1,247 @@
+#include "hub_mapping.h"
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+
+static const char* SkipSpace(const char* s)
+{
+	while( *s == ' ' || *s == '\t' )
+		++s;
+	return s;
+}
+
+static std::string Trim(const char* begin, const char* end)
+{
+	begin = SkipSpace(begin);
+	while( end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n') )
+		--end;
+	return std::string(begin, end);
+}
+
+void HubMapping::Load(const char* path)
+{
+	m_rules.clear();
+	m_dirty = true;
+	FILE* f = fopen(path, "r");
+	if( !f )
+	{
+		m_status = "automatic";
+		return;
+	}
+	char line[512];
+	for( int lineNumber = 1; fgets(line, sizeof(line), f); ++lineNumber )
+	{
+		const char* s = SkipSpace(line);
+		if( *s == '#' || *s == '\0' || *s == '\r' || *s == '\n' )
+			continue;
+		//button <n> = [device/]channel
+		//axis <n>   = [device/]channel [* scale]
+		Rule rule;
+		char kind[16];
+		int slot = -1, consumed = 0;
+		if( 2 != sscanf(s, "%15s %d =%n", kind, &slot, &consumed) || !consumed )
+		{
+			OisLog("WARN", "%s(%d): expected `button <n> = channel` or `axis <n> = channel`", path, lineNumber);
+			continue;
+		}
+		if( 0 == strcmp(kind, "button") && slot >= 0 && slot < (int)OIS_ARRAYSIZE(HubOutputState::buttonValues) )
+			rule.target = Button;
+		else if( 0 == strcmp(kind, "axis") && slot >= 0 && slot < (int)OIS_ARRAYSIZE(HubOutputState::axisValues) )
+			rule.target = Axis;
+		else
+		{
+			OisLog("WARN", "%s(%d): unknown target %s %d", path, lineNumber, kind, slot);
+			continue;
+		}
+		rule.slot = (uint8_t)slot;
+		rule.scale = 0;
+		const char* name = s + consumed;
+		const char* end = name + strlen(name);
+		const char* star = strrchr(name, '*');
+		if( star && rule.target == Axis )
+		{
+			rule.scale = (float)atof(star + 1);
+			end = star;
+		}
+		const char* slash = (const char*)memchr(name, '/', end - name);
+		if( slash )
+		{
+			rule.device = Trim(name, slash);
+			name = slash + 1;
+		}
+		rule.channel = Trim(name, end);
+		if( rule.channel.empty() )
+		{
+			OisLog("WARN", "%s(%d): missing channel name", path, lineNumber);
+			continue;
+		}
+		m_rules.push_back(rule);
+	}
+	fclose(f);
+	if( m_rules.empty() )
+		m_status = "automatic";
+	else
+		m_status = std::to_string(m_rules.size()) + " rules from " + path;
+}
+
+const HubMapping::Rule* HubMapping::FindRule(const OisDevice& device, const std::string& channel) const
+{
+	for( const Rule& r : m_rules )
+		if( r.channel == channel && (r.device.empty() || r.device == device.GetDeviceName()) )
+			return &r;
+	return nullptr;
+}
+
+HubMapping::Signature HubMapping::SignatureOf(const OisDeviceEx& item)
+{
+	Signature s = { item.handle, 0, false };
+	if( item.device )
+	{
+		s.registrationVersion = item.device->RegistrationVersion();
+		s.connected = item.device->Connected();
+	}
+	return s;
+}
+
+bool HubMapping::Changed(const std::vector<OisDeviceEx*>& devices) const
+{
+	if( m_dirty || devices.size() != m_compiledFor.size() )
+		return true;
+	for( size_t i=0, end=devices.size(); i!=end; ++i )
+	{
+		const Signature& a = m_compiledFor[i];
+		Signature b = SignatureOf(*devices[i]);
+		if( a.handle != b.handle || a.registrationVersion != b.registrationVersion || a.connected != b.connected )
+			return true;
+	}
+	return false;
+}
+
+void HubMapping::Compile(const std::vector<OisDeviceEx*>& devices, HubOutputState& out)
+{
+	m_dirty = false;
+	m_compiledFor.clear();
+	m_values.clear();
+	m_events.clear();
+	m_pulsedButtons.clear();
+	out = HubOutputState();
+
+	const int maxButtons = (int)OIS_ARRAYSIZE(out.buttonValues);
+	const int maxAxes = (int)OIS_ARRAYSIZE(out.axisValues);
+	int nextButton = 0, nextAxis = 0;//automatic mapping
+	for( OisDeviceEx* item : devices )
+	{
+		m_compiledFor.push_back(SignatureOf(*item));
+		if( !m_compiledFor.back().connected )
+			continue;
+		const OisDevice& d = *item->device;
+
+		const auto& outputs = d.DeviceOutputs();
+		for( size_t i=0, end=outputs.size(); i!=end; ++i )
+		{
+			const OisState::NumericValue& v = outputs[i];
+			ValueEntry e = { &d, (uint16_t)i, v.type == OisState::Boolean ? Button : Axis, 0, 0, NAN };
+			if( !m_rules.empty() )
+			{
+				const Rule* r = FindRule(d, v.name);
+				if( !r )
+					continue;
+				e.target = r->target;
+				e.slot = r->slot;
+				e.scale = r->scale;
+			}
+			else if( e.target == Button && nextButton < maxButtons )
+				e.slot = (uint8_t)nextButton++;
+			else if( e.target == Axis && nextAxis < maxAxes )
+				e.slot = (uint8_t)nextAxis++;
+			else
+				continue;
+			if( e.scale == 0 )
+				e.scale = v.type == OisState::Number ? 1.0f / SHRT_MAX : 1.0f;
+			m_values.push_back(e);
+		}
+		for( const OisState::Event& ev : d.DeviceEvents() )
+		{
+			EventEntry e = { &d, ev.channel, 0 };
+			if( !m_rules.empty() )
+			{
+				const Rule* r = FindRule(d, ev.name);
+				if( !r || r->target != Button )
+					continue;
+				e.slot = r->slot;
+			}
+			else if( nextButton < maxButtons )
+				e.slot = (uint8_t)nextButton++;
+			else
+				continue;
+			m_events.push_back(e);
+		}
+	}
+	std::sort(m_events.begin(), m_events.end(), [](const EventEntry& a, const EventEntry& b)
+	{
+		return a.device != b.device ? a.device < b.device : a.channel < b.channel;
+	});
+
+	for( const ValueEntry& e : m_values )
+	{
+		if( e.target == Button )
+			out.numButtons = std::max(out.numButtons, e.slot + 1);
+		else
+			out.numAxes = std::max(out.numAxes, e.slot + 1);
+	}
+	for( const EventEntry& e : m_events )
+		out.numButtons = std::max(out.numButtons, e.slot + 1);
+}
+
+bool HubMapping::Update(const std::vector<OisDeviceEx*>& devices, HubOutputState& out)
+{
+	bool changed = false;
+	if( Changed(devices) )
+	{
+		Compile(devices, out);
+		changed = true;
+	}
+
+	for( uint8_t slot : m_pulsedButtons )
+		out.buttonValues[slot] = false;
+	changed |= !m_pulsedButtons.empty();
+	m_pulsedButtons.clear();
+
+	for( ValueEntry& e : m_values )
+	{
+		const OisState::NumericValue& v = e.device->DeviceOutputs()[e.index];
+		float value;
+		switch( v.type )
+		{
+		case OisState::Boolean:  value = v.value.boolean ? 1.0f : 0.0f; break;
+		case OisState::Number:   value = v.value.number * e.scale;       break;
+		default:                 value = v.value.fraction * e.scale;     break;
+		}
+		if( value == e.last )
+			continue;
+		e.last = value;
+		changed = true;
+		if( e.target == Button )
+			out.buttonValues[e.slot] = value != 0;
+		else
+			out.axisValues[e.slot] = value;
+	}
+
+	for( OisDeviceEx* item : devices )
+	{
+		for( const OisState::Event* ev : item->newEvents )
+		{
+			EventEntry key = { item->device, ev->channel, 0 };
+			auto it = std::lower_bound(m_events.begin(), m_events.end(), key, [](const EventEntry& a, const EventEntry& b)
+			{
+				return a.device != b.device ? a.device < b.device : a.channel < b.channel;
+			});
+			if( it == m_events.end() || it->device != key.device || it->channel != key.channel )
+				continue;
+			out.buttonValues[it->slot] = true;
+			m_pulsedButtons.push_back(it->slot);
+			changed = true;
+		}
+	}
+	return changed;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "input_ois.h"
+
+//------------------------------------------------------------------------------
+// Maps device outputs and events onto the buttons and axes of an output sink (currently vJoy).
+// The rules come from a mapping file (see ois_hub_mapping.txt for the format). Whenever the set of connected devices
+//  or their registrations change (see OisDevice::RegistrationVersion), the rules are compiled into a flat table of
+//  device output -> button / axis slot + scale, and event channel -> button. Each frame then only walks that table,
+//  and only writes the values that have changed.
+//------------------------------------------------------------------------------
+
+struct HubOutputState
+{
+	float axisValues[8] = {};
+	bool buttonValues[128] = {};
+	int numButtons = 0;
+	int numAxes = 0;
+};
+
+class HubMapping
+{
+public:
+	//Replaces the current rules. If the file is missing or contains no rules, everything is mapped automatically:
+	// boolean outputs and events to buttons and other outputs to axes, in registration order.
+	void Load(const char* path);
+	//e.g. "3 rules from ois_hub_mapping.txt" or "automatic"
+	const std::string& Status() const { return m_status; }
+
+	//Call once per frame after polling the devices. Returns true if `out` changed.
+	bool Update(const std::vector<OisDeviceEx*>& devices, HubOutputState& out);
+private:
+	enum Target : uint8_t { Button, Axis };
+	struct Rule
+	{
+		Target      target;
+		uint8_t     slot;
+		float       scale;//0 for the default
+		std::string device;//empty for any device
+		std::string channel;
+	};
+	struct Signature
+	{
+		OisDeviceHandle handle;
+		unsigned        registrationVersion;
+		bool            connected;
+	};
+	struct ValueEntry
+	{
+		const OisDevice* device;
+		uint16_t         index;//into DeviceOutputs
+		Target           target;
+		uint8_t          slot;
+		float            scale;
+		float            last;
+	};
+	struct EventEntry
+	{
+		const OisDevice* device;
+		uint16_t         channel;
+		uint8_t          slot;
+	};
+
+	static Signature SignatureOf(const OisDeviceEx&);
+	bool Changed(const std::vector<OisDeviceEx*>& devices) const;
+	void Compile(const std::vector<OisDeviceEx*>& devices, HubOutputState& out);
+	const Rule* FindRule(const OisDevice& device, const std::string& channel) const;
+
+	std::vector<Rule>       m_rules;
+	std::string             m_status = "automatic";
+	std::vector<Signature>  m_compiledFor;
+	bool                    m_dirty = true;
+	std::vector<ValueEntry> m_values;
+	std::vector<EventEntry> m_events;//sorted by device, then channel
+	std::vector<uint8_t>    m_pulsedButtons;//event buttons that are held down for one frame
+};
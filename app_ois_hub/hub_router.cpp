@@ -0,0 +1,297 @@
+#include "hub_router.h"
+#include <algorithm>
+#include <math.h>
+
+static std::string Trim(const char* begin, const char* end)
+{
+	while( begin < end && (*begin == ' ' || *begin == '\t') )
+		++begin;
+	while( end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n') )
+		--end;
+	return std::string(begin, end);
+}
+
+static bool EventLess(const OisDevice* deviceA, uint16_t channelA, const OisDevice* deviceB, uint16_t channelB)
+{
+	return deviceA != deviceB ? deviceA < deviceB : channelA < channelB;
+}
+
+bool HubRouter::AddRule(const char* text)
+{
+	//[device/]channel -> [host:]name
+	const char* arrow = strstr(text, "->");
+	if( !arrow )
+		return false;
+	Rule rule;
+	const char* source = text;
+	const char* slash = (const char*)memchr(source, '/', arrow - source);
+	if( slash )
+	{
+		rule.device = Trim(source, slash);
+		source = slash + 1;
+	}
+	rule.channel = Trim(source, arrow);
+	const char* target = arrow + 2;
+	const char* end = target + strlen(target);
+	const char* colon = strchr(target, ':');
+	if( colon )
+	{
+		rule.host = Trim(target, colon);
+		target = colon + 1;
+	}
+	rule.name = Trim(target, end);
+	if( rule.channel.empty() || rule.name.empty() )
+		return false;
+	if( rule.name == "-" )
+		rule.name.clear();
+	m_rules.push_back(rule);
+	m_dirty = true;
+	return true;
+}
+
+void HubRouter::ClearRules()
+{
+	m_rules.clear();
+	m_dirty = true;
+}
+
+void HubRouter::AddHost(const char* name, OisHost& host)
+{
+	Host h = { name, &host, {}, false };
+	m_hosts.push_back(h);
+	m_dirty = true;
+}
+
+void HubRouter::RemoveHost(OisHost& host)
+{
+	m_hosts.erase(std::remove_if(m_hosts.begin(), m_hosts.end(), [&](const Host& h) { return h.host == &host; }), m_hosts.end());
+	m_dirty = true;
+}
+
+HubRouter::Signature HubRouter::SignatureOf(const OisDeviceEx& item)
+{
+	Signature s = { item.handle, 0, false };
+	if( item.device )
+	{
+		s.registrationVersion = item.device->RegistrationVersion();
+		s.connected = item.device->Connected();
+	}
+	return s;
+}
+
+bool HubRouter::Changed(const std::vector<OisDeviceEx*>& devices) const
+{
+	if( m_dirty || devices.size() != m_compiledFor.size() )
+		return true;
+	for( const Host& h : m_hosts )
+		if( h.connecting && !h.host->Connecting() )//the host is handshaking again, so unused channels can go now
+			return true;
+	for( size_t i=0, end=devices.size(); i!=end; ++i )
+	{
+		const Signature& a = m_compiledFor[i];
+		Signature b = SignatureOf(*devices[i]);
+		if( a.handle != b.handle || a.registrationVersion != b.registrationVersion || a.connected != b.connected )
+			return true;
+	}
+	return false;
+}
+
+OisState::Value HubRouter::Convert(OisState::NumericType from, OisState::NumericType to, OisState::Value v)
+{
+	if( from == to )
+		return v;
+	OisState::Value result;
+	result.number = 0;
+	switch( to )
+	{
+	case OisState::Boolean:
+		result.boolean = from == OisState::Number ? v.number != 0 : v.fraction != 0;
+		break;
+	case OisState::Number:
+		result.number = from == OisState::Boolean ? (v.boolean ? 1 : 0) : (int32_t)roundf(v.fraction);
+		break;
+	default:
+		result.fraction = from == OisState::Boolean ? (v.boolean ? 1.0f : 0.0f) : (float)v.number;
+		break;
+	}
+	return result;
+}
+
+const std::string* HubRouter::RoutedName(const OisDevice& device, const std::string& channel, const Host& host) const
+{
+	for( const Rule& r : m_rules )
+	{
+		if( r.channel == channel && (r.device.empty() || r.device == device.GetDeviceName()) && (r.host.empty() || r.host == host.name) )
+			return r.name.empty() ? nullptr : &r.name;
+	}
+	return &channel;
+}
+
+HubRouter::HostChannel& HubRouter::Register(Host& host, Kind kind, const std::string& name, OisState::NumericType type)
+{
+	for( HostChannel& c : host.channels )
+	{
+		if( c.kind != kind || c.name != name )
+			continue;
+		//The first device to use a channel decides its type, and any others are converted to it. A channel that
+		// no device has claimed yet can still change type, by registering it again, unless the game already knows it.
+		if( c.used || c.kind == Event || c.type == type || host.connecting )
+		{
+			c.used = true;
+			return c;
+		}
+		Unregister(host, c);
+		c = host.channels.back();
+		host.channels.pop_back();
+		break;
+	}
+	HostChannel c = { name, kind, type, 0, true };
+	switch( kind )
+	{
+	case Event:  c.channel = host.host->AddEvent(name);        break;
+	case Input:  c.channel = host.host->AddInput(name, type);  break;
+	case Output: c.channel = host.host->AddOutput(name, type); break;
+	}
+	host.channels.push_back(c);
+	return host.channels.back();
+}
+
+void HubRouter::Unregister(Host& host, const HostChannel& c)
+{
+	switch( c.kind )
+	{
+	case Event:  host.host->RemoveEvent(c.channel);  break;
+	case Input:  host.host->RemoveInput(c.channel);  break;
+	case Output: host.host->RemoveOutput(c.channel); break;
+	}
+}
+
+void HubRouter::Compile(const std::vector<OisDeviceEx*>& devices)
+{
+	m_dirty = false;
+	m_compiledFor.clear();
+	m_values.clear();
+	m_events.clear();
+	m_inputs.clear();
+	for( Host& h : m_hosts )
+	{
+		h.connecting = h.host->Connecting();
+		for( HostChannel& c : h.channels )
+			c.used = false;
+	}
+
+	OisState::Value none;//`last` isn't compared until the route has been sent once, while it's dirty
+	none.number = 0;
+	for( OisDeviceEx* item : devices )
+	{
+		m_compiledFor.push_back(SignatureOf(*item));
+		if( !m_compiledFor.back().connected )
+			continue;
+		OisDevice& d = *item->device;
+		for( Host& h : m_hosts )
+		{
+			const auto& outputs = d.DeviceOutputs();
+			for( size_t i=0, end=outputs.size(); i!=end; ++i )
+			{
+				const std::string* name = RoutedName(d, outputs[i].name, h);
+				if( !name )
+					continue;
+				const HostChannel& c = Register(h, Output, *name, outputs[i].type);
+				ValueRoute r = { &d, (uint16_t)i, h.host, c.channel, c.type, true, none };
+				m_values.push_back(r);
+			}
+			for( const OisState::Event& e : d.DeviceEvents() )
+			{
+				const std::string* name = RoutedName(d, e.name, h);
+				if( !name )
+					continue;
+				const HostChannel& c = Register(h, Event, *name, OisState::Boolean);
+				EventRoute r = { &d, e.channel, h.host, c.channel };
+				m_events.push_back(r);
+			}
+			for( const OisState::NumericValue& v : d.DeviceInputs() )
+			{
+				const std::string* name = RoutedName(d, v.name, h);
+				if( !name )
+					continue;
+				const HostChannel& c = Register(h, Input, *name, v.type);
+				InputRoute r = { h.host, c.channel, 0, &d, v.channel, v.type, true, none };
+				m_inputs.push_back(r);
+			}
+		}
+	}
+
+	//Only now remove the channels that are no longer used, so that channels which are still used aren't removed and
+	// added again in between.
+	for( Host& h : m_hosts )
+	{
+		for( size_t i=0; i<h.channels.size(); )
+		{
+			if( h.channels[i].used || h.connecting )
+			{
+				++i;
+				continue;
+			}
+			Unregister(h, h.channels[i]);
+			h.channels[i] = h.channels.back();
+			h.channels.pop_back();
+		}
+	}
+	//Removals move the host's inputs around, so their indices are only known now
+	for( InputRoute& r : m_inputs )
+	{
+		const auto& inputs = r.host->DeviceInputs();
+		for( size_t i=0, end=inputs.size(); i!=end; ++i )
+			if( inputs[i].channel == r.hostChannel )
+				r.index = (uint16_t)i;
+	}
+	std::sort(m_events.begin(), m_events.end(), [](const EventRoute& a, const EventRoute& b)
+	{
+		return EventLess(a.device, a.channel, b.device, b.channel);
+	});
+}
+
+void HubRouter::Update(const std::vector<OisDeviceEx*>& devices)
+{
+	if( Changed(devices) )
+		Compile(devices);
+
+	for( ValueRoute& r : m_values )
+	{
+		const OisState::NumericValue& v = r.device->DeviceOutputs()[r.index];
+		if( !r.dirty && v.value.number == r.last.number )
+			continue;
+		r.dirty = false;
+		r.last = v.value;
+		r.host->SetOutput(r.channel, Convert(v.type, r.type, v.value));
+	}
+
+	for( OisDeviceEx* item : devices )
+	{
+		for( const OisState::Event* ev : item->newEvents )
+		{
+			auto it = std::lower_bound(m_events.begin(), m_events.end(), *ev, [&](const EventRoute& a, const OisState::Event& b)
+			{
+				return EventLess(a.device, a.channel, item->device, b.channel);
+			});
+			for( ; it != m_events.end() && it->device == item->device && it->channel == ev->channel; ++it )
+				it->host->Activate(it->hostChannel);
+		}
+	}
+
+	for( InputRoute& r : m_inputs )
+	{
+		const auto& inputs = r.host->DeviceInputs();
+		if( r.index >= inputs.size() || inputs[r.index].channel != r.hostChannel )
+		{
+			m_dirty = true;//someone else changed the host's registrations; recompile next frame
+			continue;
+		}
+		const OisState::NumericValue& v = inputs[r.index];
+		if( !r.dirty && v.value.number == r.last.number )
+			continue;
+		r.dirty = false;
+		r.last = v.value;
+		r.device->SetInput(r.channel, Convert(v.type, r.type, v.value));
+	}
+}
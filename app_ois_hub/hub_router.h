@@ -0,0 +1,108 @@
+#pragma once
+#include "input_ois.h"
+
+//------------------------------------------------------------------------------
+// Routes channels between any number of devices (OisDevice, e.g. controllers) and hosts (OisHost, e.g. the hub's
+//  connection to a game):
+//  * device outputs -> host outputs, and device events -> host events. Channels that end up with the same name are
+//    merged into a single host channel, e.g. two devices with a "Throttle" output drive one "Throttle" on the host.
+//  * host inputs -> device inputs, fanned out to every device that registered an input with that name.
+// Whenever a device or host comes or goes, or a device's registrations change (see OisDevice::RegistrationVersion),
+//  the routes are recompiled into flat tables, and the hosts are only told about the channels that were added.
+//  The protocol can't unregister a channel from a connected game, so channels that are no longer used stay registered
+//  (and are reused if their device comes back) until the host next handshakes.
+// Each frame then only walks those tables, so forwarding values and events doesn't allocate.
+//------------------------------------------------------------------------------
+
+class HubRouter
+{
+public:
+	//Rules rename channels on their way between the devices and hosts: `[device/]channel -> [host:]name`.
+	// The device and host are optional filters, and a name of "-" hides the channel from the host.
+	// Channels that don't match any rule are routed to every host under their own name.
+	//Returns false if `text` can't be parsed.
+	bool AddRule(const char* text);
+	void ClearRules();
+	size_t NumRules() const { return m_rules.size(); }
+
+	//`name` is used by the host filter of the rules. The host must stay alive until it's removed.
+	void AddHost(const char* name, OisHost& host);
+	void RemoveHost(OisHost& host);
+
+	//Call once per frame after polling the devices, and before polling the hosts.
+	void Update(const std::vector<OisDeviceEx*>& devices);
+private:
+	enum Kind : uint8_t { Event, Input, Output };
+	struct Rule
+	{
+		std::string device;//empty for any device
+		std::string channel;
+		std::string host;//empty for any host
+		std::string name;//empty to hide the channel
+	};
+	struct HostChannel//a channel that the router registered on a host
+	{
+		std::string           name;
+		Kind                  kind;
+		OisState::NumericType type;
+		uint16_t              channel;
+		bool                  used;//by the routes being compiled
+	};
+	struct Host
+	{
+		std::string              name;
+		OisHost*                 host;
+		std::vector<HostChannel> channels;
+		bool                     connecting;//when compiled
+	};
+	struct Signature
+	{
+		OisDeviceHandle handle;
+		unsigned        registrationVersion;
+		bool            connected;
+	};
+	struct ValueRoute//device output -> host output
+	{
+		const OisDevice*      device;
+		uint16_t              index;//into DeviceOutputs
+		OisHost*              host;
+		uint16_t              channel;
+		OisState::NumericType type;//of the host channel
+		bool                  dirty;
+		OisState::Value       last;
+	};
+	struct EventRoute//device event -> host event
+	{
+		const OisDevice* device;
+		uint16_t         channel;
+		OisHost*         host;
+		uint16_t         hostChannel;
+	};
+	struct InputRoute//host input -> device input
+	{
+		OisHost*              host;
+		uint16_t              hostChannel;
+		uint16_t              index;//into the host's DeviceInputs
+		OisDevice*            device;
+		uint16_t              channel;
+		OisState::NumericType type;//of the device channel
+		bool                  dirty;
+		OisState::Value       last;
+	};
+
+	static Signature SignatureOf(const OisDeviceEx&);
+	static OisState::Value Convert(OisState::NumericType from, OisState::NumericType to, OisState::Value);
+	bool Changed(const std::vector<OisDeviceEx*>& devices) const;
+	void Compile(const std::vector<OisDeviceEx*>& devices);
+	const std::string* RoutedName(const OisDevice& device, const std::string& channel, const Host& host) const;
+	HostChannel& Register(Host& host, Kind kind, const std::string& name, OisState::NumericType type);
+	static void Unregister(Host& host, const HostChannel& c);
+
+	std::vector<Rule>       m_rules;
+	std::vector<Host>       m_hosts;
+	std::vector<Signature>  m_compiledFor;
+	bool                    m_dirty = true;
+	std::vector<ValueRoute> m_values;
+	std::vector<EventRoute> m_events;//sorted by device, then channel
+	std::vector<InputRoute> m_inputs;
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// A generational slot map: items are stored in slots that never move, and are referred to by 64-bit handles that
+//  contain the slot index plus a generation count.
+// Lookup, insertion and removal are O(1). A handle to a removed item is detected as stale by Get, even
+//  after its slot has been reused, because the slot's generation changes on removal.
+// Handle 0 is never valid, so it can be used as "none".
+//------------------------------------------------------------------------------
+template<class T>
+class HubSlotMap
+{
+public:
+	typedef uint64_t Handle;
+
+	//Returns the new item's handle. `out_item`, if given, receives a pointer that stays valid until the item is removed.
+	Handle Insert(const T& item, T** out_item = nullptr)
+	{
+		uint32_t index;
+		if( !m_free.empty() )
+		{
+			index = m_free.back();
+			m_free.pop_back();
+		}
+		else
+		{
+			index = (uint32_t)m_slots.size();
+			m_slots.emplace_back();
+		}
+		Slot& s = m_slots[index];
+		s.item = item;
+		s.live = (uint32_t)m_live.size();
+		m_live.push_back(index);
+		if( out_item )
+			*out_item = &s.item;
+		return MakeHandle(index, s.generation);
+	}
+
+	T* Get(Handle h)
+	{
+		uint32_t index = (uint32_t)h;
+		if( index >= m_slots.size() )
+			return nullptr;
+		Slot& s = m_slots[index];
+		return s.generation == (uint32_t)(h >> 32) && s.live != Free ? &s.item : nullptr;
+	}
+
+	bool Remove(Handle h)
+	{
+		if( !Get(h) )
+			return false;
+		uint32_t index = (uint32_t)h;
+		Slot& s = m_slots[index];
+		//swap-and-pop this slot out of the list of live indices
+		uint32_t last = m_live.back();
+		m_live[s.live] = last;
+		m_slots[last].live = s.live;
+		m_live.pop_back();
+		s.live = Free;
+		s.item = T();
+		if( ++s.generation == 0 )
+			s.generation = 1;
+		m_free.push_back(index);
+		return true;
+	}
+
+	void Clear()
+	{
+		while( !m_live.empty() )
+			Remove(HandleOf(m_live.back()));
+	}
+
+	size_t Size() const { return m_live.size(); }
+
+	//Iterate the live items, in no particular order. Don't insert or remove while iterating.
+	template<class Fn> void ForEach(Fn&& fn)
+	{
+		for( uint32_t index : m_live )
+			fn(m_slots[index].item);
+	}
+private:
+	enum : uint32_t { Free = ~0U };
+	struct Slot
+	{
+		T        item = T();
+		uint32_t generation = 1;
+		uint32_t live = Free;//position in m_live, or Free
+	};
+	static Handle MakeHandle(uint32_t index, uint32_t generation) { return ((Handle)generation << 32) | index; }
+	Handle HandleOf(uint32_t index) const { return MakeHandle(index, m_slots[index].generation); }
+
+	std::deque<Slot>      m_slots;//a deque, so that growing it doesn't move existing items
+	std::vector<uint32_t> m_free;
+	std::vector<uint32_t> m_live;
+};
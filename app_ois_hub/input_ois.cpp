@@ -1,9 +1,12 @@
 
 void OisWebbyLog( const char* fmt, ... );
-#define OIS_WEBBY_INFO( fmt, ... ) OisWebbyLog(fmt, __VA_ARGS__);
+#define OIS_WEBBY_INFO( fmt, ... ) OisWebbyLog(fmt, ##__VA_ARGS__);
 
 #define OIS_PROTOCOL_IMPL
 #include "input_ois.h"
+#include "hub_log.h"
+#include "hub_slot_map.h"
+#include "hub_router.h"
 #include <algorithm>
 
 #include "../cpp/ois_webby.h"
@@ -19,6 +22,7 @@ public:
 	}
 	OisPortSerial m_port;
 	OisDevice m_device;
+	OisDeviceHandle m_handle = 0;
 };
 
 class OisSerialConnectionList
@@ -33,22 +37,29 @@ public:
 		devices.clear();
 	}
 	
-	void New(const char* portPath, const OIS_STRING& portName)
+	OisSerialConnection* New(const char* portPath, const OIS_STRING& portName)
 	{
 		devices.push_back(new OisSerialConnection(portPath, portName, GAME_VERSION, GAME_NAME));
+		return devices.back();
 	}
 	
-	auto Find(const OisDevice& d)
+	auto Find(OisDeviceHandle h)
 	{
-		return std::find_if(devices.begin(), devices.end(), [&d](OisSerialConnection* item)
+		return std::find_if(devices.begin(), devices.end(), [h](OisSerialConnection* item)
 		{
-			return &item->m_device == &d;
+			return item->m_handle == h;
 		});
 	}
 
-	bool Delete(const OisDevice& d)
+	bool Delete(OisDeviceHandle h)
 	{
-		auto it = Find(d);
+		auto it = Find(h);
+		return it != devices.end() && Delete(*it);
+	}
+	//For a connection that hasn't been given a handle yet
+	bool Delete(OisSerialConnection* c)
+	{
+		auto it = std::find(devices.begin(), devices.end(), c);
 		if( it == devices.end() )
 			return false;
 		delete *it;
@@ -66,48 +77,24 @@ private:
 	std::vector<OisSerialConnection*> devices;
 };
 
+//Every serial and websocket device. Each connection stores its handle, and is added / removed as it comes and goes.
 class OisAllConnectionList
 {
 public:
-	std::vector<OisDeviceEx> devices;
-
-	OisDeviceEx& Find(IOisPort* p, OisDevice* d)
+	OisDeviceHandle Add(IOisPort* p, OisDevice* d)
 	{
-		auto it = std::find_if(devices.begin(), devices.end(), [d](const OisDeviceEx& item)
-		{
-			return item.device == d;
-		});
-		if( it == devices.end() )
-		{
-			OisDeviceEx e;
-			e.port = p;
-			e.device = d;
-			e.updateCount = updateCount;
-			devices.push_back(e);
-			return devices.back();
-		}
-		else
-		{
-			it->updateCount = updateCount;
-			return *it;
-		}
-	}
-	void GarbageCollect()
-	{
-		for( size_t i=0; i!=devices.size(); )
-		{
-			if( devices[i].updateCount < updateCount )
-			{
-				std::swap(devices[i], devices.back());
-				devices.pop_back();
-			}
-			else
-				++i;
-		}
-		++updateCount;
+		OisDeviceEx* e;
+		OisDeviceHandle h = devices.Insert(OisDeviceEx(), &e);
+		e->handle = h;
+		e->port = p;
+		e->device = d;
+		return h;
 	}
+	void Remove(OisDeviceHandle h)                 { devices.Remove(h); }
+	OisDeviceEx* Find(OisDeviceHandle h)           { return devices.Get(h); }
+	template<class Fn> void ForEach(Fn&& fn)       { devices.ForEach(fn); }
 private:
-	int updateCount = 0;
+	HubSlotMap<OisDeviceEx> devices;
 };
 
 static OIS_STRING_BUILDER sb;
@@ -115,8 +102,11 @@ static OisAllConnectionList    g_allDevices;
 static OisSerialConnectionList g_serialConnections;
 static OisWebHost*             g_websockets = nullptr;
 static const char*             g_webIP = nullptr;
-AppGlobals g;
-constexpr int g_port = 8082;
+static InputOisConfig          g_config;
+static std::vector<InputOisProbe>   g_probes;
+static std::vector<OisDeviceHandle> g_probeHandles;//parallel to g_probes, while probing
+static float                        g_probeTimeout = 0;
+static std::vector<OisWebWhitelist> g_configFiles;//points into g_config
 
 static OisWebWhitelist g_webFiles[] =
 {
@@ -129,11 +119,31 @@ static OisWebWhitelist g_webFiles[] =
 	{ "/example_gamepad/", "../javascript/", true },
 };
 
-void InputOis_Init()
+static void OnWebsocketConnection(OisWebsocketConnection& c, bool added, void*)
+{
+	if( added )
+		c.m_userData = g_allDevices.Add(&c.m_port, &c.m_device);
+	else
+		g_allDevices.Remove(c.m_userData);
+}
+
+void InputOis_Init(const InputOisConfig& config)
 {
 	delete g_websockets;
-	g_websockets = new OisWebHost(GAME_VERSION, GAME_NAME, g_webFiles, true, g_port);
+	g_config = config;
+	g_configFiles.clear();
+	for( const InputOisWebFile& f : g_config.webFiles )
+		g_configFiles.push_back({ f.request.c_str(), f.path.c_str(), f.isPattern });
+	const OisWebWhitelist* files = g_configFiles.empty() ? g_webFiles : &g_configFiles.front();
+	unsigned numFiles = g_configFiles.empty() ? (unsigned)OIS_ARRAYSIZE(g_webFiles) : (unsigned)g_configFiles.size();
+	const char* bindAddress = g_config.webBindAddress.empty() ? nullptr : g_config.webBindAddress.c_str();
+	g_websockets = new OisWebHost(GAME_VERSION, GAME_NAME, files, numFiles, true, g_config.webPort, bindAddress);
+	g_websockets->SetConnectionCallback(&OnWebsocketConnection, nullptr);
+	if( !g_websockets->IsListening() )
+		OisLog("WARN", "Could not start the web server on port %d", (int)g_config.webPort);
 	g_webIP = g_websockets->GetBindAddress().c_str();
+	for( OisSerialConnection* c : g_serialConnections )
+		g_websockets->AddMetrics(c->m_port.Port().PortName().c_str(), c->m_device.Stats());
 }
 
 const char* InputOis_GetWebIP()
@@ -142,7 +152,7 @@ const char* InputOis_GetWebIP()
 }
 int InputOis_GetWebPort()
 {
-	return g_port;
+	return g_config.webPort;
 }
 
 static void UpdateDevice( OisDeviceEx& d, float deltaTime )
@@ -154,6 +164,33 @@ static void UpdateDevice( OisDeviceEx& d, float deltaTime )
 		d.eventLog.push_back(event.name.c_str());
 		d.newEvents.push_back(&event);
 	});
+	if( d.eventLog.size() > InputOisEventLogSize )
+		d.eventLog.erase(d.eventLog.begin(), d.eventLog.end() - InputOisEventLogSize);
+}
+
+static void UpdateProbes( float deltaTime )
+{
+	for( size_t i=0, end=g_probes.size(); i!=end; ++i )
+	{
+		InputOisProbe& p = g_probes[i];
+		if( p.state != InputOisProbe::Probing )
+			continue;
+		p.seconds += deltaTime;
+		OisDeviceEx* d = g_allDevices.Find(g_probeHandles[i]);
+		if( !d )//disconnected by the user
+			p.state = InputOisProbe::Silent;
+		else if( d->device->Connecting() )
+		{
+			p.state = InputOisProbe::Found;
+			OisLog("INFO", "Found an OIS device on %s after %.2fs", p.port.path.c_str(), p.seconds);
+		}
+		else if( p.seconds >= g_probeTimeout )
+		{
+			p.state = InputOisProbe::Silent;
+			OisLog("INFO", "No OIS device on %s after %.2fs", p.port.path.c_str(), p.seconds);
+			InputOis_Disconnect(g_probeHandles[i]);
+		}
+	}
 }
 
 void InputOis_Update( std::vector<OisDeviceEx*>& devices, float deltaTime )
@@ -161,23 +198,20 @@ void InputOis_Update( std::vector<OisDeviceEx*>& devices, float deltaTime )
 	if( !g_websockets )
 		return;
 	
-	for( auto* c : g_serialConnections )
-	{
-		OisDeviceEx& d = g_allDevices.Find( &c->m_port, &c->m_device );
-		UpdateDevice( d, deltaTime );
-	}
+	g_websockets->Poll();//adds / removes websocket devices
+	UpdateProbes( deltaTime );
 
-	g_websockets->Poll();
-	for( auto* c : g_websockets->Connections() )
+	g_allDevices.ForEach([&](OisDeviceEx& d)
 	{
-		OisDeviceEx& d = g_allDevices.Find( &c->m_port, &c->m_device );
 		UpdateDevice( d, deltaTime );
-	}
-
-	g_allDevices.GarbageCollect();
-	
-	for( auto& d : g_allDevices.devices )
 		devices.push_back(&d);
+	});
+}
+
+void InputOis_Flush()
+{
+	if( g_websockets )
+		g_websockets->Flush();
 }
 
 void InputOis_Shutdown()
@@ -185,46 +219,103 @@ void InputOis_Shutdown()
 	delete g_websockets;
 	g_websockets = 0;
 	g_webIP = 0;
+	g_probes.clear();
+	g_probeHandles.clear();
+	for( auto* c : g_serialConnections )
+		g_allDevices.Remove(c->m_handle);
 	g_serialConnections.Clear();
-	g_allDevices.GarbageCollect();
 }
 
 void InputOis_Connect(const PortName& portName)
 {
-	g_serialConnections.New(portName.path.c_str(), portName.name);
+	OisSerialConnection* c = g_serialConnections.New(portName.path.c_str(), portName.name);
+	c->m_handle = g_allDevices.Add(&c->m_port, &c->m_device);
+	if( g_websockets )
+		g_websockets->AddMetrics(portName.path.c_str(), c->m_device.Stats());
 }
 
-void InputOis_Disconnect(const OisDevice& d)
+void InputOis_Discover(const OIS_PORT_LIST& ports, float timeout)
 {
-	if( !g_serialConnections.Delete(d) )
+	g_probes.clear();
+	g_probeHandles.clear();
+	g_probeTimeout = timeout;
+	for( const PortName& port : ports )
 	{
-		g_websockets->Disconnect(d);
+		bool inUse = false;
+		for( OisSerialConnection* c : g_serialConnections )
+			inUse |= c->m_port.Port().PortName() == port.path;
+		if( inUse )
+			continue;
+		//Opening a port is quick, so they're opened here one after the other, and then all of them wait for a
+		// handshake at the same time.
+		InputOisProbe p;
+		p.port = port;
+		OisSerialConnection* c = g_serialConnections.New(port.path.c_str(), port.name);
+		if( !c->m_port.IsConnected() )
+		{
+			p.state = InputOisProbe::Unavailable;
+			OisLog("INFO", "Can't open %s", port.path.c_str());
+			g_serialConnections.Delete(c);
+			g_probeHandles.push_back(0);
+		}
+		else
+		{
+			c->m_handle = g_allDevices.Add(&c->m_port, &c->m_device);
+			g_probeHandles.push_back(c->m_handle);
+			if( g_websockets )
+				g_websockets->AddMetrics(port.path.c_str(), c->m_device.Stats());
+		}
+		g_probes.push_back(p);
 	}
 }
 
+const std::vector<InputOisProbe>& InputOis_GetProbes()
+{
+	return g_probes;
+}
+
+void InputOis_Disconnect(OisDeviceHandle h)
+{
+	OisDeviceEx* d = g_allDevices.Find(h);
+	if( !d )
+		return;
+	if( g_websockets )
+		g_websockets->RemoveMetrics(d->device->Stats());//websocket devices aren't added, so this only affects serial ones
+	if( g_serialConnections.Delete(h) )
+		g_allDevices.Remove(h);
+	else if( g_websockets )
+		g_websockets->Disconnect(*d->device);//removed by OnWebsocketConnection once it has closed
+}
+
+OisDeviceEx* InputOis_Find(OisDeviceHandle h)
+{
+	return g_allDevices.Find(h);
+}
+
 
 
 OisHostEx g_out;
+HubRouter g_router;
 
 void OutputOis_Connect(const PortName& name)
 {
+	if( g_out.device )
+		g_router.RemoveHost(*g_out.device);
 	delete g_out.device;
 	delete g_out.port;
 
+	//The router registers the devices' channels on the output as they come and go
 	g_out.port = new OisPortSerial(name.path.c_str());
 	g_out.device = new OisHost(*g_out.port, name.name, GAME_PID, GAME_VID);
+	g_router.AddHost(name.path.c_str(), *g_out.device);
+}
 
-	for( auto& d : g_allDevices.devices )
-	{
-		for( auto& e : d.device->DeviceEvents() )
-			g_out.device->AddEvent(e.name);
-
-		for( auto& o : d.device->DeviceOutputs() )
-			g_out.device->AddOutput(o.name, o.type);
-	}
+bool OutputOis_AddRoute(const char* rule)
+{
+	return g_router.AddRule(rule);
 }
 
-void OutputOis_Update(OisHostEx*& device, float deltaTime)
+void OutputOis_Update(OisHostEx*& device, const std::vector<OisDeviceEx*>& inputs, float deltaTime)
 {
 	if( !g_out.device )
 	{
@@ -233,28 +324,63 @@ void OutputOis_Update(OisHostEx*& device, float deltaTime)
 	}
 	device = &g_out;
 
+	g_router.Update(inputs);
 	OIS_STRING_BUILDER sb;
 	g_out.device->Poll(sb, deltaTime);
 }
 
+#ifndef _WIN32
+void InputOis_GetPollDescriptors(std::vector<int>& fds, std::vector<bool>& wantWrite)
+{
+	fds.clear();
+	wantWrite.clear();
+	for( OisSerialConnection* c : g_serialConnections )
+	{
+		int fd = c->m_port.Port().FileDescriptor();
+		if( fd >= 0 )
+		{
+			fds.push_back(fd);
+			wantWrite.push_back(false);
+		}
+	}
+	if( g_out.port )
+	{
+		int fd = static_cast<OisPortSerial*>(g_out.port)->Port().FileDescriptor();//OutputOis_Connect only creates serial ports
+		if( fd >= 0 )
+		{
+			fds.push_back(fd);
+			wantWrite.push_back(false);
+		}
+	}
+	if( g_websockets )
+	{
+		size_t sockets[64];
+		int writing[64];
+		int count = std::min(g_websockets->GetSockets(sockets, writing, 64), 64);
+		for( int i=0; i!=count; ++i )
+		{
+			fds.push_back((int)sockets[i]);
+			wantWrite.push_back(writing[i] != 0);
+		}
+	}
+}
+#endif
+
 
 
 void OisLog(const char* category, const char* fmt, ...)
 {
-	std::string str;
+	HubLogLevel level = category[0] == 'I' ? HubLog_Info : category[0] == 'W' ? HubLog_Warn : HubLog_Error;
 	va_list	v;
 	va_start(v, fmt);
-	sb.FormatV(str, fmt, v);
+	HubLog_WriteV(HubLog_Ois, level, fmt, v);
 	va_end( v );
-	g.oisLog.push_back(str);
 }
 
 void OisWebbyLog(const char* fmt, ...)
 {
-	std::string str;
 	va_list	v;
 	va_start(v, fmt);
-	sb.FormatV(str, fmt, v);
+	HubLog_WriteV(HubLog_Webby, HubLog_Info, fmt, v);
 	va_end( v );
-	g.webbyLog.push_back(str);
 }
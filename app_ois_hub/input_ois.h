@@ -1,3 +1,4 @@
+#pragma once
 
 #define GAME_VERSION 1
 #define GAME_NAME    "OisHub"
@@ -6,29 +7,72 @@
 
 void OisLog( const char* category, const char* fmt, ... );
 
-#define OIS_INFO( fmt, ... ) OisLog("INFO", fmt, __VA_ARGS__);
-#define OIS_WARN( fmt, ... ) OisLog("WARN", fmt, __VA_ARGS__);
+#define OIS_INFO( fmt, ... ) OisLog("INFO", fmt, ##__VA_ARGS__);
+#define OIS_WARN( fmt, ... ) OisLog("WARN", fmt, ##__VA_ARGS__);
 #define OIS_ASSERT( condition ) if(!(condition)){OisLog("ASSERTION", "%s(%d) : %s", __FILE__, __LINE__, #condition);}
 #define OIS_ENABLE_ERROR_LOGGING 1
 #define OIS_ENABLE_VIRTUAL_PORT
+#define OIS_ENABLE_STATS
+#define OIS_ENABLE_LINK_MODEL
 
 #include "../cpp/ois_protocol.h"
 
+typedef uint64_t OisDeviceHandle;//a HubSlotMap handle; 0 is never valid
+
+const size_t InputOisEventLogSize = 64;//the most recent events that are kept in OisDeviceEx::eventLog
+
 struct OisDeviceEx
 {
+	OisDeviceHandle handle = 0;
 	IOisPort* port = nullptr;
 	OisDevice* device = nullptr;
 	std::vector<const char*> eventLog;
 	std::vector<const OisState::Event*> newEvents;
-	int updateCount = 0;
 };
 
-void InputOis_Init();
+struct InputOisWebFile
+{
+	std::string request;
+	std::string path;
+	bool isPattern = false;
+};
+struct InputOisConfig
+{
+	unsigned short webPort = 8082;
+	std::string webBindAddress;//empty for this machine's address
+	std::vector<InputOisWebFile> webFiles;//empty for the bundled javascript examples
+};
+
+void InputOis_Init(const InputOisConfig& = InputOisConfig());
 void InputOis_Update( std::vector<OisDeviceEx*>& devices, float deltaTime );
+//Sends whatever the devices wrote during InputOis_Update straight away, rather than on the next update.
+void InputOis_Flush();
 void InputOis_Shutdown();
+#ifndef _WIN32
+//The file descriptors that InputOis_Update / OutputOis_Update read from (serial ports and sockets), so that the caller
+// can sleep in poll() until one of them is ready. `wantWrite` is set for descriptors that are waiting to send.
+void InputOis_GetPollDescriptors(std::vector<int>& fds, std::vector<bool>& wantWrite);
+#endif
+
+//The result of probing one serial port with InputOis_Discover
+struct InputOisProbe
+{
+	enum State { Probing, Found, Silent, Unavailable };
+	PortName port;
+	State state = Probing;
+	float seconds = 0;//until the device answered, or until giving up
+};
 
 void InputOis_Connect(const PortName&);
-void InputOis_Disconnect(const OisDevice&);
+//Opens all of the ports at once (skipping any that are already connected), and keeps the ones where an OIS device
+// starts a handshake within `timeout` seconds. The others are closed again. The time that this takes is bounded by the
+// slowest device, rather than the sum of them. Progress is made during InputOis_Update.
+void InputOis_Discover(const OIS_PORT_LIST& ports, float timeout);
+//The ports probed by the most recent InputOis_Discover
+const std::vector<InputOisProbe>& InputOis_GetProbes();
+void InputOis_Disconnect(OisDeviceHandle);
+//Returns null if the device has been disconnected. The pointer remains valid until then.
+OisDeviceEx* InputOis_Find(OisDeviceHandle);
 
 const char* InputOis_GetWebIP();
 int         InputOis_GetWebPort();
@@ -41,15 +85,9 @@ struct OisHostEx
 	std::vector<const OisState::Event*> newEvents;
 	int updateCount = 0;
 };
+//The output presents the channels of every input device to a game, see HubRouter
 void OutputOis_Connect(const PortName&);
-void OutputOis_Update( OisHostEx*& device, float deltaTime );
-
-
-
-struct AppGlobals
-{
-	std::vector<std::string> oisLog;
-	std::vector<std::string> webbyLog;
-};
+//Adds a HubRouter rule, e.g. "Stick/Trigger -> Fire". Returns false if it can't be parsed.
+bool OutputOis_AddRoute(const char* rule);
+void OutputOis_Update( OisHostEx*& device, const std::vector<OisDeviceEx*>& inputs, float deltaTime );
 
-extern AppGlobals g;
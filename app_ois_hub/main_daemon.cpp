@@ -0,0 +1,404 @@
+//------------------------------------------------------------------------------
+// ois_hubd: a headless hub for Linux (or any POSIX system), for running the hub as a service.
+// It manages serial and websocket devices using the same code as the GUI hub (input_ois.cpp), but instead of polling on
+//  a fixed interval it sleeps in poll() until a serial port or socket is ready. A short timer is only used while a device
+//  is handshaking, so an idle hub uses next to no CPU.
+// Settings are read from a config file (see ois_hubd.conf), log messages go to stderr, and the state of every device is
+//  written as JSON to anyone that connects to the state socket, e.g.:  socat - UNIX-CONNECT:/tmp/ois_hubd.sock
+//
+// Usage: ois_hubd [config file]     (default: ois_hubd.conf)
+// Build e.g.:  cc -O2 -c ../cpp/webby/webby.c -o webby.o
+//              c++ -O2 -std=c++17 main_daemon.cpp input_ois.cpp hub_router.cpp hub_log.cpp webby.o -o ois_hubd -lpthread
+//------------------------------------------------------------------------------
+#include "input_ois.h"
+#include "hub_log.h"
+#include <chrono>
+#include <csignal>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+struct HubdConfig
+{
+	InputOisConfig           input;
+	std::vector<std::string> serialPorts;//paths, or "auto" to probe every port found at startup
+	int                      discoveryTimeoutMs = 3000;
+	std::string              outputPort;
+	std::vector<std::string> routes;//HubRouter rules
+	std::string              stateSocket = "/tmp/ois_hubd.sock";
+	HubLogLevel              logLevel = HubLog_Info;
+	int                      idleTimeoutMs = 500;//keeps websocket keepalive pings flowing
+	int                      handshakeTimeoutMs = 50;
+};
+
+static volatile sig_atomic_t s_quit = 0;
+
+static void OnSignal(int)
+{
+	s_quit = 1;
+}
+
+static std::string Trim(const std::string& s)
+{
+	size_t begin = s.find_first_not_of(" \t\r\n");
+	if( begin == std::string::npos )
+		return std::string();
+	return s.substr(begin, s.find_last_not_of(" \t\r\n") + 1 - begin);
+}
+
+//Splits "request path" for web_file / web_pattern
+static bool SplitPair(const std::string& value, std::string& a, std::string& b)
+{
+	size_t space = value.find_first_of(" \t");
+	if( space == std::string::npos )
+		return false;
+	a = value.substr(0, space);
+	b = Trim(value.substr(space));
+	return !b.empty();
+}
+
+static bool LoadConfig(const char* path, HubdConfig& config)
+{
+	FILE* f = fopen(path, "r");
+	if( !f )
+	{
+		fprintf(stderr, "Can't open %s\n", path);
+		return false;
+	}
+	bool ok = true;
+	char line[512];
+	for( int lineNumber = 1; fgets(line, sizeof(line), f); ++lineNumber )
+	{
+		std::string text = Trim(line);
+		if( text.empty() || text[0] == '#' )
+			continue;
+		size_t equals = text.find('=');
+		if( equals == std::string::npos )
+		{
+			fprintf(stderr, "%s(%d): expected `key = value`\n", path, lineNumber);
+			ok = false;
+			continue;
+		}
+		std::string key = Trim(text.substr(0, equals));
+		std::string value = Trim(text.substr(equals + 1));
+		InputOisWebFile file;
+		if( key == "serial" )
+			config.serialPorts.push_back(value);
+		else if( key == "output" )
+			config.outputPort = value;
+		else if( key == "route" )
+			config.routes.push_back(value);
+		else if( key == "web_port" )
+			config.input.webPort = (unsigned short)atoi(value.c_str());
+		else if( key == "web_bind" )
+			config.input.webBindAddress = value;
+		else if( (key == "web_file" || key == "web_pattern") && SplitPair(value, file.request, file.path) )
+		{
+			file.isPattern = key == "web_pattern";
+			config.input.webFiles.push_back(file);
+		}
+		else if( key == "state_socket" )
+			config.stateSocket = value;
+		else if( key == "idle_timeout_ms" )
+			config.idleTimeoutMs = atoi(value.c_str());
+		else if( key == "discovery_timeout_ms" )
+			config.discoveryTimeoutMs = atoi(value.c_str());
+		else if( key == "handshake_timeout_ms" )
+			config.handshakeTimeoutMs = atoi(value.c_str());
+		else if( key == "log_level" && (value == "info" || value == "warn" || value == "error") )
+			config.logLevel = value == "info" ? HubLog_Info : value == "warn" ? HubLog_Warn : HubLog_Error;
+		else
+		{
+			fprintf(stderr, "%s(%d): unknown setting %s = %s\n", path, lineNumber, key.c_str(), value.c_str());
+			ok = false;
+		}
+	}
+	fclose(f);
+	return ok;
+}
+
+static void ConnectSerialPorts(const HubdConfig& config)
+{
+	OIS_PORT_LIST available;
+	OIS_STRING_BUILDER sb;
+	SerialPort::EnumerateSerialPorts(available, sb, -1);
+	OIS_PORT_LIST probe;
+	for( const std::string& path : config.serialPorts )
+	{
+		if( path != "auto" )
+		{
+			PortName port = { 0, path, path };
+			for( const PortName& p : available )
+				if( p.path == path )
+					port = p;
+			InputOis_Connect(port);
+			continue;
+		}
+		for( const PortName& p : available )
+			if( p.path != config.outputPort )
+				probe.push_back(p);
+	}
+	//Explicitly listed ports are connected above, and so are skipped here
+	if( !probe.empty() )
+		InputOis_Discover(probe, config.discoveryTimeoutMs / 1000.0f);
+}
+
+//------------------------------------------------------------------------------
+// State socket
+
+static int OpenStateSocket(const std::string& path)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if( path.empty() || path.size() >= sizeof(address.sun_path) )
+		return -1;
+	strcpy(address.sun_path, path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if( fd < 0 )
+		return -1;
+	unlink(path.c_str());//left behind by a previous run
+	if( bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 4) != 0 )
+	{
+		fprintf(stderr, "Can't listen on %s: %s\n", path.c_str(), strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void AppendJsonString(std::string& out, const char* s)
+{
+	out += '"';
+	for( ; *s; ++s )
+	{
+		switch( *s )
+		{
+		case '"':  out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n";  break;
+		case '\r': out += "\\r";  break;
+		case '\t': out += "\\t";  break;
+		default:
+			if( (unsigned char)*s < 0x20 )
+			{
+				char escaped[8];
+				snprintf(escaped, sizeof(escaped), "\\u%04x", *s);
+				out += escaped;
+			}
+			else
+				out += *s;
+		}
+	}
+	out += '"';
+}
+
+static void AppendJsonValues(std::string& out, const char* key, const OIS_VECTOR<OisState::NumericValue>& values)
+{
+	out += ",\"";
+	out += key;
+	out += "\":[";
+	for( size_t i=0, end=values.size(); i!=end; ++i )
+	{
+		const OisState::NumericValue& v = values[i];
+		char number[32];
+		switch( v.type )
+		{
+		case OisState::Boolean:  snprintf(number, sizeof(number), "%s", v.value.boolean ? "true" : "false"); break;
+		case OisState::Number:   snprintf(number, sizeof(number), "%d", v.value.number);                     break;
+		default:                 snprintf(number, sizeof(number), "%g", v.value.fraction);                   break;
+		}
+		out += i ? ",{\"channel\":" : "{\"channel\":";
+		out += std::to_string(v.channel);
+		out += ",\"name\":";
+		AppendJsonString(out, v.name.c_str());
+		out += ",\"type\":";
+		out += v.type == OisState::Boolean ? "\"boolean\"" : v.type == OisState::Number ? "\"number\"" : "\"fraction\"";
+		out += ",\"value\":";
+		out += number;
+		out += '}';
+	}
+	out += ']';
+}
+
+template<class T>
+static void AppendJsonDevice(std::string& out, const char* name, IOisPort& port, const T& device, const std::vector<const char*>& eventLog)
+{
+	out += "{\"name\":";
+	AppendJsonString(out, name);
+	out += ",\"port\":";
+	AppendJsonString(out, port.Name());
+	out += ",\"state\":";
+	out += device.Connected() ? "\"active\"" : device.Connecting() ? "\"synchronisation\"" : "\"handshaking\"";
+	const OisLinkEstimate& link = device.Link().Estimate();
+	char linkJson[256];
+	snprintf(linkJson, sizeof(linkJson), ",\"link\":{\"baud\":%u,\"bytesOutPerSecond\":%.1f,\"bytesInPerSecond\":%.1f,"
+	         "\"utilizationOut\":%.3f,\"utilizationIn\":%.3f,\"queueSeconds\":%.4f,\"saturated\":%s}", link.baud,
+	         link.bytesOutPerSecond, link.bytesInPerSecond, link.utilizationOut, link.utilizationIn, link.queueSeconds,
+	         link.saturated ? "true" : "false");
+	out += linkJson;
+	AppendJsonValues(out, "inputs", device.DeviceInputs());
+	AppendJsonValues(out, "outputs", device.DeviceOutputs());
+	out += ",\"recentEvents\":[";
+	for( size_t i=0, end=eventLog.size(); i!=end; ++i )
+	{
+		if( i )
+			out += ',';
+		AppendJsonString(out, eventLog[i]);
+	}
+	out += "]}";
+}
+
+static void WriteState(int client, const std::vector<OisDeviceEx*>& devices, const OisHostEx* output)
+{
+	std::string json = "{\"web\":{\"address\":";
+	AppendJsonString(json, InputOis_GetWebIP() ? InputOis_GetWebIP() : "");
+	json += ",\"port\":" + std::to_string(InputOis_GetWebPort()) + "},\"devices\":[";
+	for( size_t i=0, end=devices.size(); i!=end; ++i )
+	{
+		if( i )
+			json += ',';
+		AppendJsonDevice(json, devices[i]->device->GetDeviceName(), *devices[i]->port, *devices[i]->device, devices[i]->eventLog);
+	}
+	json += "],\"probes\":[";
+	const char* const probeStates[] = { "probing", "found", "silent", "unavailable" };
+	const std::vector<InputOisProbe>& probes = InputOis_GetProbes();
+	for( size_t i=0, end=probes.size(); i!=end; ++i )
+	{
+		json += i ? ",{\"path\":" : "{\"path\":";
+		AppendJsonString(json, probes[i].port.path.c_str());
+		json += ",\"state\":\"";
+		json += probeStates[probes[i].state];
+		char seconds[32];
+		snprintf(seconds, sizeof(seconds), "\",\"seconds\":%.3f}", probes[i].seconds);
+		json += seconds;
+	}
+	json += "],\"output\":";
+	if( output && output->device )
+		AppendJsonDevice(json, output->device->GetGameName().c_str(), *output->port, *output->device, output->eventLog);
+	else
+		json += "null";
+	json += "}\n";
+
+	//The client gets a short time to read it all, so that a stuck client can't stall the devices
+	timeval timeout = { 0, 100000 };
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	int flags = fcntl(client, F_GETFL);
+	fcntl(client, F_SETFL, flags & ~O_NONBLOCK);
+	for( size_t sent = 0; sent < json.size(); )
+	{
+		ssize_t n = send(client, json.data() + sent, json.size() - sent, MSG_NOSIGNAL);
+		if( n <= 0 )
+			break;
+		sent += (size_t)n;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+static void PrintLogs()
+{
+	HubLog_Collect();
+	static const char* const categories[HubLog_NumCategories] = { "ois", "webby" };
+	char line[1024];
+	for( int c=0; c!=HubLog_NumCategories; ++c )
+	{
+		HubLogCategory category = (HubLogCategory)c;
+		for( unsigned i=0, end=HubLog_Count(category); i!=end; ++i )
+		{
+			HubLog_Format(category, i, line, sizeof(line));
+			fprintf(stderr, "[%s] %s\n", categories[c], line);
+		}
+		HubLog_Clear(category);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* configPath = argc > 1 ? argv[1] : "ois_hubd.conf";
+	HubdConfig config;
+	if( !LoadConfig(configPath, config) )
+		return 1;
+	for( int c=0; c!=HubLog_NumCategories; ++c )
+		HubLog_SetLevel((HubLogCategory)c, config.logLevel);
+
+	struct sigaction action = {};
+	action.sa_handler = &OnSignal;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+	signal(SIGPIPE, SIG_IGN);//dead sockets are detected by their send() errors
+
+	InputOis_Init(config.input);
+	ConnectSerialPorts(config);
+	int stateSocket = OpenStateSocket(config.stateSocket);
+	fprintf(stderr, "ois_hubd: websockets on %s:%d, state on %s\n", InputOis_GetWebIP(), InputOis_GetWebPort(), stateSocket >= 0 ? config.stateSocket.c_str() : "(none)");
+
+	for( const std::string& route : config.routes )
+		if( !OutputOis_AddRoute(route.c_str()) )
+			fprintf(stderr, "%s: can't parse route %s\n", configPath, route.c_str());
+	if( !config.outputPort.empty() )
+	{
+		PortName port = { 0, config.outputPort, config.outputPort };
+		OutputOis_Connect(port);
+	}
+
+	std::vector<OisDeviceEx*> devices;
+	OisHostEx* output = nullptr;
+	std::vector<int> fds;
+	std::vector<bool> wantWrite;
+	std::vector<pollfd> waits;
+	bool busy = true;
+	auto time = std::chrono::steady_clock::now();
+	while( !s_quit )
+	{
+		InputOis_GetPollDescriptors(fds, wantWrite);
+		waits.clear();
+		for( size_t i=0, end=fds.size(); i!=end; ++i )
+			waits.push_back({ fds[i], (short)(POLLIN | (wantWrite[i] ? POLLOUT : 0)), 0 });
+		if( stateSocket >= 0 )
+			waits.push_back({ stateSocket, POLLIN, 0 });
+		if( poll(waits.empty() ? nullptr : &waits.front(), (nfds_t)waits.size(), busy ? config.handshakeTimeoutMs : config.idleTimeoutMs) < 0 && errno != EINTR )
+		{
+			fprintf(stderr, "poll failed: %s\n", strerror(errno));
+			break;
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		float deltaTime = std::chrono::duration<float>(now - time).count();
+		time = now;
+
+		devices.clear();
+		InputOis_Update(devices, deltaTime);
+		OutputOis_Update(output, devices, deltaTime);
+		InputOis_Flush();
+
+		//Timers only matter while a device is handshaking: otherwise everything happens in response to I/O.
+		//Closed ports are retried once a second at most, so the idle timeout is enough for those.
+		busy = output && output->device && output->port->IsConnected() && !output->device->Connected();
+		for( OisDeviceEx* d : devices )
+			busy |= d->port->IsConnected() && !d->device->Connected();
+
+		if( stateSocket >= 0 )
+		{
+			int client;
+			while( (client = accept(stateSocket, nullptr, nullptr)) >= 0 )
+			{
+				WriteState(client, devices, output);
+				close(client);
+			}
+		}
+		PrintLogs();
+	}
+
+	fprintf(stderr, "ois_hubd: shutting down\n");
+	if( stateSocket >= 0 )
+	{
+		close(stateSocket);
+		unlink(config.stateSocket.c_str());
+	}
+	InputOis_Shutdown();
+	PrintLogs();
+	return 0;
+}
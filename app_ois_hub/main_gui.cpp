@@ -8,14 +8,10 @@
 #include <limits.h>
 #include <chrono>
 
-#include "input_ois.h"
+#include "hub_io.h"
+#include "hub_log.h"
 
 void RunDemoGui();
-
-bool VJoy_Init(char* out_error, int errorSize);
-void VJoy_Shutdown();
-void VJoy_Pause();
-void VJoy_Update( int numAxes, float* axes, int numButtons, bool* buttons );
  
 static void PrintError( const TCHAR* what, DWORD dwLastError )
 {
@@ -52,20 +48,42 @@ int main( int argc, char *argv[] )
 #include "nuklear/nuklear.h"
 #include "nuklear/nuklear_gdi.h"
 
-void DoLogGui(struct nk_context* ctx, std::vector<std::string>& log)
+//The GUI is rebuilt at most this often, independently of how often the I/O thread polls the devices. It's only
+// redrawn if the rebuilt draw commands differ from the ones that are on screen.
+const int s_maxRedrawsPerSecond = 30;
+static bool s_resized = false;
+
+void DoLogGui(struct nk_context* ctx, HubLogCategory category)
 {
-	nk_layout_row_dynamic(ctx, 30, 1);
+	nk_layout_row_dynamic(ctx, 30, 2);
 	if( nk_button_label(ctx, "Clear Log") )
 	{
-		log.clear();
+		HubLog_Clear(category);
+	}
+	const char* levels[HubLog_NumLevels];
+	for( int i=0; i!=HubLog_NumLevels; ++i )
+		levels[i] = HubLog_LevelName((HubLogLevel)i);
+	int level = nk_combo(ctx, levels, HubLog_NumLevels, HubLog_GetLevel(category), 30, nk_vec2(200, 130));
+	HubLog_SetLevel(category, (HubLogLevel)level);
+	uint64_t dropped = HubLog_Dropped(category);
+	if( dropped )
+	{
+		nk_layout_row_dynamic(ctx, 30, 1);
+		nk_labelf(ctx, NK_TEXT_LEFT, "%llu messages dropped", (unsigned long long)dropped);
 	}
+	//Only the visible lines are formatted
 	nk_layout_row_dynamic(ctx, 200, 1);
-	if( nk_group_begin(ctx, "Log", 0) )
+	struct nk_list_view view;
+	if( nk_list_view_begin(ctx, &view, "Log", 0, 30, HubLog_Count(category)) )
 	{
 		nk_layout_row_dynamic(ctx, 30, 1);
-		for( auto it = log.begin(); it != log.end(); ++it )
-			nk_label(ctx, it->c_str(), NK_TEXT_LEFT);
-		nk_group_end(ctx);
+		char line[256];
+		for( int i = view.begin; i != view.end; ++i )
+		{
+			HubLog_Format(category, i, line, sizeof(line));
+			nk_label(ctx, line, NK_TEXT_LEFT);
+		}
+		nk_list_view_end(&view);
 	}
 }
 
@@ -93,80 +111,99 @@ void DoConnectingGui(struct nk_context* ctx)
 			std::string label = it->name + " (" + it->path + ')';
 			if( nk_button_label(ctx, label.c_str()) )
 			{
-				if( output )
-					OutputOis_Connect(*it);
-				else
-					InputOis_Connect(*it);
+				HubCommand c;
+				c.type = output ? HubCommand::ConnectOutput : HubCommand::ConnectInput;
+				c.port = *it;
+				HubIo_Send(c);
 			}
 		}
 	}
 }
 
-void TGui_Disconnect(const OisDevice& d)
-{
-	InputOis_Disconnect(d);
-}
-void TGui_Disconnect(const OisHost& d) {}
-const char* TGui_GetName(const OisDevice& d)
-{
-	return d.GetDeviceName();
-}
-const char* TGui_GetName(const OisHost& d)
-{
-	return d.GetGameName().c_str();
-}
-
-void TGui_SetInput(OisDevice& d, const OisState::NumericValue& input, const OisState::Value& newValue)
+void DoDiscoveryGui(struct nk_context* ctx, const HubSnapshot& snapshot)
 {
-	d.SetInput(input, newValue);
+	nk_layout_row_dynamic(ctx, 30, 1);
+	if( nk_button_label(ctx, "Auto-connect all COM ports") )
+	{
+		HubCommand c;
+		c.type = HubCommand::DiscoverInputs;
+		HubIo_Send(c);
+	}
+	const float ratio2[] = {0.6f, 0.4f};
+	nk_layout_row(ctx, NK_DYNAMIC, 30, 2, ratio2);
+	for( const InputOisProbe& p : snapshot.probes )
+	{
+		nk_labelf(ctx, NK_TEXT_LEFT, "%s (%s)", p.port.name.c_str(), p.port.path.c_str());
+		switch( p.state )
+		{
+		case InputOisProbe::Probing:     nk_labelf(ctx, NK_TEXT_LEFT, "probing... %.1fs", p.seconds);  break;
+		case InputOisProbe::Found:       nk_labelf(ctx, NK_TEXT_LEFT, "found in %.2fs", p.seconds);    break;
+		case InputOisProbe::Silent:      nk_labelf(ctx, NK_TEXT_LEFT, "no answer (%.1fs)", p.seconds); break;
+		case InputOisProbe::Unavailable: nk_label(ctx, "can't open", NK_TEXT_LEFT);                     break;
+		}
+	}
 }
-void TGui_SetInput(OisHost& d, const OisState::NumericValue& input, const OisState::Value& newValue) {}
 
-template<class T>
-void DoOisGui(struct nk_context* ctx, T& d)
+//Devices are owned by the I/O thread. `isInput` is false for the output device, which can't be edited from here.
+void DoOisGui(struct nk_context* ctx, const HubDeviceSnapshot& d, bool isInput)
 {
-	auto* device = d.device;
-	if( !device )
-		return;
 	const float ratio2[] = {0.4f, 0.6f};
 	
 	nk_layout_row_dynamic(ctx, 30, 1);
 	if( nk_button_label(ctx, "Disconnect") )
 	{
-		TGui_Disconnect(*device);
+		if( isInput )
+		{
+			HubCommand c;
+			c.type = HubCommand::Disconnect;
+			c.device = d.id;
+			HubIo_Send(c);
+		}
 		return;
 	}
 	nk_layout_row(ctx, NK_DYNAMIC, 30, 2, ratio2);
 	nk_label(ctx, "Name", NK_TEXT_LEFT);
-	nk_label(ctx, TGui_GetName(*device), NK_TEXT_LEFT);
+	nk_label(ctx, d.name.c_str(), NK_TEXT_LEFT);
 	//nk_label(ctx, "PID", NK_TEXT_LEFT);
 	//nk_labelf(ctx, NK_TEXT_LEFT, "0x%8X", device->GetProductID());
 	//nk_label(ctx, "VID", NK_TEXT_LEFT);
 	//nk_labelf(ctx, NK_TEXT_LEFT, "0x%8X", device->GetVendorID());
 	nk_label(ctx, "Port", NK_TEXT_LEFT);
-	nk_labelf(ctx, NK_TEXT_LEFT, "%s", d.port->Name());
+	nk_labelf(ctx, NK_TEXT_LEFT, "%s", d.portName.c_str());
 	nk_label(ctx, "State", NK_TEXT_LEFT);
-	if( device->Connected() )
+	if( d.state == HubDeviceSnapshot::Active )
 		nk_label(ctx, "Active", NK_TEXT_LEFT);
-	else if( device->Connecting() )
+	else if( d.state == HubDeviceSnapshot::Synchronisation )
 		nk_label(ctx, "Sync", NK_TEXT_LEFT);
 	else
 		nk_label(ctx, "Handshake", NK_TEXT_LEFT);
+	nk_label(ctx, "Link", NK_TEXT_LEFT);
+	if( d.link.baud )
+		nk_labelf(ctx, NK_TEXT_LEFT, "%u baud: %.0f%% out, %.0f%% in, %.1f ms queued", d.link.baud,
+		          d.link.utilizationOut * 100, d.link.utilizationIn * 100, d.link.queueSeconds * 1000);
+	else
+		nk_labelf(ctx, NK_TEXT_LEFT, "%.0f B/s out, %.0f B/s in", d.link.bytesOutPerSecond, d.link.bytesInPerSecond);
 	
 	nk_layout_row_dynamic(ctx, 30, 1);
+	if( d.link.saturated )
+		nk_label_colored(ctx, "The link is saturated, so values will lag: use a higher baud rate, or send less often",
+		                 NK_TEXT_LEFT, nk_rgb(255, 96, 64));
 	
 	if (nk_tree_push(ctx, NK_TREE_TAB, "Events", NK_MAXIMIZED))
 	{
 		if( nk_button_label(ctx, "Clear Event Log") )
 		{
-			d.eventLog.clear();
+			HubCommand c;
+			c.type = HubCommand::ClearEvents;
+			c.device = d.id;
+			HubIo_Send(c);
 		}
 		nk_layout_row_dynamic(ctx, 200, 1);
 		if( nk_group_begin(ctx, "Event Log", 0) )
 		{
 			nk_layout_row_dynamic(ctx, 30, 1);
-			for( auto it = d.eventLog.begin(); it != d.eventLog.end(); ++it )
-				nk_label(ctx, *it, NK_TEXT_LEFT);
+			for( auto it = d.recentEvents.begin(); it != d.recentEvents.end(); ++it )
+				nk_label(ctx, it->c_str(), NK_TEXT_LEFT);
 			nk_group_end(ctx);
 		}
 		nk_tree_pop(ctx);
@@ -174,7 +211,7 @@ void DoOisGui(struct nk_context* ctx, T& d)
 
 	if (nk_tree_push(ctx, NK_TREE_TAB, "Inputs", NK_MAXIMIZED))
 	{
-		auto& inputs = device->DeviceInputs();
+		auto& inputs = d.inputs;
 		for( auto it = inputs.begin(); it != inputs.end(); ++it )
 		{
 			std::string name = it->name + " : ch" + std::to_string(it->channel);
@@ -213,8 +250,15 @@ void DoOisGui(struct nk_context* ctx, T& d)
 						break;
 					}
 				}
-				if( set )
-					TGui_SetInput(*device, *it, newValue);
+				if( set && isInput )
+				{
+					HubCommand c;
+					c.type = HubCommand::SetInput;
+					c.device = d.id;
+					c.channel = it->channel;
+					c.value = newValue;
+					HubIo_Send(c);
+				}
 				nk_tree_pop(ctx);
 			}
 		}
@@ -223,7 +267,7 @@ void DoOisGui(struct nk_context* ctx, T& d)
 	
 	if (nk_tree_push(ctx, NK_TREE_TAB, "Outputs", NK_MAXIMIZED))
 	{
-		auto& outputs = device->DeviceOutputs();
+		auto& outputs = d.outputs;
 		for( auto it = outputs.begin(); it != outputs.end(); ++it )
 		{
 			std::string name = it->name + " : ch" + std::to_string(it->channel);
@@ -246,103 +290,57 @@ void DoOisGui(struct nk_context* ctx, T& d)
 	}
 }
 
-static bool s_enableVJoyOutput = false;
-static char s_vjoyError[1024] = {'\0'};
-struct VJoyState
-{
-	float axisValues[8] = {};
-	bool buttonValues[128] = {};
-	int numButtons = 0;
-	int numAxes = 0;
-} g_vJoyState;
-void DoVJoyGui(struct nk_context* ctx)
+void DoVJoyGui(struct nk_context* ctx, const HubSnapshot& snapshot)
 {
 	nk_layout_row_dynamic(ctx, 30, 1);
-	if( !s_enableVJoyOutput )
+	if( !snapshot.vjoyEnabled )
 	{
 		if( nk_button_label(ctx, "Enable vJoy output") )
-			s_enableVJoyOutput = VJoy_Init(s_vjoyError, 1024);
-		if( s_vjoyError[0] != '\0' )
-			nk_labelf(ctx, NK_TEXT_LEFT, "Error: %s", s_vjoyError);
+		{
+			HubCommand c;
+			c.type = HubCommand::EnableVJoy;
+			HubIo_Send(c);
+		}
+		if( !snapshot.vjoyError.empty() )
+			nk_labelf(ctx, NK_TEXT_LEFT, "Error: %s", snapshot.vjoyError.c_str());
 		return;
 	}
 	if( nk_button_label(ctx, "Disable vJoy output") )
 	{
-		s_enableVJoyOutput = false;
-		VJoy_Shutdown();
+		HubCommand c;
+		c.type = HubCommand::DisableVJoy;
+		HubIo_Send(c);
 		return;
 	}
 
-	if( g_vJoyState.numAxes )
+	nk_layout_row_dynamic(ctx, 30, 2);
+	nk_labelf(ctx, NK_TEXT_LEFT, "Mapping: %s", snapshot.mappingStatus.c_str());
+	if( nk_button_label(ctx, "Reload mapping") )
+	{
+		HubCommand c;
+		c.type = HubCommand::ReloadMapping;
+		HubIo_Send(c);
+	}
+
+	nk_layout_row_dynamic(ctx, 30, 1);
+	HubOutputState vJoyState = snapshot.outputState;
+	if( vJoyState.numAxes )
 		nk_label(ctx, "Axes", NK_TEXT_ALIGN_LEFT);
-	for( int i=0; i!=g_vJoyState.numAxes; ++i )
-		nk_slider_float(ctx, -1, &g_vJoyState.axisValues[i], 1, 0.1f);
+	for( int i=0; i!=vJoyState.numAxes; ++i )
+		nk_slider_float(ctx, -1, &vJoyState.axisValues[i], 1, 0.1f);
 
-	if( g_vJoyState.numButtons )
+	if( vJoyState.numButtons )
 		nk_label(ctx, "Buttons", NK_TEXT_ALIGN_LEFT);
 	nk_layout_row_dynamic(ctx, 30, 5);
-	for( int i=0; i!=g_vJoyState.numButtons; ++i )
+	for( int i=0; i!=vJoyState.numButtons; ++i )
 	{
 		char label[32];
 		sprintf(label, "Btn%d", i);
-		nk_check_label(ctx, label, g_vJoyState.buttonValues[i]);
-	}
-}
-
-void DoVJoyUpdate(std::vector<OisDeviceEx*>& devices)
-{
-	for( int i=0; i!=g_vJoyState.numButtons; ++i )
-		g_vJoyState.buttonValues[i] = false;
-	
-	int numButtons = 0;
-	int numAxes = 0;
-	
-	for( auto& item : devices )
-	{
-		OisDevice* device = item->device;
-		if( !device || !device->Connected() )
-			continue;
-		
-		const auto& events  = device->DeviceEvents();
-		const auto& outputs = device->DeviceOutputs();
-
-		//map events onto buttons:
-		for( auto it = item->newEvents.begin(); it != item->newEvents.end(); ++it )
-		{
-			const OisState::Event* event = *it;
-			int index = (int)(ptrdiff_t)(event - &events.front());
-			if( index >= 0 && index < numButtons )
-				g_vJoyState.buttonValues[index] = true;
-		}
-
-		//numeric output bools to buttons, others to axes
-		for( auto it = outputs.begin(); it != outputs.end(); ++it )
-		{
-			if( it->type == OisState::Boolean )
-				g_vJoyState.buttonValues[numButtons++] = it->value.boolean;
-			else
-			{
-				if( it->type == OisState::Number )
-					g_vJoyState.axisValues[numAxes++] = it->value.number / (float)MAXSHORT;
-				else
-					g_vJoyState.axisValues[numAxes++] = it->value.fraction / 100.0f;
-			}
-		}
-	}
-
-	if( numButtons || numAxes )
-	{
-		g_vJoyState.numButtons = numButtons;
-		g_vJoyState.numAxes = numAxes;
-		VJoy_Update(numAxes, g_vJoyState.axisValues, numButtons, g_vJoyState.buttonValues);
-	}
-	else 
-	{
-		VJoy_Pause();
+		nk_check_label(ctx, label, vJoyState.buttonValues[i]);
 	}
 }
 
-void DrawGui(struct nk_context* ctx, std::vector<OisDeviceEx*>& devices, OisHostEx* outputDevice)
+void DrawGui(struct nk_context* ctx, const HubSnapshot& snapshot)
 {
 	if (nk_begin(ctx, "Inputs", nk_rect(0, 0, (float)gdi.width/2-2, (float)gdi.height), 0))
 	{
@@ -357,20 +355,21 @@ void DrawGui(struct nk_context* ctx, std::vector<OisDeviceEx*>& devices, OisHost
 		}
 		if (nk_tree_push(ctx, NK_TREE_TAB, "Ois Log", NK_MINIMIZED))
 		{
-			DoLogGui(ctx, g.oisLog);
+			DoLogGui(ctx, HubLog_Ois);
 			nk_tree_pop(ctx);
 		}
 		if (nk_tree_push(ctx, NK_TREE_TAB, "Websocket Log", NK_MINIMIZED))
 		{
-			DoLogGui(ctx, g.webbyLog);
+			DoLogGui(ctx, HubLog_Webby);
 			nk_tree_pop(ctx);
 		}
+		DoDiscoveryGui(ctx, snapshot);
 		DoConnectingGui<false>(ctx);
-		for( auto& item : devices )
+		for( auto& item : snapshot.inputs )
 		{
-			if (nk_tree_push(ctx, NK_TREE_TAB, "Ois Input", NK_MAXIMIZED))
+			if (nk_tree_push_id(ctx, NK_TREE_TAB, "Ois Input", NK_MAXIMIZED, (int)item.id))
 			{
-				DoOisGui(ctx, *item);
+				DoOisGui(ctx, item, true);
 				nk_tree_pop(ctx);
 			}
 		}
@@ -378,17 +377,27 @@ void DrawGui(struct nk_context* ctx, std::vector<OisDeviceEx*>& devices, OisHost
 	nk_end(ctx);
 	if (nk_begin(ctx, "Outputs", nk_rect((float)gdi.width/2+2, 0, (float)gdi.width/2-2, (float)gdi.height), 0))
 	{
-		DoVJoyGui(ctx);
+		DoVJoyGui(ctx, snapshot);
 		DoConnectingGui<true>(ctx);
-		if (outputDevice && nk_tree_push(ctx, NK_TREE_TAB, "Ois Input", NK_MAXIMIZED))
+		if (snapshot.hasOutput && nk_tree_push(ctx, NK_TREE_TAB, "Ois Input", NK_MAXIMIZED))
 		{
-			DoOisGui(ctx, *outputDevice);
+			DoOisGui(ctx, snapshot.output, false);
 			nk_tree_pop(ctx);
 		}
 	}
 	nk_end(ctx);
-	
-	nk_gdi_render( nk_rgb(30,30,30) );
+}
+
+//FNV-1a of every draw command that the last DrawGui produced
+static uint64_t HashDrawCommands(struct nk_context* ctx)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	const nk_byte* bytes = (const nk_byte*)nk_buffer_memory_const(&ctx->memory);
+	for( nk_size i=0, end=ctx->memory.allocated; i!=end; ++i )
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	for( const struct nk_window* w = ctx->begin; w; w = w->next )//the window order decides which is drawn on top
+		hash = (hash ^ (uint64_t)w->buffer.begin) * 1099511628211ULL;
+	return hash;
 }
 
 static LRESULT CALLBACK WindowProc(HWND wnd, UINT msg, WPARAM wparam, LPARAM lparam)
@@ -398,6 +407,9 @@ static LRESULT CALLBACK WindowProc(HWND wnd, UINT msg, WPARAM wparam, LPARAM lpa
 	case WM_DESTROY:
 		PostQuitMessage(0);
 		return 0;
+	case WM_SIZE:
+		s_resized = true;//the back buffer is recreated empty
+		break;
 	}
 
 	if (nk_gdi_handle_event(wnd, msg, wparam, lparam))
@@ -438,44 +450,59 @@ void RunDemoGui()
 	font = nk_gdifont_create("Arial", 24);
 	ctx = nk_gdi_init(font, dc, WINDOW_WIDTH, WINDOW_HEIGHT);
 
-	InputOis_Init();
-	
-	std::vector<OisDeviceEx*> inputDevices;
-	
-	auto time = std::chrono::steady_clock::now();
-	float deltaTime = 0;
+	HubIo_Start();
+
+	typedef std::chrono::steady_clock Clock;
+	const Clock::duration frameInterval = std::chrono::microseconds(1000000 / s_maxRedrawsPerSecond);
+	Clock::time_point nextFrame = Clock::now();
+	uint64_t drawnHash = 0;
+	bool changed = true;
+	nk_input_begin( ctx );
 	while( running )
 	{
+		//Sleep until there's a window message or it's time for the next frame. Input is gathered until then.
+		Clock::time_point now = Clock::now();
+		if( now < nextFrame )
+		{
+			DWORD waitMs = (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(nextFrame - now).count();
+			MsgWaitForMultipleObjects( 0, NULL, FALSE, waitMs, QS_ALLINPUT );
+		}
 		MSG msg;
-		nk_input_begin( ctx );
 		while( PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE) ) 
 		{
 			if( msg.message == WM_QUIT )
 				running = 0;
 			TranslateMessage(&msg);
 			DispatchMessageW(&msg);
+			changed = true;
 		}
+		if( Clock::now() < nextFrame )
+			continue;
+		nextFrame = Clock::now() + frameInterval;
 		nk_input_end( ctx );
-		
-		InputOis_Update( inputDevices, deltaTime );
-
-		OisHostEx* outputDevice = 0;
-		OutputOis_Update( outputDevice, deltaTime );
-
-		DrawGui( ctx, inputDevices, outputDevice );
-		
-		DoVJoyUpdate( inputDevices );
 
-		Sleep(1);
-		inputDevices.clear();
-		
-		auto end = std::chrono::steady_clock::now();
-        std::chrono::duration<float> diff = end-time;
-		deltaTime = diff.count();
-		time = end;
+		bool newSnapshot;
+		const HubSnapshot& snapshot = HubIo_Snapshot( &newSnapshot );
+		changed |= HubLog_Collect();
+		changed |= newSnapshot;
+		if( changed )
+		{
+			DrawGui( ctx, snapshot );
+			uint64_t hash = HashDrawCommands( ctx );
+			if( hash != drawnHash || s_resized )
+			{
+				nk_gdi_render( nk_rgb(30,30,30) );//also clears the commands
+				drawnHash = hash;
+				s_resized = false;
+			}
+			else
+				nk_clear( ctx );
+		}
+		changed = false;
+		nk_input_begin( ctx );
 	}
 	
-	InputOis_Shutdown();
+	HubIo_Stop();
 
 	nk_gdifont_del(font);
 	ReleaseDC(wnd, dc);
@@ -0,0 +1,178 @@
+#ifndef OIS_ARDUINO_HOST_INCLUDED
+#define OIS_ARDUINO_HOST_INCLUDED
+//------------------------------------------------------------------------------
+// A stand-in for the parts of the Arduino core that ../ois_protocol.h uses, so that a sketch can be built and run on
+//  a PC, e.g. against the C++ OisDevice in the same process (see cpp/bench/bench_arduino.cpp).
+// * Time is simulated: micros / millis return OisHostMicros(), which only moves when the program advances it, or
+//   when the sketch calls delay (see OisHostDelay).
+// * Serial is an in-memory serial line. The other end of the cable reads Serial.fromSketch, and writes into
+//   Serial.toSketch. Bytes take 10 bit times each to arrive (8N1) at the baud rate passed to Serial.begin.
+// Include this before ../ois_protocol.h.
+//------------------------------------------------------------------------------
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+
+typedef uint32_t     u32;
+typedef unsigned int uint;
+typedef uint8_t      byte;
+
+#define DEC 10
+#define HEX 16
+
+template<class T> T min(T a, T b) { return a < b ? a : b; }
+template<class T> T max(T a, T b) { return a > b ? a : b; }
+
+inline bool isDigit(int c) { return 0 != isdigit(c); }
+
+inline char* ltoa(long value, char* buffer, int base)
+{
+  sprintf(buffer, base == HEX ? "%lx" : "%ld", value);
+  return buffer;
+}
+
+//------------------------------------------------------------------------------
+// Simulated time, in microseconds since the program started
+inline uint64_t& OisHostMicros()
+{
+  static uint64_t now = 0;
+  return now;
+}
+//Called instead of advancing the time when the sketch calls delay, so that the other end of the cable can keep
+// running meanwhile. It must advance OisHostMicros() by the given number of microseconds.
+typedef void (*OisHostDelayFn)(void* user, uint64_t us);
+inline OisHostDelayFn& OisHostDelay()     { static OisHostDelayFn fn = nullptr; return fn; }
+inline void*&          OisHostDelayUser() { static void* user = nullptr; return user; }
+
+inline unsigned long micros()                    { return (unsigned long)OisHostMicros(); }
+inline unsigned long millis()                    { return (unsigned long)(OisHostMicros() / 1000); }
+inline void          delayMicroseconds(uint us)
+{
+  if( OisHostDelay() )
+    OisHostDelay()(OisHostDelayUser(), us);
+  else
+    OisHostMicros() += us;
+}
+inline void          delay(unsigned long ms)     { delayMicroseconds((uint)(ms * 1000)); }
+
+//------------------------------------------------------------------------------
+// One direction of a serial line. Bytes are sent one after another, and can only be read once they've arrived.
+class OisHostLink
+{
+public:
+  //0 delivers everything instantly
+  void SetBaud(long baud)
+  {
+    m_baud = baud;
+  }
+  void Send(const void* data, size_t size)
+  {
+    if( !size )
+      return;
+    double now = (double)OisHostMicros();
+    double start = m_lineFree > now ? m_lineFree : now;
+    if( m_baud > 0 )
+      m_lineFree = start + size * 1e7 / m_baud;
+    m_chunks.push_back({ size, start });
+    m_data.append((const char*)data, size);
+    m_sent += size;
+  }
+  size_t Available()
+  {
+    double now = (double)OisHostMicros();
+    size_t partial = 0;
+    while( !m_chunks.empty() )
+    {
+      Chunk& c = m_chunks.front();
+      size_t arrived = c.size;
+      if( m_baud > 0 )
+      {
+        double bytes = now <= c.start ? 0 : (now - c.start) * m_baud / 1e7;
+        arrived = bytes < (double)c.size ? (size_t)bytes : c.size;
+      }
+      if( arrived < c.size )
+      {
+        partial = arrived;
+        break;
+      }
+      m_arrived += c.size;
+      m_chunks.pop_front();
+    }
+    return (size_t)(m_arrived + partial - m_read);
+  }
+  size_t Read(void* buffer, size_t size)
+  {
+    size_t available = Available();
+    if( size > available )
+      size = available;
+    memcpy(buffer, m_data.data() + m_position, size);
+    m_position += size;
+    m_read += size;
+    if( m_position == m_data.size() )
+    {
+      m_data.clear();//keeps its capacity
+      m_position = 0;
+    }
+    return size;
+  }
+  //Bytes sent that haven't been read yet, whether they've arrived or not
+  size_t   Queued() const { return m_data.size() - m_position; }
+  uint64_t Sent()   const { return m_sent; }
+private:
+  struct Chunk
+  {
+    size_t size;
+    double start;//when its first byte started to be sent
+  };
+  long              m_baud = 0;
+  double            m_lineFree = 0;
+  std::deque<Chunk> m_chunks;//that haven't fully arrived
+  std::string       m_data;
+  size_t            m_position = 0;
+  uint64_t          m_sent = 0;
+  uint64_t          m_arrived = 0;
+  uint64_t          m_read = 0;
+};
+
+//------------------------------------------------------------------------------
+class OisHostSerial
+{
+public:
+  //The sketch's side, as HardwareSerial:
+  void   begin(long baud)                       { toSketch.SetBaud(baud); fromSketch.SetBaud(baud); }
+  void   end()                                  {}
+  void   flush()                                {}
+  int    available()                            { return (int)toSketch.Available(); }
+  size_t readBytes(char* buffer, size_t length) { return toSketch.Read(buffer, length); }
+  size_t write(uint8_t c)                       { return write(&c, 1); }
+  size_t write(const uint8_t* data, size_t size){ fromSketch.Send(data, size); return size; }
+  size_t write(const char* data, size_t size)   { return write((const uint8_t*)data, size); }
+  size_t print(const char* text)                { return write(text, strlen(text)); }
+  size_t print(char c)                          { return write((uint8_t)c); }
+  size_t print(int n, int base = DEC)           { return print((long)n, base); }
+  size_t print(unsigned n, int base = DEC)      { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC)
+  {
+    char buffer[24];
+    return write(buffer, snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%ld", n));
+  }
+  size_t print(unsigned long n, int base = DEC)
+  {
+    char buffer[24];
+    return write(buffer, snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%lu", n));
+  }
+  template<class T> size_t println(T value)     { size_t n = print(value); return n + print("\r\n"); }
+
+  //The other end of the cable:
+  OisHostLink toSketch;
+  OisHostLink fromSketch;
+};
+
+static OisHostSerial Serial;
+
+#endif // OIS_ARDUINO_HOST_INCLUDED
@@ -561,7 +561,7 @@ int ois_parse_binary(OisState& ois, char* start, char* end)
     return 0;
   int bufferLength = (int)(ptrdiff_t)(end - start);
   
-  uint16_t payload = (*start);
+  uint16_t payload = (uint8_t)(*start);//char may be signed
   uint16_t command = payload & OisState::SV_COMMAND_MASK;
   int cmdLength = 1;
   if( payload == OisState::SV_END_ )//the host send the END command as ASCII
@@ -597,9 +597,9 @@ int ois_parse_binary(OisState& ois, char* start, char* end)
   {
   case OisState::SV_VAL_1: value = extra;                              channel = *(uint8_t *)(start+1);              break;
   case OisState::SV_VAL_2: value = *(uint8_t *)(start+1)|(extra << 8); channel = *(uint8_t *)(start+2);              break;
-  case OisState::SV_VAL_3: value = *(uint16_t*)(start+1);              channel = *(uint8_t *)(start+3)|(extra << 8); break;
-  case OisState::SV_VAL_4: value = *(uint16_t*)(start+1);              channel = *(uint16_t*)(start+3);              break;
-  }
+  case OisState::SV_VAL_3: value = *(int16_t *)(start+1);              channel = *(uint8_t *)(start+3)|(extra << 8); break;
+  case OisState::SV_VAL_4: value = *(int16_t *)(start+1);              channel = *(uint16_t*)(start+3);              break;
+  }//values are 16-bit and signed, even where int is 32-bit
   
   int index = channel - ois.numCommands;
   if( index >= 0 && index < ois.numInputs )
@@ -957,7 +957,7 @@ void ois_send_active(OisState& ois)
       uint& value = ois.touchedCommandsMasks[i];
       if( !value )
         continue;
-      for( int j=0, mask=1; j != 16; ++j, mask <<= 1 )
+      for( uint j=0, mask=1; j != sizeof(int)*8; ++j, mask <<= 1 )
       {
         if( value & mask )
         {
@@ -982,7 +982,7 @@ void ois_send_active(OisState& ois)
       uint& value = ois.touchedOutputsMasks[i];
       if( !value )
         continue;
-      for( uint j=0, mask=1; j != 16; ++j, mask <<= 1 )
+      for( uint j=0, mask=1; j != sizeof(int)*8; ++j, mask <<= 1 )
       {
         if( value & mask )
         {
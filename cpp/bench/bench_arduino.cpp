@@ -0,0 +1,348 @@
+//------------------------------------------------------------------------------
+// Runs the Arduino client (arduino/ois_protocol.h) on the PC, against an OisDevice in the same process, over the
+//  simulated serial line in arduino/host/arduino_host.h. Each channel count in --channels is a separate run, with an
+//  eighth of the channels as commands, three eighths as inputs (game to board) and half as outputs (board to game).
+// Time is simulated: each pass of the sketch's loop() takes --loop-us plus any delay() it makes, and the game polls
+//  every --loop-us, including during a delay(). Every pass, the board calls ois_set / ois_execute and the game calls
+//  SetInput at --rate changes per second each. Reports:
+//  * sync time: from power on until the game has every channel and is active (simulated)
+//  * ns per ois_loop call while active, on this PC, and the loop rate that would allow. Only comparable between runs
+//    on the same machine, but enough to see the cost of a change to the client before flashing a board.
+//  * values and events delivered per second each way, and the bytes per update on the wire
+//  * the game's estimate of the line's utilization each way, and the longest that its output was queued, from the
+//    link model (see ois_link.h)
+//  * changes still queued on the board at the end (it sends at most two per loop), and values that didn't arrive
+//    intact (the board's and the game's copies differ once the line is idle)
+//
+// Usage: bench_arduino [--json] [--channels 8,32,128,512] [--version 2] [--rate 100] [--seconds 10] [--loop-us 1000]
+//                      [--baud 115200]
+//  --version 1 is the ASCII protocol, and has no outputs. --baud 0 is unlimited.
+// Build e.g.:  c++ -O2 -std=c++11 bench_arduino.cpp -o bench_arduino
+//------------------------------------------------------------------------------
+#define OIS_NO_SERIAL_PORT
+#define OIS_ENABLE_VIRTUAL_PORT
+#define OIS_ENABLE_STATS
+#define OIS_ENABLE_LINK_MODEL
+#define OIS_PROTOCOL_IMPL
+#include "../ois_protocol.h"
+#include "bench_common.h"
+#include "../../arduino/host/arduino_host.h"
+#include <chrono>
+#include <string>
+
+//The Arduino client has its own OisState, so lives in a namespace of its own
+namespace Arduino
+{
+#include "../../arduino/ois_protocol.h"
+}
+
+//------------------------------------------------------------------------------
+// The game's end of the simulated cable
+class ArduinoPort : public IOisPort
+{
+public:
+	explicit ArduinoPort(long baud) : m_baud(baud) {}
+	bool IsConnected()   { return true; }
+	void Connect()       {}
+	void Disconnect()    {}
+	const char* Name()   { return "arduino"; }
+	int Read(char* buffer, int size)
+	{
+		return (int)Serial.fromSketch.Read(buffer, size);
+	}
+	int Write(const char* buffer, int size)
+	{
+		Serial.toSketch.Send(buffer, size);
+		return size;
+	}
+	int Baud()           { return (int)m_baud; }
+private:
+	long m_baud;
+};
+
+//The game polls once per --loop-us of simulated time, including while the sketch is in delay()
+struct Game
+{
+	Game(IOisPort& port, int pollUs) : device(port, "Arduino", 1, "bench_arduino"), pollUs(pollUs) {}
+	OisDevice          device;
+	OIS_STRING_BUILDER sb;
+	int                pollUs;
+	uint64_t           lastPoll = 0;
+	float              maxQueueSeconds = 0;
+
+	void Advance(uint64_t us)
+	{
+		for( uint64_t end = OisHostMicros() + us; OisHostMicros() < end; )
+		{
+			uint64_t step = end - OisHostMicros();
+			OisHostMicros() += step < (uint64_t)pollUs ? step : pollUs;
+			device.Poll(sb, (float)((OisHostMicros() - lastPoll) / 1e6));
+			lastPoll = OisHostMicros();
+			float queue = device.Link().Estimate().queueSeconds;
+			maxQueueSeconds = queue > maxQueueSeconds ? queue : maxQueueSeconds;
+		}
+	}
+	static void OnDelay(void* user, uint64_t us) { ((Game*)user)->Advance(us); }
+};
+
+struct Options
+{
+	OIS_VECTOR<int> channels = OIS_VECTOR<int>{8, 32, 128, 512};
+	int    version = 2;
+	double rate = 100;
+	double seconds = 10;
+	int    loopUs = 1000;
+	long   baud = 115200;
+	bool   json = false;
+};
+
+struct Result
+{
+	int      channels, commands, inputs, outputs;
+	double   syncMs;
+	double   loopNs;
+	uint64_t changesToGame, changesToBoard;
+	uint64_t valuesToGame, eventsToGame, valuesToBoard;
+	uint64_t bytesToGame, bytesToBoard;
+	float    linkOut, linkIn;//utilization
+	float    queueMs;
+	int      queued;
+	int      mismatched;
+};
+
+static bool ParseChannels(const char* text, OIS_VECTOR<int>& channels)
+{
+	channels.clear();
+	for( const char* c = text; *c; )
+	{
+		char* end;
+		long n = strtol(c, &end, 10);
+		if( end == c || n < 1 || n > 4096 )
+			return false;
+		channels.push_back((int)n);
+		c = *end == ',' ? end + 1 : end;
+		if( *end && *end != ',' )
+			return false;
+	}
+	return !channels.empty();
+}
+
+static double Seconds(std::chrono::steady_clock::duration d)
+{
+	return std::chrono::duration<double>(d).count();
+}
+
+//------------------------------------------------------------------------------
+static bool Run(const Options& o, int channels, Result& r)
+{
+	typedef std::chrono::steady_clock Clock;
+	r = Result();
+	r.channels = channels;
+	r.commands = channels / 8 > 0 ? channels / 8 : 1;
+	r.outputs = o.version >= 2 ? channels / 2 : 0;
+	r.inputs = channels - r.commands - r.outputs;
+
+	OIS_VECTOR<std::string> names;
+	for( int i=0; i!=channels; ++i )
+		names.push_back((i < r.commands ? "Command " : i < r.commands + r.inputs ? "Input " : "Output ") + std::to_string(i));
+	OIS_VECTOR<Arduino::OisCommand> commands;
+	OIS_VECTOR<Arduino::OisNumericInput> inputs;
+	OIS_VECTOR<Arduino::OisNumericOutput> outputs;
+	for( int i=0; i!=r.commands; ++i )
+		commands.push_back(Arduino::OisCommand{names[i].c_str()});
+	for( int i=0; i!=r.inputs; ++i )
+		inputs.push_back(Arduino::OisNumericInput{names[r.commands + i].c_str(), Arduino::Number, 0});
+	for( int i=0; i!=r.outputs; ++i )
+		outputs.push_back(Arduino::OisNumericOutput{names[r.commands + r.inputs + i].c_str(), Arduino::Number, 0});
+
+	//Power on. ois_setup doesn't delay, so the game can be created afterwards
+	Serial = OisHostSerial();
+	OisHostMicros() = 0;
+	Arduino::OisState board = Arduino::OisState();
+	Arduino::ois_setup(board, "Arduino", FOURCC("BNCH"), FOURCC("OIS_"), commands.data(), r.commands, inputs.data(), r.inputs,
+	                   outputs.empty() ? nullptr : outputs.data(), r.outputs, o.version);
+	Serial.begin(board.baud = o.baud);
+
+	ArduinoPort port(o.baud);
+	Game side(port, o.loopUs);
+	OisDevice& game = side.device;
+	OisHostDelay() = &Game::OnDelay;
+	OisHostDelayUser() = &side;
+	auto Loop = [&]()
+	{
+		Arduino::ois_loop(board);
+		side.Advance(o.loopUs);
+	};
+
+	//Connect
+	const uint64_t timeout = 120 * 1000000ull;
+	while( !(game.Connected() && board.deviceState == Arduino::OisState::Active) && OisHostMicros() < timeout )
+		Loop();
+	OisHostDelay() = nullptr;//the sketch only delays while handshaking
+	if( !game.Connected() || board.deviceState != Arduino::OisState::Active )
+	{
+		fprintf(stderr, "%d channels: not connected within %.0fs\n", channels, timeout / 1e6);
+		return false;
+	}
+	r.syncMs = OisHostMicros() / 1000.0;
+	OIS_VECTOR<int> gameInputs, gameOutputs;//indices into DeviceInputs / DeviceOutputs, by the board's index
+	for( int i=0; i!=r.inputs; ++i )
+	{
+		const OIS_VECTOR<OisState::NumericValue>& values = game.DeviceInputs();
+		int index = -1;
+		for( size_t j=0; j!=values.size(); ++j )
+			if( values[j].channel == r.commands + i )
+				index = (int)j;
+		gameInputs.push_back(index);
+	}
+	for( int i=0; i!=r.outputs; ++i )
+	{
+		const OIS_VECTOR<OisState::NumericValue>& values = game.DeviceOutputs();
+		int index = -1;
+		for( size_t j=0; j!=values.size(); ++j )
+			if( values[j].channel == r.commands + r.inputs + i )
+				index = (int)j;
+		gameOutputs.push_back(index);
+	}
+	int missing = 0;
+	for( int i : gameInputs )  missing += i < 0;
+	for( int i : gameOutputs ) missing += i < 0;
+	if( missing )
+	{
+		fprintf(stderr, "%d channels: %d weren't registered with the game\n", channels, missing);
+		return false;
+	}
+	game.ClearStats();
+	side.maxQueueSeconds = 0;//the registration burst while connecting isn't interesting
+
+	//Run, timing only the sketch's side
+	Random random;
+	const double changesPerLoop = o.rate * o.loopUs / 1e6;
+	double boardAllowance = 0, gameAllowance = 0;
+	const uint64_t loops = (uint64_t)(o.seconds * 1e6 / o.loopUs + 0.5);
+	double loopSeconds = 0;
+	for( uint64_t l=0; l!=loops; ++l )
+	{
+		for( boardAllowance += changesPerLoop; boardAllowance >= 1 - 1e-9; boardAllowance -= 1 )
+		{
+			int kind = (int)(random.Next() % (r.commands + r.outputs));
+			if( kind < r.commands )
+				Arduino::ois_execute(board, commands[kind]);
+			else
+				Arduino::ois_set(board, outputs[kind - r.commands], (int)(random.Next() % 65536) - 32768);
+			++r.changesToGame;
+		}
+		for( gameAllowance += changesPerLoop; r.inputs && gameAllowance >= 1 - 1e-9; gameAllowance -= 1 )
+		{
+			OisState::Value v;
+			v.number = (int)(random.Next() % 65536) - 32768;
+			game.SetInput(game.DeviceInputs()[gameInputs[random.Next() % r.inputs]], v);
+			++r.changesToBoard;
+		}
+		Clock::time_point start = Clock::now();
+		Arduino::ois_loop(board);
+		loopSeconds += Seconds(Clock::now() - start);
+		side.Advance(o.loopUs);
+		game.PopEvents([](const OisState::Event&){});
+	}
+	r.loopNs = loopSeconds * 1e9 / (double)loops;
+	r.queued = board.numTouchedCommands + board.numTouchedOutputs;
+	const OisStats& stats = game.Stats();
+	r.valuesToGame  = stats.commands[OisStats::In][OisStats::Value].Get();
+	r.eventsToGame  = stats.commands[OisStats::In][OisStats::Event].Get();
+	r.valuesToBoard = stats.commands[OisStats::Out][OisStats::Value].Get();
+	r.bytesToGame   = stats.bytes[OisStats::In].Get();
+	r.bytesToBoard  = stats.bytes[OisStats::Out].Get();
+	r.linkOut       = game.Link().Estimate().utilizationOut;
+	r.linkIn        = game.Link().Estimate().utilizationIn;
+	r.queueMs       = side.maxQueueSeconds * 1000;
+
+	//Let the line go idle, then compare both copies of every value
+	for( int i=0; i!=5000 && (board.numTouchedCommands + board.numTouchedOutputs || Serial.toSketch.Queued() || Serial.fromSketch.Queued()); ++i )
+		Loop();
+	for( int i=0; i!=100; ++i )
+		Loop();
+	for( int i=0; i!=r.inputs; ++i )
+		r.mismatched += inputs[i].value != game.DeviceInputs()[gameInputs[i]].value.number;
+	for( int i=0; i!=r.outputs; ++i )
+		r.mismatched += outputs[i].value != game.DeviceOutputs()[gameOutputs[i]].value.number;
+
+	free(board.gameTitle);
+	free(board.touchedCommandsMasks);
+	free(board.touchedOutputsMasks);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	Options o;
+	bool valid = true;
+	for( int i=1; i<argc && valid; ++i )
+	{
+		const char* arg = argv[i];
+		bool hasValue = i+1 < argc;
+		if( 0 == strcmp(arg, "--json") )                           o.json = true;
+		else if( hasValue && 0 == strcmp(arg, "--channels") )      valid = ParseChannels(argv[++i], o.channels);
+		else if( hasValue && 0 == strcmp(arg, "--version") )       o.version = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--rate") )          o.rate = atof(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--seconds") )       o.seconds = atof(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--loop-us") )       o.loopUs = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--baud") )          o.baud = atol(argv[++i]);
+		else                                                       valid = false;
+	}
+	if( !valid || o.version < 1 || o.version > 2 || !(o.rate >= 0) || !(o.seconds > 0) || o.loopUs <= 0 || o.baud < 0 )
+	{
+		fprintf(stderr, "Usage: %s [--json] [--channels 8,32,128,512] [--version 2] [--rate 100] [--seconds 10] [--loop-us 1000]\n"
+		                "       [--baud 115200]\n", argv[0]);
+		return 1;
+	}
+
+	if( !o.json )
+	{
+		printf("Protocol version %d (%s); %.0f changes/s each way; %.1fs with a %dus loop; ",
+		       o.version, o.version >= 2 ? "binary" : "ASCII", o.rate, o.seconds, o.loopUs);
+		if( o.baud )
+			printf("%ld baud\n", o.baud);
+		else
+			printf("unlimited bandwidth\n");
+		printf("%8s %9s %9s %12s %10s %10s %10s %10s %10s %7s %7s %9s %7s %7s\n", "channels", "sync ms", "ns/loop", "loops/s",
+		       "values/s", "events/s", "B/update", "inputs/s", "B/input", "link in", "out", "queue ms", "queued", "wrong");
+	}
+	int failed = 0;
+	for( int channels : o.channels )
+	{
+		Result r;
+		if( !Run(o, channels, r) )
+		{
+			++failed;
+			continue;
+		}
+		uint64_t toGame = r.valuesToGame + r.eventsToGame;
+		double bytesPerUpdate = toGame ? (double)r.bytesToGame / toGame : 0;
+		double bytesPerInput = r.valuesToBoard ? (double)r.bytesToBoard / r.valuesToBoard : 0;
+		double loopsPerSecond = r.loopNs > 0 ? 1e9 / r.loopNs : 0;
+		if( o.json )
+		{
+			printf("{\"channels\":%d,\"commands\":%d,\"inputs\":%d,\"outputs\":%d,\"version\":%d,\"rate\":%.1f,\"seconds\":%.3f,"
+			       "\"loop_us\":%d,\"baud\":%ld,\"sync_ms\":%.2f,\"ns_per_loop\":%.1f,\"loops_per_second\":%.0f,"
+			       "\"changes_to_game\":%llu,\"values_to_game\":%llu,\"events_to_game\":%llu,\"bytes_to_game\":%llu,\"bytes_per_update\":%.2f,"
+			       "\"changes_to_board\":%llu,\"values_to_board\":%llu,\"bytes_to_board\":%llu,\"bytes_per_input\":%.2f,"
+			       "\"link_utilization_in\":%.3f,\"link_utilization_out\":%.3f,\"link_queue_ms_max\":%.2f,\"queued\":%d,\"mismatched\":%d}\n",
+			       r.channels, r.commands, r.inputs, r.outputs, o.version, o.rate, o.seconds, o.loopUs, o.baud, r.syncMs,
+			       r.loopNs, loopsPerSecond, (unsigned long long)r.changesToGame, (unsigned long long)r.valuesToGame,
+			       (unsigned long long)r.eventsToGame, (unsigned long long)r.bytesToGame, bytesPerUpdate,
+			       (unsigned long long)r.changesToBoard, (unsigned long long)r.valuesToBoard, (unsigned long long)r.bytesToBoard,
+			       bytesPerInput, r.linkIn, r.linkOut, r.queueMs, r.queued, r.mismatched);
+		}
+		else
+		{
+			printf("%8d %9.1f %9.1f %12.0f %10.1f %10.1f %10.2f %10.1f %10.2f %6.0f%% %6.0f%% %9.2f %7d %7d\n", r.channels, r.syncMs,
+			       r.loopNs, loopsPerSecond, r.valuesToGame / o.seconds, r.eventsToGame / o.seconds, bytesPerUpdate,
+			       r.valuesToBoard / o.seconds, bytesPerInput, 100 * r.linkIn, 100 * r.linkOut, r.queueMs, r.queued, r.mismatched);
+		}
+		if( r.mismatched )
+			++failed;
+	}
+	return failed ? 2 : 0;
+}
@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------------
+// Shows what OIS_ENABLE_POLL_BUDGET (see ois_budget.h) does for a game whose controller floods it. Each frame, one
+//  OisHost sets every one of its outputs to a new value and polls, --flood times over, and then the game polls its
+//  OisDevice once. This runs twice: without a budget, and with --budget-us / --budget-bytes. For each, reports:
+//  * Poll time per frame (p50, p99, max), and the mean split into reading, parsing and sending, as reported to the
+//    PollBudget callback
+//  * bytes read per Poll, and the share of Polls that stopped because of the budget
+//  * the backlog left unread at the end: a budget caps the cost of a flood by delaying it, so if the flood
+//    outlasts the budget's throughput, the backlog grows for as long as it lasts
+//
+// Usage: bench_budget [--json] [--outputs 256] [--flood 4] [--frames 2000] [--budget-us 200] [--budget-bytes 0]
+// Build e.g.:  c++ -O2 -std=c++11 bench_budget.cpp -o bench_budget
+//------------------------------------------------------------------------------
+#define OIS_NO_SERIAL_PORT
+#define OIS_ENABLE_VIRTUAL_PORT
+#define OIS_ENABLE_POLL_BUDGET
+#define OIS_PROTOCOL_IMPL
+#include "../ois_protocol.h"
+#include "bench_common.h"
+#include <algorithm>
+#include <string>
+
+//------------------------------------------------------------------------------
+struct Options
+{
+	int      outputs = 256;
+	int      flood = 4;
+	int      frames = 2000;
+	double   budgetUs = 200;
+	uint32_t budgetBytes = 0;
+	bool     json = false;
+};
+
+struct Result
+{
+	OIS_VECTOR<uint64_t> pollNs;
+	uint64_t readNs = 0, parseNs = 0, sendNs = 0;
+	uint64_t bytes = 0;
+	uint64_t limited = 0;
+	size_t   backlog = 0;
+	uint64_t Percentile(double p) const
+	{
+		return pollNs.empty() ? 0 : pollNs[(size_t)(p * (double)(pollNs.size() - 1))];
+	}
+};
+
+static void OnPoll(const OisPollProfile& p, void* user)
+{
+	Result& r = *(Result*)user;
+	r.pollNs.push_back(p.totalNanoseconds);
+	r.readNs += p.readNanoseconds;
+	r.parseNs += p.parseNanoseconds;
+	r.sendNs += p.sendNanoseconds;
+	r.bytes += p.bytesRead;
+	r.limited += p.limited ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+static bool Run(const Options& o, bool budgeted, Result& r)
+{
+	Pipe toHost, toDevice;
+	BenchPort hostPort(&toHost, &toDevice), devicePort(&toDevice, &toHost);
+	OisHost controller(hostPort, "Flood", 0x1000, 0x2000);
+	OisDevice game(devicePort, "budget", 1, "bench_budget");
+	OIS_VECTOR<uint16_t> outputs;
+	for( int i=0; i!=o.outputs; ++i )
+		outputs.push_back(controller.AddOutput("Output " + std::to_string(i), OisState::Number));
+	OIS_STRING_BUILDER sb;
+	for( int i=0; i!=1000 && !(game.Connected() && controller.Connected()); ++i )
+	{
+		controller.Poll(sb, 0.01f);
+		game.Poll(sb, 0.01f);
+	}
+	if( !game.Connected() || !controller.Connected() )
+	{
+		fprintf(stderr, "Not connected\n");
+		return false;
+	}
+
+	if( budgeted )
+		game.PollBudget().SetLimits(o.budgetBytes, (uint64_t)(o.budgetUs * 1000));
+	game.PollBudget().SetCallback(&OnPoll, &r);
+	r.pollNs.reserve(o.frames);
+	int32_t next = 1;
+	for( int f=0; f!=o.frames; ++f )
+	{
+		for( int k=0; k!=o.flood; ++k )
+		{
+			for( uint16_t channel : outputs )
+			{
+				OisState::Value v;
+				v.number = (next++ % 30000) + 1;
+				controller.SetOutput(channel, v);
+			}
+			controller.Poll(sb, 0.001f);
+		}
+		game.Poll(sb, 0.016f);
+	}
+	game.PollBudget().SetCallback(nullptr, nullptr);
+	r.backlog = toDevice.Queued();
+	std::sort(r.pollNs.begin(), r.pollNs.end());
+	return true;
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	Options o;
+	bool valid = true;
+	for( int i=1; i<argc && valid; ++i )
+	{
+		const char* arg = argv[i];
+		bool hasValue = i+1 < argc;
+		if( 0 == strcmp(arg, "--json") )                           o.json = true;
+		else if( hasValue && 0 == strcmp(arg, "--outputs") )       o.outputs = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--flood") )         o.flood = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--frames") )        o.frames = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--budget-us") )     o.budgetUs = atof(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--budget-bytes") )  o.budgetBytes = (uint32_t)atol(argv[++i]);
+		else                                                       valid = false;
+	}
+	if( !valid || o.outputs <= 0 || o.outputs > 60000 || o.flood < 0 || o.frames <= 0 || !(o.budgetUs >= 0) )
+	{
+		fprintf(stderr, "Usage: %s [--json] [--outputs 256] [--flood 4] [--frames 2000] [--budget-us 200] [--budget-bytes 0]\n", argv[0]);
+		return 1;
+	}
+
+	if( !o.json )
+	{
+		printf("%d outputs, all changed %d times per frame; %d frames; budget %.0fus", o.outputs, o.flood, o.frames, o.budgetUs);
+		if( o.budgetBytes )
+			printf(", %u bytes", o.budgetBytes);
+		printf(" per Poll\n");
+		printf("%-10s %9s %9s %9s %9s %9s %9s %11s %8s %11s\n", "", "p50 us", "p99 us", "max us", "read us", "parse us",
+		       "send us", "bytes/Poll", "limited", "backlog KB");
+	}
+	for( int budgeted=0; budgeted!=2; ++budgeted )
+	{
+		Result r;
+		if( !Run(o, budgeted != 0, r) )
+			return 1;
+		double n = (double)r.pollNs.size();
+		const char* name = budgeted ? "budget" : "unlimited";
+		if( o.json )
+		{
+			printf("{\"name\":\"%s\",\"outputs\":%d,\"flood\":%d,\"frames\":%d,\"budget_us\":%.1f,\"budget_bytes\":%u,"
+			       "\"poll_us_p50\":%.2f,\"poll_us_p99\":%.2f,\"poll_us_max\":%.2f,\"read_us_mean\":%.2f,\"parse_us_mean\":%.2f,"
+			       "\"send_us_mean\":%.2f,\"bytes_per_poll\":%.1f,\"limited_fraction\":%.4f,\"backlog_bytes\":%llu}\n",
+			       name, o.outputs, o.flood, o.frames, budgeted ? o.budgetUs : 0.0, budgeted ? o.budgetBytes : 0,
+			       r.Percentile(0.5) / 1e3, r.Percentile(0.99) / 1e3, r.Percentile(1) / 1e3, r.readNs / n / 1e3,
+			       r.parseNs / n / 1e3, r.sendNs / n / 1e3, r.bytes / n, r.limited / n, (unsigned long long)r.backlog);
+		}
+		else
+		{
+			printf("%-10s %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %11.1f %7.1f%% %11.1f\n", name,
+			       r.Percentile(0.5) / 1e3, r.Percentile(0.99) / 1e3, r.Percentile(1) / 1e3, r.readNs / n / 1e3,
+			       r.parseNs / n / 1e3, r.sendNs / n / 1e3, r.bytes / n, 100 * r.limited / n, r.backlog / 1024.0);
+		}
+	}
+	return 0;
+}
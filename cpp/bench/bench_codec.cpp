@@ -0,0 +1,469 @@
+//------------------------------------------------------------------------------
+// Microbenchmarks for the codec in ois_protocol.h:
+//  pack_cl / pack_sv      OisState::PackNumericValueCommand, for each of the four VAL size classes, with the device's
+//                         (CL_) and the game's (SV_) command sets
+//  device_binary          OisDevice decoding a binary stream of output values, as sent by OisHost
+//  host_binary            OisHost decoding a binary stream of input values, as sent by OisDevice
+//  device_ascii           OisDevice decoding ASCII `channel=value` lines, as sent by e.g. the Arduino library
+//  register_binary/ascii  OisDevice decoding a whole handshake and one registration per channel, after its state has
+//                         been cleared (so per message here means per registration)
+//  replay_device/host     with --capture, a new OisDevice / OisHost replaying a real capture (see ois_capture.h) Poll by
+//                         Poll instead of the generated streams (so per message here means per Poll)
+// Each stream is generated once for the given number of channels and distribution of values, and then decoded over
+//  and over from memory. Results are in ns/message and messages/s; --json prints one JSON object per line instead of
+//  a table, so that results can be compared between releases.
+//
+// Usage: bench_codec [--json] [--channels 8,1024,8192] [--values boolean,small,medium,full] [--seconds 0.2]
+//        bench_codec [--json] [--seconds 0.2] --capture capture.bin
+// Build e.g.:  c++ -O2 -std=c++11 bench_codec.cpp -o bench_codec
+//------------------------------------------------------------------------------
+#define OIS_NO_SERIAL_PORT
+#define OIS_ENABLE_VIRTUAL_PORT
+#define OIS_PROTOCOL_IMPL
+#include "../ois_protocol.h"
+#include "../ois_replay.h"
+#include "bench_common.h"
+#include <chrono>
+#include <string>
+
+//Connects an OisHost to an OisDevice through a pair of BenchPorts
+struct BenchLink
+{
+	Pipe      toHost, toDevice;
+	BenchPort hostPort{&toHost, &toDevice}, devicePort{&toDevice, &toHost};
+	OIS_STRING_BUILDER sb;
+	bool Connect(OisHost& host, OisDevice& device)
+	{
+		for( int i=0; i!=100 && !device.Connected(); ++i )
+		{
+			host.Poll(sb, 0.1f);
+			device.Poll(sb, 0.1f);
+		}
+		return device.Connected() && host.Connected();
+	}
+};
+
+//Closes the device's port, so that its next stream starts a new handshake, like a controller that has been reset
+static void Reset(OisDevice& device, BenchPort& port, OIS_STRING_BUILDER& sb)
+{
+	port.Disconnect();
+	device.Poll(sb, 0);   //clears the device's state
+	device.Poll(sb, 2.0f);//reopens the port, after the reconnection delay
+}
+
+enum Distribution { Boolean, Small, Medium, Full, NumDistributions };
+const char* const g_distributionNames[] = { "boolean", "small", "medium", "full" };
+
+static OisState::Value MakeValue(Distribution d, Random& r)
+{
+	OisState::Value v;
+	v.number = 0;
+	switch( d )
+	{
+	case Boolean: v.boolean = (r.Next() & 1) != 0;          break;
+	case Small:   v.number = (int)(r.Next() % 16);          break;//VAL_1 for either side
+	case Medium:  v.number = 16 + (int)(r.Next() % 4080);   break;//VAL_2 on low channels
+	default:      v.number = (int16_t)(r.Next() & 0xFFFF);  break;
+	}
+	return v;
+}
+
+static OisState::NumericType TypeOf(Distribution d) { return d == Boolean ? OisState::Boolean : OisState::Number; }
+
+struct Result
+{
+	const char* name;
+	int         channels;
+	const char* values;
+	uint64_t    messages;
+	double      seconds;
+	uint64_t    bytes;//per pass over the stream, or 0
+};
+
+static bool g_json = false;
+static double g_minSeconds = 0.2;
+
+static void Print(const Result& r)
+{
+	double ns = r.seconds * 1e9 / (double)r.messages;
+	if( g_json )
+		printf("{\"bench\":\"%s\",\"channels\":%d,\"values\":\"%s\",\"messages\":%llu,\"ns_per_message\":%.2f,\"messages_per_second\":%.0f,\"stream_bytes\":%llu}\n",
+		       r.name, r.channels, r.values, (unsigned long long)r.messages, ns, 1e9 / ns, (unsigned long long)r.bytes);
+	else
+		printf("%-16s %8d %-8s %12llu %10.2f %14.0f %12llu\n",
+		       r.name, r.channels, r.values, (unsigned long long)r.messages, ns, 1e9 / ns, (unsigned long long)r.bytes);
+}
+
+//Calls fn() (which processes `messagesPerCall` messages) until at least g_minSeconds have passed
+template<class Fn>
+static void Measure(Result& r, uint64_t messagesPerCall, Fn&& fn)
+{
+	typedef std::chrono::steady_clock Clock;
+	fn();//warm up
+	Clock::time_point start = Clock::now();
+	double elapsed = 0;
+	uint64_t calls = 0;
+	do
+	{
+		fn();
+		++calls;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while( elapsed < g_minSeconds );
+	r.messages = calls * messagesPerCall;
+	r.seconds = elapsed;
+	Print(r);
+}
+
+//------------------------------------------------------------------------------
+// PackNumericValueCommand is protected, along with the command constants
+struct BenchCodec : OisState
+{
+	static void Pack()
+	{
+		//One channel / value pair per VAL size class, with the CL_ limits (the SV_ ones are a little larger)
+		static const int classes[4][2] = { { 5, 3 }, { 5, 1000 }, { 1000, 1000 }, { 10000, 1000 } };
+		static const char* const names[2][4] = { { "pack_cl_1", "pack_cl_2", "pack_cl_3", "pack_cl_4" },
+		                                         { "pack_sv_1", "pack_sv_2", "pack_sv_3", "pack_sv_4" } };
+		for( int side=0; side!=2; ++side )
+		{
+			for( int c=0; c!=4; ++c )
+			{
+				NumericValue values[256];
+				for( int i=0; i!=256; ++i )
+				{
+					values[i].channel = (uint16_t)(classes[c][0] + (i & 7));
+					values[i].type = Number;
+					values[i].value.number = classes[c][1] + (i & 3);
+				}
+				volatile unsigned sink = 0;
+				Result r = { names[side][c], 8, "fixed", 0, 0, 0 };
+				Measure(r, 256, [&]()
+				{
+					uint8_t cmd[5];
+					unsigned total = 0;
+					for( const NumericValue& v : values )
+					{
+						total += side == 0 ? PackNumericValueCommand(v, cmd, CL_PAYLOAD_SHIFT, CL_VAL_1, CL_VAL_2, CL_VAL_3, CL_VAL_4)
+						                   : PackNumericValueCommand(v, cmd, SV_PAYLOAD_SHIFT, SV_VAL_1, SV_VAL_2, SV_VAL_3, SV_VAL_4);
+						total += cmd[0];
+					}
+					sink = sink + total;
+				});
+			}
+		}
+	}
+};
+
+//------------------------------------------------------------------------------
+const int g_streamMessages = 4096;
+
+static void DeviceBinary(int channels, Distribution d)
+{
+	BenchLink link;
+	OisHost host(link.hostPort, "bench", 1, 2);
+	OisDevice device(link.devicePort, "bench", 1, "bench");
+	OIS_VECTOR<uint16_t> ids;
+	for( int i=0; i!=channels; ++i )
+		ids.push_back(host.AddOutput(std::to_string(i), TypeOf(d)));
+	if( !link.Connect(host, device) )
+		return (void)fprintf(stderr, "device_binary: connection failed\n");
+
+	//Record what the host sends. Each value differs from the channel's last one, so that none are skipped.
+	Pipe stream;
+	link.hostPort.SetOut(&stream);
+	Random random;
+	OIS_VECTOR<int32_t> last(channels, 0);
+	for( int i=0; i!=g_streamMessages; ++i )
+	{
+		int c = (int)(random.Next() % channels);
+		OisState::Value v = MakeValue(d, random);
+		if( d == Boolean )
+			v.boolean = !last[c];
+		else if( v.number == last[c] )
+			v.number ^= 1;
+		last[c] = v.number;
+		host.SetOutput(ids[c], v);
+		host.Poll(link.sb, 0);
+	}
+	Result r = { "device_binary", channels, g_distributionNames[d], 0, 0, stream.data.size() };
+	link.devicePort.SetIn(&stream);
+	Measure(r, g_streamMessages, [&]()
+	{
+		stream.position = 0;
+		device.Poll(link.sb, 0);
+	});
+}
+
+static void HostBinary(int channels, Distribution d)
+{
+	BenchLink link;
+	OisHost host(link.hostPort, "bench", 1, 2);
+	OisDevice device(link.devicePort, "bench", 1, "bench");
+	for( int i=0; i!=channels; ++i )
+		host.AddInput(std::to_string(i), TypeOf(d));
+	if( !link.Connect(host, device) )
+		return (void)fprintf(stderr, "host_binary: connection failed\n");
+
+	Pipe stream;
+	link.devicePort.SetOut(&stream);
+	Random random;
+	const OIS_VECTOR<OisState::NumericValue>& inputs = device.DeviceInputs();
+	for( int i=0; i!=g_streamMessages; ++i )
+	{
+		const OisState::NumericValue& input = inputs[random.Next() % inputs.size()];
+		OisState::Value v = MakeValue(d, random);
+		if( d == Boolean )
+			v.boolean = !input.value.boolean;
+		else if( v.number == input.value.number )
+			v.number ^= 1;
+		device.SetInput(input, v);
+		device.Poll(link.sb, 0);
+	}
+	Result r = { "host_binary", channels, g_distributionNames[d], 0, 0, stream.data.size() };
+	link.hostPort.SetIn(&stream);
+	Measure(r, g_streamMessages, [&]()
+	{
+		stream.position = 0;
+		host.Poll(link.sb, 0);
+	});
+}
+
+//The handshake that an ASCII device sends, registering `channels` values (outputs, from the game's point of view)
+static std::string AsciiRegistration(int channels, Distribution d)
+{
+	std::string s = "451\nSYN=2\nPID=1,2,bench\n";
+	char line[64];
+	for( int i=0; i!=channels; ++i )
+	{
+		snprintf(line, sizeof(line), "%s=%d,%d\n", d == Boolean ? "NOB" : "NON", i, i);
+		s += line;
+	}
+	return s + "ACT\n";
+}
+
+static void DeviceAscii(int channels, Distribution d)
+{
+	BenchPort port;
+	OIS_STRING_BUILDER sb;
+	OisDevice device(port, "bench", 1, "bench");
+	Pipe registration;
+	registration.data = AsciiRegistration(channels, d);
+	port.SetIn(&registration);
+	device.Poll(sb, 0);
+	if( !device.Connected() )
+		return (void)fprintf(stderr, "device_ascii: connection failed\n");
+
+	Pipe stream;
+	Random random;
+	char line[32];
+	for( int i=0; i!=g_streamMessages; ++i )
+	{
+		OisState::Value v = MakeValue(d, random);
+		snprintf(line, sizeof(line), "%d=%d\n", (int)(random.Next() % channels), d == Boolean ? (int)v.boolean : v.number);
+		stream.data += line;
+	}
+	Result r = { "device_ascii", channels, g_distributionNames[d], 0, 0, stream.data.size() };
+	port.SetIn(&stream);
+	Measure(r, g_streamMessages, [&]()
+	{
+		stream.position = 0;
+		device.Poll(sb, 0);
+	});
+}
+
+static void RegisterAscii(int channels, Distribution d)
+{
+	BenchPort port;
+	OIS_STRING_BUILDER sb;
+	OisDevice device(port, "bench", 1, "bench");
+	Pipe stream;
+	stream.data = AsciiRegistration(channels, d);
+	Result r = { "register_ascii", channels, g_distributionNames[d], 0, 0, stream.data.size() };
+	port.SetIn(&stream);
+	Measure(r, channels, [&]()
+	{
+		Reset(device, port, sb);
+		stream.position = 0;
+		device.Poll(sb, 0);
+	});
+	if( (int)device.DeviceOutputs().size() != channels )
+		fprintf(stderr, "register_ascii: expected %d outputs, got %d\n", channels, (int)device.DeviceOutputs().size());
+}
+
+static void RegisterBinary(int channels, Distribution d)
+{
+	//Record everything that the host sends while connecting
+	BenchLink link;
+	OisHost host(link.hostPort, "bench", 1, 2);
+	OisDevice device(link.devicePort, "bench", 1, "bench");
+	for( int i=0; i!=channels; ++i )
+		host.AddOutput(std::to_string(i), TypeOf(d));
+	std::string stream;
+	link.hostPort.SetCapture(&stream);
+	if( !link.Connect(host, device) )
+		return (void)fprintf(stderr, "register_binary: connection failed\n");
+	link.devicePort.SetOut(nullptr);
+
+	//The host waits for the device's ACK before switching to binary, so the device reads the ASCII SYN on its own
+	size_t split = stream.find("SYN=2,B\n") + 8;
+	Pipe syn, registrations;
+	syn.data = stream.substr(0, split);
+	registrations.data = stream.substr(split);
+	Result r = { "register_binary", channels, g_distributionNames[d], 0, 0, stream.size() };
+	Measure(r, channels, [&]()
+	{
+		Reset(device, link.devicePort, link.sb);
+		syn.position = 0;
+		link.devicePort.SetIn(&syn);
+		device.Poll(link.sb, 0);
+		registrations.position = 0;
+		link.devicePort.SetIn(&registrations);
+		device.Poll(link.sb, 0);
+	});
+	if( (int)device.DeviceOutputs().size() != channels )
+		fprintf(stderr, "register_binary: expected %d outputs, got %d\n", channels, (int)device.DeviceOutputs().size());
+}
+
+//------------------------------------------------------------------------------
+//------------------------------------------------------------------------------
+static bool ReadFile(const char* path, std::string& out)
+{
+	FILE* fp = fopen(path, "rb");
+	if( !fp )
+		return false;
+	char buffer[4096];
+	size_t n;
+	while( (n = fread(buffer, 1, sizeof(buffer), fp)) > 0 )
+		out.append(buffer, n);
+	fclose(fp);
+	return true;
+}
+
+//An OisHost replay only writes the same bytes as the original if it has the same channels, which aren't in the
+// capture, so mismatches are expected there; the reads are still decoded in the same way.
+static bool Replay(const char* path)
+{
+	std::string capture;
+	OisReplayPort port;
+	if( !ReadFile(path, capture) || !port.Open(capture.data(), capture.size()) )
+	{
+		fprintf(stderr, "%s is not a capture\n", path);
+		return false;
+	}
+	bool device = port.Header()->side == OisCaptureFileHeader::Host;
+	OIS_STRING_BUILDER sb;
+	auto replay = [&]()
+	{
+		port.Open(capture.data(), capture.size());
+		float deltaTime;
+		if( device )
+		{
+			OisDevice d(port, "Replay", 1, "bench");
+			while( port.NextPoll(deltaTime) )
+				d.Poll(sb, deltaTime);
+		}
+		else
+		{
+			OisHost h(port, "Replay", 0, 0);
+			while( port.NextPoll(deltaTime) )
+				h.Poll(sb, deltaTime);
+		}
+	};
+	replay();
+	if( !port.Polls() )
+	{
+		fprintf(stderr, "%s has no Polls\n", path);
+		return false;
+	}
+	if( port.Mismatches() )
+		fprintf(stderr, "%llu of the %llu bytes written differ from the capture, from byte %llu\n",
+		        (unsigned long long)port.Mismatches(), (unsigned long long)port.Written(), (unsigned long long)port.FirstMismatch());
+	if( port.MissingWrites() )
+		fprintf(stderr, "%llu of the %llu bytes written in the capture weren't written by the replay, in %llu Polls\n",
+		        (unsigned long long)port.MissingWrites(), (unsigned long long)port.CaptureWritten(),
+		        (unsigned long long)port.PollsMissingWrites());
+	Result r = { device ? "replay_device" : "replay_host", 0, "capture", 0, 0, (uint64_t)capture.size() };
+	Measure(r, port.Polls(), replay);
+	return true;
+}
+
+static bool ParseList(const char* arg, OIS_VECTOR<std::string>& out)
+{
+	out.clear();
+	std::string s = arg;
+	for( size_t start = 0; start <= s.size(); )
+	{
+		size_t comma = s.find(',', start);
+		if( comma == std::string::npos )
+			comma = s.size();
+		if( comma > start )
+			out.push_back(s.substr(start, comma - start));
+		start = comma + 1;
+	}
+	return !out.empty();
+}
+
+int main(int argc, char** argv)
+{
+	OIS_VECTOR<int> channelCounts = { 8, 1024, 8192 };
+	OIS_VECTOR<Distribution> distributions = { Boolean, Small, Medium, Full };
+	const char* capture = nullptr;
+	bool valid = true;
+	for( int i=1; i<argc && valid; ++i )
+	{
+		OIS_VECTOR<std::string> list;
+		if( 0 == strcmp(argv[i], "--json") )
+			g_json = true;
+		else if( 0 == strcmp(argv[i], "--seconds") && i+1 < argc )
+			g_minSeconds = atof(argv[++i]);
+		else if( 0 == strcmp(argv[i], "--capture") && i+1 < argc )
+			capture = argv[++i];
+		else if( 0 == strcmp(argv[i], "--channels") && i+1 < argc && ParseList(argv[++i], list) )
+		{
+			channelCounts.clear();
+			for( const std::string& c : list )
+				if( atoi(c.c_str()) > 0 )
+					channelCounts.push_back(atoi(c.c_str()));
+		}
+		else if( 0 == strcmp(argv[i], "--values") && i+1 < argc && ParseList(argv[++i], list) )
+		{
+			distributions.clear();
+			for( const std::string& v : list )
+			{
+				int d = 0;
+				while( d != NumDistributions && v != g_distributionNames[d] )
+					++d;
+				if( d == NumDistributions )
+					valid = false;
+				else
+					distributions.push_back((Distribution)d);
+			}
+		}
+		else
+			valid = false;
+	}
+	if( !valid || channelCounts.empty() || distributions.empty() )
+	{
+		fprintf(stderr, "Usage: %s [--json] [--channels 8,1024,8192] [--values boolean,small,medium,full] [--seconds 0.2]\n", argv[0]);
+		fprintf(stderr, "       %s [--json] [--seconds 0.2] --capture capture.bin\n", argv[0]);
+		return 1;
+	}
+
+	if( !g_json )
+		printf("%-16s %8s %-8s %12s %10s %14s %12s\n", "bench", "channels", "values", "messages", "ns/msg", "msgs/s", "stream bytes");
+	if( capture )
+		return Replay(capture) ? 0 : 1;
+	BenchCodec::Pack();
+	for( int channels : channelCounts )
+	{
+		for( Distribution d : distributions )
+		{
+			DeviceBinary(channels, d);
+			HostBinary(channels, d);
+			DeviceAscii(channels, d);
+		}
+		RegisterBinary(channels, Full);
+		RegisterAscii(channels, Full);
+	}
+	return 0;
+}
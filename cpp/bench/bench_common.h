@@ -0,0 +1,84 @@
+#ifndef OIS_BENCH_COMMON_INCLUDED
+#define OIS_BENCH_COMMON_INCLUDED
+//------------------------------------------------------------------------------
+// The in-memory link and random numbers that the benchmarks share. Include ois_protocol.h (with
+//  OIS_ENABLE_VIRTUAL_PORT) before this file.
+//------------------------------------------------------------------------------
+
+#include <string>
+
+//------------------------------------------------------------------------------
+// One direction of a link. What's been read stays in `data` until the next write finds it all read, so setting
+//  `position` back to 0 before then reads the same bytes again, e.g. to decode one stream over and over.
+struct Pipe
+{
+	std::string data;
+	size_t      position = 0;
+	double      allowance = 0;//bytes that a rate limited BenchPort may still read
+	size_t Queued() const { return data.size() - position; }
+};
+
+//------------------------------------------------------------------------------
+// Reads from one Pipe and writes to another, so two of these with the same Pipes the other way around connect an
+//  OisHost to an OisDevice. Either Pipe may be null: nothing is read, or what's written is discarded.
+// When rate limited, each read is limited to the Pipe's allowance, which the caller tops up to simulate bandwidth.
+class BenchPort : public IOisPort
+{
+public:
+	BenchPort(Pipe* in = nullptr, Pipe* out = nullptr, bool rateLimited = false)
+		: m_in(in), m_out(out), m_rateLimited(rateLimited) {}
+	void SetIn(Pipe* in)   { m_in = in; }
+	void SetOut(Pipe* out) { m_out = out; }
+	//Also appends everything written to `capture`, or stops if null.
+	void SetCapture(std::string* capture) { m_capture = capture; }
+
+	bool IsConnected()   { return m_connected; }
+	void Connect()       { m_connected = true; }
+	void Disconnect()    { m_connected = false; }
+	const char* Name()   { return "bench"; }
+	int Read(char* buffer, int size)
+	{
+		if( !m_in )
+			return 0;
+		int available = (int)m_in->Queued();
+		if( m_rateLimited && available > (int)m_in->allowance )
+			available = (int)m_in->allowance;
+		if( size > available )
+			size = available;
+		memcpy(buffer, m_in->data.data() + m_in->position, size);
+		m_in->position += size;
+		m_in->allowance -= size;
+		return size;
+	}
+	int Write(const char* buffer, int size)
+	{
+		if( m_out )
+		{
+			if( !m_out->Queued() )
+			{
+				m_out->data.clear();//keeps its capacity
+				m_out->position = 0;
+			}
+			m_out->data.append(buffer, size);
+		}
+		if( m_capture )
+			m_capture->append(buffer, size);
+		return size;
+	}
+private:
+	Pipe*        m_in;
+	Pipe*        m_out;
+	std::string* m_capture = nullptr;
+	bool         m_rateLimited;
+	bool         m_connected = true;
+};
+
+//------------------------------------------------------------------------------
+// Deterministic, so that runs with the same options are comparable
+struct Random
+{
+	uint32_t seed = 12345;
+	uint32_t Next() { seed = seed * 1103515245u + 12345u; return seed >> 8; }
+};
+
+#endif // OIS_BENCH_COMMON_INCLUDED
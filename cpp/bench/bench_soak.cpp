@@ -0,0 +1,448 @@
+//------------------------------------------------------------------------------
+// Soak test for ois_protocol.h: N simulated controllers (OisHost), each connected to its own OisDevice over an
+//  in-memory port that's limited to the bandwidth of a serial link.
+// Time is simulated in fixed ticks; every tick, each controller makes randomized changes to its outputs and fires its
+//  events at the target rate, and the game side changes its inputs at the same rate, then every host and device is
+//  polled once. Reports:
+//  * handshake time (until the device starts synchronising) and sync time (from then, until both sides are active)
+//  * delivered updates/s, and how many changes were coalesced into a later value before being sent
+//  * end-to-end latency percentiles, in simulated time: from the tick a change was made, to the tick it was seen on
+//    the other side, inclusive (so the minimum is one tick)
+//  * wall clock time spent polling, and how much faster than real-time that is
+//  * heap use: peak, after connecting, and the number of allocations made while soaking. Once connected, polling and
+//    making changes shouldn't allocate, so any allocation while soaking is a failure.
+//
+// Usage: bench_soak [--json] [--controllers 40] [--events 4] [--inputs 8] [--outputs 16] [--rate 100]
+//                   [--seconds 10] [--tick 1] [--baud 115200]
+//  --rate is changes per second, per controller and per direction. --tick is in ms. --baud 0 is unlimited.
+//  Exits with 2 if changes were still in flight after draining, or 3 if anything was allocated while soaking.
+// Build e.g.:  c++ -O2 -std=c++11 bench_soak.cpp -o bench_soak
+//------------------------------------------------------------------------------
+#define OIS_NO_SERIAL_PORT
+#define OIS_ENABLE_VIRTUAL_PORT
+#define OIS_PROTOCOL_IMPL
+#include "../ois_protocol.h"
+#include "bench_common.h"
+#include <chrono>
+#include <string>
+#include <cstddef>
+#include <new>
+
+//------------------------------------------------------------------------------
+// Counts everything allocated through operator new
+static size_t   g_heapLive = 0;
+static size_t   g_heapPeak = 0;
+static uint64_t g_allocations = 0;
+static const size_t g_heapHeader = alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+
+void* operator new(size_t size)
+{
+	char* p = (char*)malloc(size + g_heapHeader);
+	if( !p )
+		throw std::bad_alloc();
+	*(size_t*)p = size;
+	g_heapLive += size;
+	if( g_heapLive > g_heapPeak )
+		g_heapPeak = g_heapLive;
+	++g_allocations;
+	return p + g_heapHeader;
+}
+void operator delete(void* ptr) noexcept
+{
+	if( !ptr )
+		return;
+	char* p = (char*)ptr - g_heapHeader;
+	g_heapLive -= *(size_t*)p;
+	free(p);
+}
+void* operator new[](size_t size)               { return operator new(size); }
+void  operator delete[](void* ptr) noexcept     { operator delete(ptr); }
+void  operator delete(void* ptr, size_t) noexcept   { operator delete(ptr); }
+void  operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+
+//Latencies in ticks; the last bucket collects anything longer
+struct Histogram
+{
+	enum { Buckets = 4096 };
+	OIS_VECTOR<uint64_t> counts = OIS_VECTOR<uint64_t>(Buckets, 0);
+	uint64_t total = 0;
+	void Add(uint64_t ticks) { ++counts[ticks < Buckets ? ticks : Buckets-1]; ++total; }
+	uint64_t Percentile(double p) const
+	{
+		uint64_t rank = (uint64_t)(p * (double)(total ? total-1 : 0));
+		uint64_t seen = 0;
+		for( uint64_t i=0; i!=Buckets; ++i )
+		{
+			seen += counts[i];
+			if( seen > rank )
+				return i;
+		}
+		return Buckets-1;
+	}
+	uint64_t Max() const
+	{
+		for( uint64_t i=Buckets; i--; )
+			if( counts[i] )
+				return i;
+		return 0;
+	}
+};
+
+struct Options
+{
+	int    controllers = 40;
+	int    events = 4;
+	int    inputs = 8;
+	int    outputs = 16;
+	double rate = 100;
+	double seconds = 10;
+	double tickMs = 1;
+	int    baud = 115200;
+	bool   json = false;
+};
+
+//A change that hasn't been seen on the other side yet
+struct Pending
+{
+	uint64_t tick;//of the first change since the last delivery
+	int32_t  value;//latest value sent
+	bool     waiting;
+};
+
+//Event activations that haven't been seen on the other side yet, in the order they were made
+struct PendingEvents
+{
+	enum { Capacity = 64 };
+	uint64_t ticks[Capacity];
+	unsigned head = 0, count = 0;
+	bool Push(uint64_t tick) { if( count == Capacity ) return false; ticks[(head + count++) % Capacity] = tick; return true; }
+	uint64_t Pop() { uint64_t t = ticks[head]; head = (head + 1) % Capacity; --count; return t; }
+};
+
+struct Controller
+{
+	Controller(int index, const Options& o)
+		: hostPort(&toHost, &toDevice, o.baud > 0)
+		, devicePort(&toDevice, &toHost, o.baud > 0)
+		, host(hostPort, "Controller " + std::to_string(index), 0x1000 + index, 0x2000)
+		, device(devicePort, "soak", 1, "soak")
+	{
+		for( int i=0; i!=o.events; ++i )
+			events.push_back(host.AddEvent("Event " + std::to_string(i)));
+		for( int i=0; i!=o.inputs; ++i )
+			inputs.push_back(host.AddInput("Input " + std::to_string(i), OisState::Number));
+		for( int i=0; i!=o.outputs; ++i )
+			outputs.push_back(host.AddOutput("Output " + std::to_string(i), OisState::Number));
+		toHost.data.reserve(1024);//so that only a link that can't keep up allocates while soaking
+		toDevice.data.reserve(1024);
+		pendingEvents.resize(o.events);
+		pendingInputs.resize(o.inputs, Pending{0, 0, false});
+		pendingOutputs.resize(o.outputs, Pending{0, 0, false});
+	}
+
+	Pipe      toHost, toDevice;
+	BenchPort hostPort, devicePort;
+	OisHost  host;
+	OisDevice device;
+	OIS_VECTOR<uint16_t> events, inputs, outputs;//channels, in the order they were added to the host
+
+	//Indices of the same channels on the other side, found once connected
+	OIS_VECTOR<int> deviceInputs, deviceOutputs, hostInputs;
+	OIS_VECTOR<PendingEvents> pendingEvents;
+	OIS_VECTOR<Pending> pendingInputs, pendingOutputs;
+
+	uint64_t handshakeTick = 0, syncTick = 0;
+
+	template<class T, class C>
+	static int IndexOf(const T& values, C channel)
+	{
+		for( size_t i=0, end=values.size(); i!=end; ++i )
+			if( values[i].channel == channel )
+				return (int)i;
+		return -1;
+	}
+	void FindChannels()
+	{
+		for( uint16_t c : inputs )  deviceInputs.push_back(IndexOf(device.DeviceInputs(), c));
+		for( uint16_t c : inputs )  hostInputs.push_back(IndexOf(host.DeviceInputs(), c));
+		for( uint16_t c : outputs ) deviceOutputs.push_back(IndexOf(device.DeviceOutputs(), c));
+	}
+};
+
+struct Stats
+{
+	uint64_t  changes = 0;
+	uint64_t  delivered = 0;
+	uint64_t  coalesced = 0;
+	uint64_t  untracked = 0;//events made while PendingEvents was full
+	Histogram latency;
+};
+
+static int32_t NewValue(Random& r, int32_t previous)
+{
+	int32_t v = (int32_t)(r.Next() % 2001) - 1000;
+	return v == previous ? v + 1 : v;
+}
+
+//Controllers make changes to outputs and events, and the game to inputs
+static void MakeChanges(Controller& c, const Options& o, Random& random, uint64_t tick, Stats& stats)
+{
+	OisState::Value v;
+	int kind = (int)(random.Next() % (o.events + o.outputs));
+	if( kind < o.events )
+	{
+		c.host.Activate(c.events[kind]);
+		if( !c.pendingEvents[kind].Push(tick) )
+			++stats.untracked;
+	}
+	else
+	{
+		int i = kind - o.events;
+		Pending& p = c.pendingOutputs[i];
+		v.number = p.value = NewValue(random, p.value);
+		c.host.SetOutput(c.outputs[i], v);
+		if( p.waiting )
+			++stats.coalesced;
+		else
+			p = Pending{tick, p.value, true};
+	}
+	++stats.changes;
+
+	if( o.inputs )
+	{
+		int i = (int)(random.Next() % o.inputs);
+		Pending& p = c.pendingInputs[i];
+		v.number = p.value = NewValue(random, p.value);
+		c.device.SetInput(c.device.DeviceInputs()[c.deviceInputs[i]], v);
+		if( p.waiting )
+			++stats.coalesced;
+		else
+			p = Pending{tick, p.value, true};
+		++stats.changes;
+	}
+}
+
+static void CheckDeliveries(Controller& c, uint64_t tick, Stats& stats)
+{
+	c.device.PopEvents([&](const OisState::Event& e)
+	{
+		for( size_t i=0, end=c.events.size(); i!=end; ++i )
+		{
+			if( c.events[i] != e.channel || !c.pendingEvents[i].count )
+				continue;
+			stats.latency.Add(tick - c.pendingEvents[i].Pop() + 1);
+			++stats.delivered;
+		}
+	});
+	const OIS_VECTOR<OisState::NumericValue>& deviceOutputs = c.device.DeviceOutputs();
+	for( size_t i=0, end=c.pendingOutputs.size(); i!=end; ++i )
+	{
+		Pending& p = c.pendingOutputs[i];
+		if( p.waiting && deviceOutputs[c.deviceOutputs[i]].value.number == p.value )
+		{
+			stats.latency.Add(tick - p.tick + 1);
+			++stats.delivered;
+			p.waiting = false;
+		}
+	}
+	const OIS_VECTOR<OisState::NumericValue>& hostInputs = c.host.DeviceInputs();
+	for( size_t i=0, end=c.pendingInputs.size(); i!=end; ++i )
+	{
+		Pending& p = c.pendingInputs[i];
+		if( p.waiting && hostInputs[c.hostInputs[i]].value.number == p.value )
+		{
+			stats.latency.Add(tick - p.tick + 1);
+			++stats.delivered;
+			p.waiting = false;
+		}
+	}
+}
+
+static bool Waiting(const Controller& c)
+{
+	for( const PendingEvents& p : c.pendingEvents ) if( p.count )   return true;
+	for( const Pending& p : c.pendingOutputs )      if( p.waiting ) return true;
+	for( const Pending& p : c.pendingInputs )       if( p.waiting ) return true;
+	return false;
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	Options o;
+	bool valid = true;
+	for( int i=1; i<argc && valid; ++i )
+	{
+		const char* arg = argv[i];
+		bool hasValue = i+1 < argc;
+		if( 0 == strcmp(arg, "--json") )                           o.json = true;
+		else if( hasValue && 0 == strcmp(arg, "--controllers") )   o.controllers = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--events") )        o.events = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--inputs") )        o.inputs = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--outputs") )       o.outputs = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--rate") )          o.rate = atof(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--seconds") )       o.seconds = atof(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--tick") )          o.tickMs = atof(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--baud") )          o.baud = atoi(argv[++i]);
+		else                                                       valid = false;
+	}
+	if( !valid || o.controllers <= 0 || o.events < 0 || o.inputs < 0 || o.outputs < 0 || o.events + o.outputs <= 0 ||
+	    !(o.rate >= 0) || !(o.seconds > 0) || !(o.tickMs > 0) || o.baud < 0 )
+	{
+		fprintf(stderr, "Usage: %s [--json] [--controllers 40] [--events 4] [--inputs 8] [--outputs 16] [--rate 100]\n"
+		                "       [--seconds 10] [--tick 1] [--baud 115200]\n", argv[0]);
+		return 1;
+	}
+
+	typedef std::chrono::steady_clock Clock;
+	const double tickSeconds = o.tickMs / 1000;
+	const float tick = (float)tickSeconds;//for Poll
+	const double bytesPerTick = o.baud / 10.0 * tickSeconds;
+	OIS_STRING_BUILDER sb;
+	Stats stats;
+	Random random;
+	double pollSeconds = 0;
+	uint64_t now = 0;
+
+	OIS_VECTOR<Controller*> controllers;
+	for( int i=0; i!=o.controllers; ++i )
+		controllers.push_back(new Controller(i, o));
+
+	auto Step = [&]()
+	{
+		//Each tick allows another baud/10 bytes to be read (8N1), and unused bandwidth is lost
+		for( Controller* c : controllers )
+		{
+			c->toHost.allowance   = (c->toHost.allowance   < 1 ? c->toHost.allowance   : 1) + bytesPerTick;//keep fractions of a byte
+			c->toDevice.allowance = (c->toDevice.allowance < 1 ? c->toDevice.allowance : 1) + bytesPerTick;
+		}
+		Clock::time_point start = Clock::now();
+		for( Controller* c : controllers )
+			c->host.Poll(sb, tick);
+		for( Controller* c : controllers )
+			c->device.Poll(sb, tick);
+		pollSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+		++now;
+	};
+
+	//Connect
+	const uint64_t timeout = (uint64_t)(10.0 / tickSeconds + 0.5);
+	int connected = 0;
+	while( connected != o.controllers && now < timeout )
+	{
+		Step();
+		for( Controller* c : controllers )
+		{
+			if( !c->handshakeTick && c->device.Connecting() )
+				c->handshakeTick = now;
+			if( !c->syncTick && c->device.Connected() && c->host.Connected() )
+			{
+				c->syncTick = now;
+				c->FindChannels();
+				++connected;
+			}
+		}
+	}
+	if( connected != o.controllers )
+	{
+		fprintf(stderr, "Only %d of %d controllers connected within %.0fs\n", connected, o.controllers, timeout * tickSeconds);
+		return 1;
+	}
+	double handshakeMean = 0, handshakeMax = 0, syncMean = 0, syncMax = 0;
+	for( Controller* c : controllers )
+	{
+		double handshake = c->handshakeTick * o.tickMs, sync = (c->syncTick - c->handshakeTick) * o.tickMs;
+		handshakeMean += handshake / o.controllers;
+		syncMean += sync / o.controllers;
+		handshakeMax = handshake > handshakeMax ? handshake : handshakeMax;
+		syncMax = sync > syncMax ? sync : syncMax;
+	}
+	//Soak
+	const uint64_t soakTicks = (uint64_t)(o.seconds / tickSeconds + 0.5);
+	const double changesPerTick = o.rate * tickSeconds;
+	OIS_VECTOR<double> changeAllowance(o.controllers, 0.0);
+	size_t heapConnected = g_heapLive;
+	uint64_t allocationsBefore = g_allocations;
+	pollSeconds = 0;
+	for( uint64_t t=0; t!=soakTicks; ++t )
+	{
+		for( int i=0; i!=o.controllers; ++i )
+		{
+			for( changeAllowance[i] += changesPerTick; changeAllowance[i] >= 1 - 1e-9; changeAllowance[i] -= 1 )
+				MakeChanges(*controllers[i], o, random, now, stats);
+		}
+		Step();
+		for( Controller* c : controllers )
+			CheckDeliveries(*c, now-1, stats);
+	}
+	const double soakPollSeconds = pollSeconds;
+	const uint64_t soakAllocations = g_allocations - allocationsBefore;
+
+	//Drain whatever is still in flight, for up to a second
+	uint64_t inFlight = 0;
+	for( uint64_t t=0; t < (uint64_t)(1.0 / tickSeconds + 0.5); ++t )
+	{
+		bool waiting = false;
+		for( Controller* c : controllers )
+			waiting = waiting || Waiting(*c);
+		if( !waiting )
+			break;
+		Step();
+		for( Controller* c : controllers )
+			CheckDeliveries(*c, now-1, stats);
+	}
+	for( Controller* c : controllers )
+	{
+		for( const PendingEvents& p : c->pendingEvents ) inFlight += p.count;
+		for( const Pending& p : c->pendingOutputs )      inFlight += p.waiting;
+		for( const Pending& p : c->pendingInputs )       inFlight += p.waiting;
+	}
+
+	const double simulated = (double)soakTicks * tickSeconds;
+	const double ms = o.tickMs;
+	if( o.json )
+	{
+		printf("{\"controllers\":%d,\"events\":%d,\"inputs\":%d,\"outputs\":%d,\"rate\":%.1f,\"seconds\":%.3f,\"tick_ms\":%.3f,\"baud\":%d,"
+		       "\"handshake_ms_mean\":%.2f,\"handshake_ms_max\":%.2f,\"sync_ms_mean\":%.2f,\"sync_ms_max\":%.2f,"
+		       "\"changes\":%llu,\"delivered\":%llu,\"coalesced\":%llu,\"untracked\":%llu,\"lost\":%llu,\"updates_per_second\":%.1f,"
+		       "\"latency_ms_p50\":%.2f,\"latency_ms_p90\":%.2f,\"latency_ms_p99\":%.2f,\"latency_ms_p999\":%.2f,\"latency_ms_max\":%.2f,"
+		       "\"poll_seconds\":%.4f,\"realtime_factor\":%.1f,\"ns_per_update\":%.1f,"
+		       "\"heap_peak_bytes\":%llu,\"heap_connected_bytes\":%llu,\"soak_allocations\":%llu}\n",
+		       o.controllers, o.events, o.inputs, o.outputs, o.rate, simulated, o.tickMs, o.baud,
+		       handshakeMean, handshakeMax, syncMean, syncMax,
+		       (unsigned long long)stats.changes, (unsigned long long)stats.delivered, (unsigned long long)stats.coalesced,
+		       (unsigned long long)stats.untracked, (unsigned long long)inFlight, stats.delivered / simulated,
+		       stats.latency.Percentile(0.5) * ms, stats.latency.Percentile(0.9) * ms, stats.latency.Percentile(0.99) * ms,
+		       stats.latency.Percentile(0.999) * ms, stats.latency.Max() * ms,
+		       soakPollSeconds, simulated / soakPollSeconds, soakPollSeconds * 1e9 / (double)(stats.delivered ? stats.delivered : 1),
+		       (unsigned long long)g_heapPeak, (unsigned long long)heapConnected, (unsigned long long)soakAllocations);
+	}
+	else
+	{
+		printf("%d controllers with %d events, %d inputs and %d outputs; %.0f changes/s each way; %.1fs in %.2fms ticks; ",
+		       o.controllers, o.events, o.inputs, o.outputs, o.rate, simulated, o.tickMs);
+		if( o.baud )
+			printf("%d baud\n", o.baud);
+		else
+			printf("unlimited bandwidth\n");
+		printf("handshake      %8.2f ms mean, %8.2f ms max\n", handshakeMean, handshakeMax);
+		printf("sync           %8.2f ms mean, %8.2f ms max\n", syncMean, syncMax);
+		printf("changes        %8llu (%llu coalesced into a later value, %llu events not tracked)\n",
+		       (unsigned long long)stats.changes, (unsigned long long)stats.coalesced, (unsigned long long)stats.untracked);
+		printf("delivered      %8llu (%.0f/s), %llu still in flight after draining\n",
+		       (unsigned long long)stats.delivered, stats.delivered / simulated, (unsigned long long)inFlight);
+		printf("latency        p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms\n",
+		       stats.latency.Percentile(0.5) * ms, stats.latency.Percentile(0.9) * ms, stats.latency.Percentile(0.99) * ms,
+		       stats.latency.Percentile(0.999) * ms, stats.latency.Max() * ms);
+		printf("polling        %8.3f s wall clock, %.1fx real-time, %.1f ns per delivered update\n",
+		       soakPollSeconds, simulated / soakPollSeconds, soakPollSeconds * 1e9 / (double)(stats.delivered ? stats.delivered : 1));
+		printf("heap           %8.1f KB peak, %.1f KB once connected (%.1f KB per controller), %llu allocations while soaking\n",
+		       g_heapPeak / 1024.0, heapConnected / 1024.0, heapConnected / 1024.0 / o.controllers, (unsigned long long)soakAllocations);
+	}
+
+	for( Controller* c : controllers )
+		delete c;
+	if( soakAllocations )
+		fprintf(stderr, "%llu allocations while soaking; steady-state polling should not allocate\n", (unsigned long long)soakAllocations);
+	return inFlight ? 2 : soakAllocations ? 3 : 0;
+}
@@ -0,0 +1,236 @@
+//------------------------------------------------------------------------------
+// Stress test for OisThreadedDevice (ois_threaded.h). An I/O thread polls a simulated controller (OisHost) and the
+//  OisThreadedDevice that it's connected to, over an in-memory port, as fast as it can. Every poll, the controller
+//  sets all of its outputs to the same new value and fires --events events. Meanwhile the game thread hammers
+//  SetInput, PopEvents and ReadOutputs. Checks that:
+//  * every Outputs snapshot that the game reads holds a single generation of values, i.e. none were torn
+//  * every event that was sent was either delivered to the game, or counted by DroppedEvents
+//  * every input value that the game queued was applied, in order: the controller ends with the last one of each
+//    channel, and never sees a channel's value go backwards
+// Build it with -fsanitize=thread to also check the handoffs between the threads for data races. GCC warns that
+//  ThreadSanitizer doesn't model the fences in OisSeqlock; the torn snapshot check covers that.
+//
+// Usage: bench_threaded [--json] [--seconds 5] [--inputs 8] [--outputs 32] [--events 4] [--game-sleep-us 0]
+//  --game-sleep-us makes the game thread sleep between passes, so that the queues fill up and events are dropped.
+//  Exits with 2 if any check failed.
+// Build e.g.:  c++ -O1 -g -std=c++11 -fsanitize=thread bench_threaded.cpp -o bench_threaded -pthread
+//------------------------------------------------------------------------------
+#define OIS_NO_SERIAL_PORT
+#define OIS_ENABLE_VIRTUAL_PORT
+#define OIS_PROTOCOL_IMPL
+#include "../ois_protocol.h"
+#include "../ois_threaded.h"
+#include "bench_common.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+//------------------------------------------------------------------------------
+struct Options
+{
+	double seconds = 5;
+	int    inputs = 8;
+	int    outputs = 32;
+	int    events = 4;
+	int    gameSleepUs = 0;
+	bool   json = false;
+};
+
+//Number values are 16 bit on the wire, so sequences count 1..30000 and wrap
+static int32_t Next(int32_t v) { return v >= 30000 ? 1 : v + 1; }
+//True if `to` is `from`, or comes after it by less than half of the cycle
+static bool NotBehind(int32_t from, int32_t to)
+{
+	int32_t ahead = (to - from + 30000) % 30000;
+	return from == 0 || ahead < 15000;
+}
+
+//------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+	Options o;
+	bool valid = true;
+	for( int i=1; i<argc && valid; ++i )
+	{
+		const char* arg = argv[i];
+		bool hasValue = i+1 < argc;
+		if( 0 == strcmp(arg, "--json") )                           o.json = true;
+		else if( hasValue && 0 == strcmp(arg, "--seconds") )       o.seconds = atof(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--inputs") )        o.inputs = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--outputs") )       o.outputs = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--events") )        o.events = atoi(argv[++i]);
+		else if( hasValue && 0 == strcmp(arg, "--game-sleep-us") ) o.gameSleepUs = atoi(argv[++i]);
+		else                                                       valid = false;
+	}
+	if( !valid || !(o.seconds > 0) || o.inputs < 1 || o.outputs < 1 || o.outputs > OIS_THREADED_MAX_OUTPUTS ||
+	    o.events < 1 || o.gameSleepUs < 0 )
+	{
+		fprintf(stderr, "Usage: %s [--json] [--seconds 5] [--inputs 8] [--outputs 32] [--events 4] [--game-sleep-us 0]\n", argv[0]);
+		return 1;
+	}
+
+	Pipe toController, toGame;
+	//Both ends of the link are only used by the I/O thread
+	BenchPort controllerPort(&toController, &toGame), gamePort(&toGame, &toController);
+	OisHost controller(controllerPort, "Stress", 0x1000, 0x2000);
+	OisDevice device(gamePort, "stress", 1, "bench_threaded");
+	OisThreadedDevice threaded(device);
+	OIS_VECTOR<uint16_t> events, outputs;
+	for( int i=0; i!=o.inputs; ++i )
+		controller.AddInput("Input " + std::to_string(i), OisState::Number);
+	for( int i=0; i!=o.outputs; ++i )
+		outputs.push_back(controller.AddOutput("Output " + std::to_string(i), OisState::Number));
+	for( int i=0; i!=o.events; ++i )
+		events.push_back(controller.AddEvent("Event " + std::to_string(i)));
+
+	//Connect before starting the threads; the I/O thread takes over polling from here
+	OIS_STRING_BUILDER sb;
+	for( int i=0; i!=1000 && !(device.Connected() && controller.Connected()); ++i )
+	{
+		controller.Poll(sb, 0.01f);
+		threaded.Poll(sb, 0.01f);
+	}
+	if( !device.Connected() || !controller.Connected() )
+	{
+		fprintf(stderr, "Not connected\n");
+		return 1;
+	}
+
+	std::atomic<bool> gameDone{false}, ioDone{false};
+	uint64_t eventsSent = 0, polls = 0, inputsBackwards = 0;
+
+	//I/O thread
+	std::thread io([&]()
+	{
+		OIS_STRING_BUILDER sb;
+		OIS_VECTOR<int32_t> lastInputs(o.inputs, 0);
+		int32_t generation = 0;
+		auto PollBoth = [&]()
+		{
+			controller.Poll(sb, 0.001f);
+			threaded.Poll(sb, 0.001f);
+			controller.Poll(sb, 0.001f);//receives the inputs that the game side just sent
+			const OIS_VECTOR<OisState::NumericValue>& inputs = controller.DeviceInputs();
+			for( size_t i=0; i!=inputs.size() && i!=lastInputs.size(); ++i )
+			{
+				inputsBackwards += NotBehind(lastInputs[i], inputs[i].value.number) ? 0 : 1;
+				lastInputs[i] = inputs[i].value.number;
+			}
+			++polls;
+		};
+		while( !gameDone.load() )
+		{
+			generation = Next(generation);
+			for( uint16_t channel : outputs )
+			{
+				OisState::Value v;
+				v.number = generation;
+				controller.SetOutput(channel, v);
+			}
+			for( uint16_t channel : events )
+			{
+				controller.Activate(channel);
+				++eventsSent;
+			}
+			PollBoth();
+		}
+		//The game has stopped queueing inputs: flush them, and the last events
+		for( int i=0; i!=10; ++i )
+			PollBoth();
+		ioDone.store(true);
+	});
+
+	//Game thread (this one)
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point end = Clock::now() + std::chrono::microseconds((int64_t)(o.seconds * 1e6));
+	OisThreadedDevice::Outputs snapshot;
+	OIS_VECTOR<uint16_t> inputChannels;
+	OIS_VECTOR<int32_t> queuedInputs;//the last value queued for each of inputChannels
+	uint64_t eventsDelivered = 0, reads = 0, tornReads = 0, inputsQueued = 0, inputsRefused = 0;
+	uint32_t channel = 0;
+	auto CountEvent = [&](uint16_t) { ++eventsDelivered; };
+	while( Clock::now() < end )
+	{
+		if( threaded.AcquireRegistrations() || inputChannels.empty() )
+		{
+			const OisThreadedDevice::RegistrationList& r = threaded.Registrations();
+			if( inputChannels.size() != r.inputs.size() )
+			{
+				inputChannels.clear();
+				for( const OisState::NumericValue& v : r.inputs )
+					inputChannels.push_back(v.channel);
+				queuedInputs.assign(inputChannels.size(), 0);
+			}
+		}
+		for( int i=0; i!=16 && !inputChannels.empty(); ++i, ++channel )
+		{
+			size_t index = channel % inputChannels.size();
+			OisState::Value v;
+			v.number = Next(queuedInputs[index]);
+			if( threaded.SetInput(inputChannels[index], v) )
+			{
+				queuedInputs[index] = v.number;
+				++inputsQueued;
+			}
+			else
+				++inputsRefused;
+		}
+		threaded.PopEvents(CountEvent);
+		threaded.ReadOutputs(snapshot);
+		++reads;
+		for( unsigned i=1; i<snapshot.count; ++i )
+		{
+			if( snapshot.values[i].value.number != snapshot.values[0].value.number )
+			{
+				++tornReads;
+				break;
+			}
+		}
+		if( o.gameSleepUs )
+			std::this_thread::sleep_for(std::chrono::microseconds(o.gameSleepUs));
+	}
+	gameDone.store(true);
+	while( !ioDone.load() )
+		threaded.PopEvents(CountEvent);
+	io.join();
+	threaded.PopEvents(CountEvent);
+
+	uint64_t inputsLost = 0;
+	const OIS_VECTOR<OisState::NumericValue>& finalInputs = controller.DeviceInputs();
+	for( size_t i=0; i!=inputChannels.size(); ++i )
+	{
+		const OisState::NumericValue* v = nullptr;
+		for( const OisState::NumericValue& c : finalInputs )
+			if( c.channel == inputChannels[i] )
+				v = &c;
+		inputsLost += !v || v->value.number != queuedInputs[i];
+	}
+	uint64_t dropped = threaded.DroppedEvents();
+	bool eventsOk = eventsDelivered + dropped == eventsSent;
+	bool ok = !tornReads && eventsOk && !inputsLost && !inputsBackwards && !inputChannels.empty();
+
+	if( o.json )
+	{
+		printf("{\"seconds\":%.3f,\"inputs\":%d,\"outputs\":%d,\"events\":%d,\"game_sleep_us\":%d,\"polls\":%llu,\"reads\":%llu,"
+		       "\"torn_reads\":%llu,\"events_sent\":%llu,\"events_delivered\":%llu,\"events_dropped\":%llu,"
+		       "\"inputs_queued\":%llu,\"inputs_refused\":%llu,\"inputs_lost\":%llu,\"inputs_backwards\":%llu,\"ok\":%s}\n",
+		       o.seconds, o.inputs, o.outputs, o.events, o.gameSleepUs, (unsigned long long)polls, (unsigned long long)reads,
+		       (unsigned long long)tornReads, (unsigned long long)eventsSent, (unsigned long long)eventsDelivered,
+		       (unsigned long long)dropped, (unsigned long long)inputsQueued, (unsigned long long)inputsRefused,
+		       (unsigned long long)inputsLost, (unsigned long long)inputsBackwards, ok ? "true" : "false");
+	}
+	else
+	{
+		printf("%.1fs: %llu polls on the I/O thread, %llu passes on the game thread\n", o.seconds,
+		       (unsigned long long)polls, (unsigned long long)reads);
+		printf("outputs   %llu torn snapshots\n", (unsigned long long)tornReads);
+		printf("events    %llu sent, %llu delivered, %llu dropped%s\n", (unsigned long long)eventsSent,
+		       (unsigned long long)eventsDelivered, (unsigned long long)dropped, eventsOk ? "" : " (MISMATCH)");
+		printf("inputs    %llu queued (%llu refused while full), %llu channels lost their last value, %llu went backwards\n",
+		       (unsigned long long)inputsQueued, (unsigned long long)inputsRefused, (unsigned long long)inputsLost,
+		       (unsigned long long)inputsBackwards);
+		printf("%s\n", ok ? "OK" : "FAILED");
+	}
+	return ok ? 0 : 2;
+}
@@ -0,0 +1,162 @@
+//------------------------------------------------------------------------------
+// Benchmark for websocket permessage-deflate (ois_deflate.h) on typical OIS controller traffic.
+// For each kind of traffic, reports the bytes on the wire (payload + websocket frame header) with and without
+//  compression, and the CPU time per message to compress and decompress it.
+//
+// Build e.g.:  c++ -O2 -std=c++11 bench_ws_deflate.cpp -lz -o bench_ws_deflate
+//------------------------------------------------------------------------------
+#include "../ois_deflate.h"
+#include <chrono>
+#include <string>
+
+typedef OIS_VECTOR<std::string> Messages;
+
+//A browser controller registering 16 commands, 32 inputs and 16 outputs, as sent by javascript/ois_protocol.js
+static std::string RegistrationMessage()
+{
+	std::string m = "PID=1234,5678,Virtual Flight Panel\n";
+	char line[128];
+	int channel = 0;
+	for( int i=0; i!=16; ++i, ++channel )
+	{
+		snprintf(line, sizeof(line), "CMD=Button_%d,%d\n", i, channel);
+		m += line;
+	}
+	for( int i=0; i!=32; ++i, ++channel )
+	{
+		static const char* types[] = { "NIB", "NIN", "NIF" };
+		snprintf(line, sizeof(line), "%s=Indicator_%d,%d\n", types[i%3], i, channel);
+		m += line;
+	}
+	for( int i=0; i!=16; ++i, ++channel )
+	{
+		static const char* types[] = { "NOB", "NON", "NOF" };
+		snprintf(line, sizeof(line), "%s=Slider_%d,%d\n", types[i%3], i, channel);
+		m += line;
+	}
+	m += "ACT\n";
+	return m;
+}
+
+//ASCII value updates: a few sliders that move smoothly plus the odd button press, one message per 100ms poll.
+static Messages ValueMessages(int count, int firstChannel, bool withEvents)
+{
+	Messages messages;
+	unsigned seed = 12345;
+	char line[64];
+	for( int i=0; i!=count; ++i )
+	{
+		std::string m;
+		seed = seed * 1103515245u + 12345u;
+		int lines = 1 + (seed >> 16) % 4;
+		for( int l=0; l!=lines; ++l )
+		{
+			int channel = firstChannel + (int)((seed >> (l*4)) % 8);
+			int value = (int)(5000 + 4000 * ((i + l*7) % 50) / 50);
+			snprintf(line, sizeof(line), "%d=%d\n", channel, value);
+			m += line;
+		}
+		if( withEvents && (seed >> 24) % 8 == 0 )
+		{
+			snprintf(line, sizeof(line), "EXC=%d\n", (int)((seed >> 8) % 16));
+			m += line;
+		}
+		messages.push_back(m);
+	}
+	return messages;
+}
+
+static unsigned FrameHeaderSize(size_t payload, bool masked)
+{
+	return (payload < 126 ? 2 : payload < 65536 ? 4 : 10) + (masked ? 4 : 0);
+}
+
+struct Result
+{
+	size_t messages = 0;
+	size_t rawWire = 0;
+	size_t wire = 0;
+	size_t compressedMessages = 0;
+	double compressNs = 0;
+	double decompressNs = 0;
+};
+
+//Send every message through one connection's contexts, the way OisWebHost would.
+static Result Run(const Messages& messages, bool masked, unsigned threshold, bool noContextTakeover, int repeats)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	Result r;
+	OIS_VECTOR<uint8_t> compressed, inflated;
+	for( int rep=0; rep!=repeats; ++rep )
+	{
+		OisDeflateParams params;
+		params.serverNoContextTakeover = noContextTakeover;
+		params.clientNoContextTakeover = noContextTakeover;
+		OisWebsocketDeflate sender(params), receiver(params);
+		for( const std::string& m : messages )
+		{
+			const uint8_t* data = (const uint8_t*)m.data();
+			unsigned size = (unsigned)m.size();
+			r.messages++;
+			r.rawWire += size + FrameHeaderSize(size, masked);
+			if( size < threshold )
+			{
+				r.wire += size + FrameHeaderSize(size, masked);
+				continue;
+			}
+			Clock::time_point t0 = Clock::now();
+			if( !sender.Compress(data, size, compressed) )
+				exit(1);
+			Clock::time_point t1 = Clock::now();
+			inflated.clear();
+			if( !receiver.Decompress(compressed.empty() ? nullptr : &compressed.front(), (unsigned)compressed.size(), inflated) )
+				exit(1);
+			Clock::time_point t2 = Clock::now();
+			if( inflated.size() != size || 0 != memcmp(&inflated.front(), data, size) )
+			{
+				printf("MISMATCH\n");
+				exit(1);
+			}
+			r.compressedMessages++;
+			r.wire += compressed.size() + FrameHeaderSize(compressed.size(), masked);
+			r.compressNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+			r.decompressNs += std::chrono::duration<double, std::nano>(t2 - t1).count();
+		}
+	}
+	return r;
+}
+
+int main()
+{
+	Messages registration(1, RegistrationMessage());
+	Messages toHost = ValueMessages(2000, 16, true);
+	Messages toDevice = ValueMessages(2000, 48, false);
+
+	struct Scenario { const char* name; const Messages* messages; bool masked; int repeats; };
+	Scenario scenarios[] =
+	{
+		{ "registration",     &registration, true,  200 },
+		{ "values_to_host",   &toHost,       true,  5 },
+		{ "values_to_device", &toDevice,     false, 5 },
+	};
+	unsigned thresholds[] = { 0, 16, 32, 64 };
+
+	printf("%-18s %-10s %9s %8s %10s %10s %7s %10s %12s %14s\n",
+		"traffic", "context", "threshold", "messages", "raw_bytes", "wire_bytes", "ratio", "compressed", "deflate_ns", "inflate_ns");
+	for( const Scenario& s : scenarios )
+	{
+		for( int noTakeover=0; noTakeover!=2; ++noTakeover )
+		{
+			for( unsigned threshold : thresholds )
+			{
+				Result r = Run(*s.messages, s.masked, threshold, noTakeover != 0, s.repeats);
+				double perMessage = r.compressedMessages ? 1.0 / r.compressedMessages : 0;
+				printf("%-18s %-10s %9u %8u %10u %10u %7.3f %10u %12.0f %14.0f\n",
+					s.name, noTakeover ? "reset" : "takeover", threshold, (unsigned)r.messages,
+					(unsigned)r.rawWire, (unsigned)r.wire, (double)r.wire / r.rawWire, (unsigned)r.compressedMessages,
+					r.compressNs * perMessage, r.decompressNs * perMessage);
+			}
+		}
+	}
+	return 0;
+}
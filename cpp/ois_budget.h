@@ -0,0 +1,122 @@
+#ifndef OIS_BUDGET_INCLUDED
+#define OIS_BUDGET_INCLUDED
+//------------------------------------------------------------------------------
+// A cap on the protocol work done by each Poll of one OIS connection, and a breakdown of where each Poll's time went.
+//  ois_protocol.h uses this when OIS_ENABLE_POLL_BUDGET is defined, and OisDevice::PollBudget / OisHost::PollBudget
+//  return it.
+// * SetLimits caps the bytes read, and the time spent reading and parsing, in one Poll. Whatever is left stays in the
+//   port and is read by the next Poll, so a peer that floods the link delays its own traffic, instead of stalling the
+//   caller's frame. Nothing is dropped, but a port with a small buffer (e.g. a serial port) can overflow if it's
+//   always over budget. Queued values and events are always sent.
+//   The time limit is checked after each read is parsed, which is at most OIS_MAX_COMMAND_LENGTH*2 bytes, so a Poll
+//   can overrun it by that much parsing.
+// * LastPoll is the breakdown of the previous Poll, and SetCallback reports each one as it finishes:
+//   - read:  in OIS_PORT::Read
+//   - parse: processing the commands that were read, including any replies that they send
+//   - send:  everything else in Poll, which is mostly sending queued values and events, or the handshake
+// Each Poll takes about one timestamp per read, plus two; nothing is allocated.
+//------------------------------------------------------------------------------
+
+#include <cstdint>
+
+//------------------------------------------------------------------------------
+struct OisPollProfile
+{
+	uint64_t totalNanoseconds;
+	uint64_t readNanoseconds;
+	uint64_t parseNanoseconds;
+	uint64_t sendNanoseconds;
+	uint32_t bytesRead;
+	bool     limited;//stopped reading because of the budget, so there may be a backlog for the next Poll
+};
+
+//------------------------------------------------------------------------------
+class OisPollBudget
+{
+public:
+	typedef void (*Callback)(const OisPollProfile&, void* user);
+
+	//0 is unlimited.
+	void SetLimits(uint32_t maxBytes, uint64_t maxNanoseconds)
+	{
+		m_maxBytes = maxBytes;
+		m_maxNanoseconds = maxNanoseconds;
+	}
+	uint32_t MaxBytes()       const { return m_maxBytes; }
+	uint64_t MaxNanoseconds() const { return m_maxNanoseconds; }
+	//Called at the end of every Poll, from the thread that polls.
+	void SetCallback(Callback callback, void* user)
+	{
+		m_callback = callback;
+		m_callbackUser = user;
+	}
+	const OisPollProfile& LastPoll() const { return m_last; }
+
+	//Used by ois_protocol.h:
+	class Scope
+	{
+	public:
+		explicit Scope(OisPollBudget& budget) : m_budget(budget) { m_budget.Begin(); }
+		~Scope()                                                 { m_budget.End(); }
+	private:
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+		OisPollBudget& m_budget;
+	};
+	//How much of `space` may be read now. 0 once the byte limit is reached.
+	unsigned ReadLimit(unsigned space)
+	{
+		if( !m_maxBytes )
+			return space;
+		uint32_t left = m_maxBytes > m_current.bytesRead ? m_maxBytes - m_current.bytesRead : 0;
+		if( !left )
+			m_current.limited = true;
+		return left < space ? left : space;
+	}
+	void OnRead(unsigned bytes)
+	{
+		uint64_t now = OIS_TIME_NS();
+		m_current.readNanoseconds += now - m_mark;
+		m_current.bytesRead += bytes;
+		m_mark = now;
+	}
+	//Returns false once the time limit is reached.
+	bool OnParsed()
+	{
+		uint64_t now = OIS_TIME_NS();
+		m_current.parseNanoseconds += now - m_mark;
+		m_mark = now;
+		if( m_maxNanoseconds && now - m_start >= m_maxNanoseconds )
+		{
+			m_current.limited = true;
+			return false;
+		}
+		return true;
+	}
+private:
+	void Begin()
+	{
+		m_current = OisPollProfile();
+		m_start = m_mark = OIS_TIME_NS();
+	}
+	void End()
+	{
+		m_current.totalNanoseconds = OIS_TIME_NS() - m_start;
+		uint64_t measured = m_current.readNanoseconds + m_current.parseNanoseconds;
+		m_current.sendNanoseconds = m_current.totalNanoseconds > measured ? m_current.totalNanoseconds - measured : 0;
+		m_last = m_current;
+		if( m_callback )
+			m_callback(m_last, m_callbackUser);
+	}
+
+	uint32_t       m_maxBytes = 0;
+	uint64_t       m_maxNanoseconds = 0;
+	Callback       m_callback = nullptr;
+	void*          m_callbackUser = nullptr;
+	uint64_t       m_start = 0;
+	uint64_t       m_mark = 0;//the end of the last timed step
+	OisPollProfile m_current = OisPollProfile();
+	OisPollProfile m_last = OisPollProfile();
+};
+
+#endif // OIS_BUDGET_INCLUDED
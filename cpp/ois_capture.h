@@ -0,0 +1,195 @@
+#ifndef OIS_CAPTURE_INCLUDED
+#define OIS_CAPTURE_INCLUDED
+//------------------------------------------------------------------------------
+// Wire-level capture of one OIS connection: every byte an OisDevice / OisHost reads from and writes to its port, and
+//  the deltaTime / connection state of each Poll, with timestamps. ois_protocol.h writes into an OisCapture when
+//  OIS_ENABLE_CAPTURE is defined and one is attached with SetCapture.
+// A capture can be fed back into a fresh OisDevice / OisHost with OisReplayPort (ois_replay.h), to reproduce an issue
+//  from the field offline, or to benchmark with real traffic. Replaying Poll by Poll reproduces everything that the
+//  object did in response to what it read. What the application did isn't captured, e.g. SetInput / SetOutput /
+//  Activate / AddInput calls, so the writes that those caused are missing from a replay (see
+//  OisReplayPort::MissingWrites).
+// Records are only ever appended, and the file is written through a FILE buffer; call Flush to bound how much is lost
+//  if the process dies. A truncated file is still readable up to its last complete record.
+//------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+// Capture file layout, in the byte order of the machine that wrote it:
+//  OisCaptureFileHeader
+//  any number of { OisCaptureRecord, followed by `length` bytes, then zeros up to a multiple of 8 bytes }
+// Every record starts 8-byte aligned, so a memory-mapped capture can be walked in place (see OisCaptureReader).
+struct OisCaptureFileHeader
+{
+	enum { Version = 1 };
+	enum Side : uint8_t
+	{
+		Host,  //written by an OisDevice: it reads the device's commands, and writes the host's
+		Device,//written by an OisHost: it reads the host's commands, and writes the device's
+	};
+	char     magic[8];//"OISCAPTR"
+	uint32_t version;
+	uint8_t  side;
+	uint8_t  padding[3];
+};
+
+struct OisCaptureRecord
+{
+	enum Type : uint8_t
+	{
+		Read, //bytes returned by the port's Read
+		Write,//bytes passed to the port's Write
+		Poll, //the start of a Poll call: an OisCapturePoll
+	};
+	uint64_t time;  //nanoseconds since the capture was opened
+	uint32_t length;//of the data that follows
+	uint8_t  type;  //Type
+	uint8_t  padding[3];
+};
+static_assert( sizeof(OisCaptureFileHeader) == 16, "OisCaptureFileHeader should be packed into 16 bytes" );
+static_assert( sizeof(OisCaptureRecord) == 16, "OisCaptureRecord should be packed into 16 bytes" );
+
+struct OisCapturePoll
+{
+	float    deltaTime;
+	uint32_t connected;//the port's IsConnected, as the Poll started
+};
+
+//------------------------------------------------------------------------------
+class OisCapture
+{
+public:
+	OisCapture() {}
+	~OisCapture() { Close(); }
+
+	//Creates (or truncates) the file. `side` must match the object it is attached to.
+	bool Open(const char* path, OisCaptureFileHeader::Side side)
+	{
+		Close();
+		m_file = fopen(path, "wb");
+		if( !m_file )
+			return false;
+		OisCaptureFileHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, "OISCAPTR", 8);
+		h.version = OisCaptureFileHeader::Version;
+		h.side = side;
+		m_side = side;
+		m_start = OIS_TIME_NS();
+		m_size = sizeof(h);
+		m_failed = 1 != fwrite(&h, sizeof(h), 1, m_file);
+		return !m_failed;
+	}
+	bool Close()
+	{
+		if( !m_file )
+			return false;
+		bool ok = 0 == fclose(m_file) && !m_failed;
+		m_file = nullptr;
+		return ok;
+	}
+	bool Flush() { return m_file && 0 == fflush(m_file); }
+
+	bool     IsOpen() const { return m_file != nullptr; }
+	//False if any write to the file has failed.
+	bool     Ok()     const { return m_file && !m_failed; }
+	OisCaptureFileHeader::Side Side() const { return m_side; }
+	//The size of the file so far.
+	uint64_t Size()   const { return m_size; }
+
+	//Called by ois_protocol.h
+	void OnPoll(float deltaTime, bool connected)
+	{
+		OisCapturePoll p = { deltaTime, connected ? 1U : 0U };
+		Record(OisCaptureRecord::Poll, &p, sizeof(p));
+	}
+	void OnRead(const char* data, int size)  { Record(OisCaptureRecord::Read, data, (uint32_t)size); }
+	void OnWrite(const char* data, int size) { Record(OisCaptureRecord::Write, data, (uint32_t)size); }
+private:
+	OisCapture(const OisCapture&);
+	OisCapture& operator=(const OisCapture&);
+
+	void Record(OisCaptureRecord::Type type, const void* data, uint32_t length)
+	{
+		if( !m_file || m_failed )
+			return;
+		OisCaptureRecord r;
+		memset(&r, 0, sizeof(r));
+		r.time = OIS_TIME_NS() - m_start;
+		r.length = length;
+		r.type = type;
+		static const char zeros[8] = {};
+		uint32_t padding = (8 - (length & 7)) & 7;
+		m_failed = 1 != fwrite(&r, sizeof(r), 1, m_file)
+		        || length != fwrite(data, 1, length, m_file)
+		        || padding != fwrite(zeros, 1, padding, m_file);
+		m_size += sizeof(r) + length + padding;
+	}
+
+	FILE*    m_file = nullptr;
+	bool     m_failed = false;
+	OisCaptureFileHeader::Side m_side = OisCaptureFileHeader::Host;
+	uint64_t m_start = 0;
+	uint64_t m_size = 0;
+};
+
+//------------------------------------------------------------------------------
+// Walks the records of a capture that's in memory (e.g. memory-mapped, or loaded by OisReplayPort::Open).
+class OisCaptureReader
+{
+public:
+	struct Entry
+	{
+		const OisCaptureRecord* record;
+		const uint8_t*          data;//record->length bytes
+		size_t                  offset;//of the record in the file
+	};
+
+	OisCaptureReader() {}
+	OisCaptureReader(const void* data, size_t size) { Reset(data, size); }
+	//Returns false if this isn't a capture of a version that can be read.
+	bool Reset(const void* data, size_t size)
+	{
+		m_data = (const uint8_t*)data;
+		m_size = size;
+		m_offset = sizeof(OisCaptureFileHeader);
+		const OisCaptureFileHeader* h = Header();
+		m_valid = h && 0 == memcmp(h->magic, "OISCAPTR", 8) && h->version == OisCaptureFileHeader::Version;
+		return m_valid;
+	}
+	bool Valid() const { return m_valid; }
+	const OisCaptureFileHeader* Header() const { return m_size >= sizeof(OisCaptureFileHeader) ? (const OisCaptureFileHeader*)m_data : nullptr; }
+
+	//False at the end of the capture, or at a truncated record.
+	bool Next(Entry& e)
+	{
+		if( !Peek(e) )
+			return false;
+		m_offset += sizeof(OisCaptureRecord) + ((e.record->length + 7) & ~(size_t)7);
+		return true;
+	}
+	bool Peek(Entry& e) const
+	{
+		if( !m_valid || m_offset > m_size || m_size - m_offset < sizeof(OisCaptureRecord) )
+			return false;
+		const OisCaptureRecord* r = (const OisCaptureRecord*)(m_data + m_offset);
+		if( m_size - m_offset - sizeof(OisCaptureRecord) < r->length )
+			return false;
+		e.record = r;
+		e.data = m_data + m_offset + sizeof(OisCaptureRecord);
+		e.offset = m_offset;
+		return true;
+	}
+	size_t Offset() const { return m_offset; }
+	void   Rewind()       { m_offset = sizeof(OisCaptureFileHeader); }
+private:
+	const uint8_t* m_data = nullptr;
+	size_t         m_size = 0;
+	size_t         m_offset = 0;
+	bool           m_valid = false;
+};
+
+#endif // OIS_CAPTURE_INCLUDED
@@ -0,0 +1,245 @@
+#ifndef OIS_DEFLATE_INCLUDED
+#define OIS_DEFLATE_INCLUDED
+//------------------------------------------------------------------------------
+// RFC 7692 "permessage-deflate" websocket compression, built on zlib.
+// OisWebHost uses this when OIS_WEBBY_DEFLATE is defined; you'll need to add zlib to your project to do so.
+//
+// OisDeflateParams::Negotiate picks an extension offer from the client's Sec-WebSocket-Extensions header.
+// OisWebsocketDeflate holds the compression and decompression contexts for one connection.
+// By default the contexts persist across messages ("context takeover"), which is what makes the very repetitive
+//  OIS text commands compress well: a value update can be encoded as a back-reference to an earlier message.
+//------------------------------------------------------------------------------
+
+#include <zlib.h>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#ifndef OIS_VECTOR
+# include <vector>
+# define OIS_VECTOR std::vector
+#endif
+
+//------------------------------------------------------------------------------
+// Incoming compressed messages that are, or inflate to, more than this are rejected, so that a client can't exhaust
+//  our memory.
+#ifndef OIS_DEFLATE_MAX_MESSAGE
+#define OIS_DEFLATE_MAX_MESSAGE (1024*1024)
+#endif
+
+struct OisDeflateParams
+{
+	int  serverMaxWindowBits = 15;
+	bool serverMaxWindowBitsRequested = false;
+	bool serverNoContextTakeover = false;
+	bool clientNoContextTakeover = false;
+
+	//Pick the first permessage-deflate offer from a Sec-WebSocket-Extensions header that we can support.
+	//On success, writes the value of the Sec-WebSocket-Extensions response header and returns true.
+	bool Negotiate(const char* header, char* response, size_t responseSize)
+	{
+		for( const char* offer = header; offer && *offer; )
+		{
+			const char* end = strchr(offer, ',');
+			if( !end )
+				end = offer + strlen(offer);
+			*this = OisDeflateParams();
+			if( ParseOffer(offer, end) )
+			{
+				int len = snprintf(response, responseSize, "permessage-deflate%s%s",
+					serverNoContextTakeover ? "; server_no_context_takeover" : "",
+					clientNoContextTakeover ? "; client_no_context_takeover" : "");
+				if( serverMaxWindowBitsRequested && len > 0 && (size_t)len < responseSize )
+					len += snprintf(response + len, responseSize - len, "; server_max_window_bits=%d", serverMaxWindowBits);
+				return len > 0 && (size_t)len < responseSize;
+			}
+			offer = *end ? end + 1 : end;
+		}
+		return false;
+	}
+private:
+	static const char* SkipSpace(const char* s, const char* end)
+	{
+		while( s != end && (*s == ' ' || *s == '\t') )
+			++s;
+		return s;
+	}
+	static bool Equals(const char* s, size_t len, const char* literal)
+	{
+		return len == strlen(literal) && 0 == strncmp(s, literal, len);
+	}
+	bool ParseOffer(const char* s, const char* end)
+	{
+		s = SkipSpace(s, end);
+		const char* name = s;
+		while( s != end && *s != ';' && *s != ' ' && *s != '\t' )
+			++s;
+		if( !Equals(name, s - name, "permessage-deflate") )
+			return false;
+		unsigned seen = 0;
+		for( s = SkipSpace(s, end); s != end && *s == ';'; s = SkipSpace(s, end) )
+		{
+			s = SkipSpace(s + 1, end);
+			const char* param = s;
+			while( s != end && *s != ';' && *s != '=' && *s != ' ' && *s != '\t' )
+				++s;
+			size_t paramLen = s - param;
+			int value = -1;
+			s = SkipSpace(s, end);
+			if( s != end && *s == '=' )
+			{
+				s = SkipSpace(s + 1, end);
+				bool quoted = s != end && *s == '"';
+				if( quoted )
+					++s;
+				value = 0;
+				const char* digits = s;
+				while( s != end && *s >= '0' && *s <= '9' && value < 100 )
+					value = value * 10 + (*s++ - '0');
+				if( s == digits || (quoted && (s == end || *s++ != '"')) )
+					return false;
+			}
+
+			unsigned bit;
+			if( Equals(param, paramLen, "server_no_context_takeover") && value < 0 )
+			{
+				bit = 1;
+				serverNoContextTakeover = true;
+			}
+			else if( Equals(param, paramLen, "client_no_context_takeover") && value < 0 )
+			{
+				bit = 2;
+				clientNoContextTakeover = true;
+			}
+			else if( Equals(param, paramLen, "server_max_window_bits") )
+			{
+				bit = 4;
+				//zlib can't produce raw deflate streams with a 256 byte window, so an offer that requires one is declined.
+				if( value < 9 || value > 15 )
+					return false;
+				serverMaxWindowBits = value;
+				serverMaxWindowBitsRequested = true;
+			}
+			else if( Equals(param, paramLen, "client_max_window_bits") )
+			{
+				bit = 8;//a hint that the client can limit its window. We always inflate with the largest window, so it's not needed.
+				if( value >= 0 && (value < 8 || value > 15) )
+					return false;
+			}
+			else
+				return false;
+			if( seen & bit )
+				return false;
+			seen |= bit;
+		}
+		return s == end;
+	}
+};
+
+class OisWebsocketDeflate
+{
+public:
+	OisWebsocketDeflate(const OisDeflateParams& params, int level = Z_DEFAULT_COMPRESSION)
+		: m_params(params)
+	{
+		memset(&m_deflate, 0, sizeof(m_deflate));
+		memset(&m_inflate, 0, sizeof(m_inflate));
+		m_deflateOk = Z_OK == deflateInit2(&m_deflate, level, Z_DEFLATED, -params.serverMaxWindowBits, 8, Z_DEFAULT_STRATEGY);
+		m_inflateOk = Z_OK == inflateInit2(&m_inflate, -15);
+	}
+	~OisWebsocketDeflate()
+	{
+		if( m_deflateOk )
+			deflateEnd(&m_deflate);
+		if( m_inflateOk )
+			inflateEnd(&m_inflate);
+	}
+	bool IsValid() const { return m_deflateOk && m_inflateOk; }
+
+	//Compress one outgoing message. `out` receives the payload to send with the RSV1 bit set.
+	bool Compress(const uint8_t* data, unsigned size, OIS_VECTOR<uint8_t>& out)
+	{
+		if( !m_deflateOk )
+			return false;
+		out.resize(size + size/8 + 64);
+		m_deflate.next_in = (Bytef*)data;
+		m_deflate.avail_in = size;
+		size_t length = 0;
+		for(;;)
+		{
+			m_deflate.next_out = &out.front() + length;
+			m_deflate.avail_out = (uInt)(out.size() - length);
+			int result = deflate(&m_deflate, Z_SYNC_FLUSH);
+			length = out.size() - m_deflate.avail_out;
+			if( result != Z_OK && result != Z_BUF_ERROR )
+				return false;
+			if( m_deflate.avail_out != 0 )
+				break;
+			out.resize(out.size() * 2);//the flush didn't fit; call deflate again to finish it
+		}
+		//The sync flush ends with an empty stored block, 00 00 ff ff, which the RFC says to drop.
+		if( length < 4 || 0 != memcmp(&out[length - 4], Tail(), 4) )
+			return false;
+		out.resize(length - 4);
+		if( m_params.serverNoContextTakeover )
+			deflateReset(&m_deflate);
+		return true;
+	}
+
+	//Decompress one incoming message that had the RSV1 bit set. The inflated bytes are appended to `out`.
+	bool Decompress(const uint8_t* data, unsigned size, OIS_VECTOR<uint8_t>& out)
+	{
+		if( !m_inflateOk )
+			return false;
+		if( !Inflate(data, size, out) || !Inflate(Tail(), 4, out) )
+			return false;
+		if( m_params.clientNoContextTakeover )
+			inflateReset(&m_inflate);
+		return true;
+	}
+private:
+	OisWebsocketDeflate(const OisWebsocketDeflate&);
+	OisWebsocketDeflate& operator=(const OisWebsocketDeflate&);
+
+	bool Inflate(const uint8_t* data, unsigned size, OIS_VECTOR<uint8_t>& out)
+	{
+		m_inflate.next_in = (Bytef*)data;
+		m_inflate.avail_in = size;
+		do
+		{
+			size_t used = out.size();
+			if( used > OIS_DEFLATE_MAX_MESSAGE )
+				return false;
+			//Grows `out` by at most one byte past the limit, which is enough to tell that the message is over it
+			size_t chunk = (size_t)size * 4 + 256;
+			if( chunk > OIS_DEFLATE_MAX_MESSAGE + 1 - used )
+				chunk = OIS_DEFLATE_MAX_MESSAGE + 1 - used;
+			out.resize(used + chunk);
+			m_inflate.next_out = &out.front() + used;
+			m_inflate.avail_out = (uInt)chunk;
+			int result = inflate(&m_inflate, Z_SYNC_FLUSH);
+			out.resize(out.size() - m_inflate.avail_out);
+			if( result == Z_STREAM_END )
+				inflateReset(&m_inflate);//the client finished its deflate stream with a final block, and will start a new one
+			else if( result != Z_OK && result != Z_BUF_ERROR )
+				return false;
+			else if( result == Z_BUF_ERROR && m_inflate.avail_out != 0 )
+				break;//no progress possible; the rest of the message is still to come
+		} while( m_inflate.avail_in != 0 || m_inflate.avail_out == 0 );
+		return true;
+	}
+
+	static const uint8_t* Tail()
+	{
+		static const uint8_t tail[4] = { 0x00, 0x00, 0xff, 0xff };
+		return tail;
+	}
+	OisDeflateParams m_params;
+	z_stream m_deflate;
+	z_stream m_inflate;
+	bool m_deflateOk;
+	bool m_inflateOk;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef OIS_LATENCY_INCLUDED
+#define OIS_LATENCY_INCLUDED
+//------------------------------------------------------------------------------
+// Latency histograms for the values and events received on one OIS connection. ois_protocol.h records into this when
+//  OIS_ENABLE_LATENCY is defined, and OisDevice::Latency / OisHost::Latency return it. Every time is measured from the
+//  ReadCommands call that completed the command, i.e. from when its last byte was read from the port:
+//  * Applied():        to the value / event being applied by ProcessBinary or ProcessAscii. This is the cost of
+//                      decoding it, and everything ahead of it in the same read.
+//  * ValuesConsumed(): to the application seeing the value, by calling OisDevice::DeviceOutputs (or
+//                      OisHost::DeviceInputs) after it was applied.
+//  * EventsConsumed(): to the event being returned by OisDevice::PopEvents.
+// Times are in nanoseconds. Recording one is a timestamp, a few integer operations and some increments; nothing is
+//  allocated. Up to OIS_LATENCY_PENDING values and events can be waiting to be consumed; any more are only counted by
+//  Dropped().
+//------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+//------------------------------------------------------------------------------
+// The number of received values, and of events, that are timed until the application consumes them. Each one is 8 bytes.
+#ifndef OIS_LATENCY_PENDING
+#define OIS_LATENCY_PENDING 256
+#endif
+
+//------------------------------------------------------------------------------
+// Log-linear buckets, like HdrHistogram: 16 per power of two, so values are kept to within 1/16th (6%), up to 2^36ns
+//  (about 69 seconds). Anything longer goes in the last bucket, but still counts towards Max and Mean.
+class OisLatencyHistogram
+{
+public:
+	enum
+	{
+		SubBucketBits = 4,
+		SubBuckets = 1 << SubBucketBits,
+		MaxBits = 36,
+		Buckets = (MaxBits - SubBucketBits + 1) * SubBuckets,
+	};
+	OisLatencyHistogram() { Clear(); }
+
+	void Record(uint64_t ns)
+	{
+		++m_counts[BucketOf(ns)];
+		++m_count;
+		m_sum += ns;
+		if( ns > m_max )
+			m_max = ns;
+		if( ns < m_min )
+			m_min = ns;
+	}
+	void Clear()
+	{
+		memset(m_counts, 0, sizeof(m_counts));
+		m_count = m_sum = m_max = 0;
+		m_min = ~(uint64_t)0;
+	}
+
+	uint64_t Count() const { return m_count; }
+	uint64_t Min()   const { return m_count ? m_min : 0; }
+	uint64_t Max()   const { return m_max; }
+	double   Mean()  const { return m_count ? (double)m_sum / (double)m_count : 0.0; }
+	//The time that `fraction` (0 to 1) of the recorded times are less than or equal to, rounded up to the top of its
+	// bucket (but no more than Max).
+	uint64_t Percentile(double fraction) const
+	{
+		if( !m_count )
+			return 0;
+		uint64_t rank = (uint64_t)(fraction * (double)m_count + 0.5);
+		rank = rank < 1 ? 1 : (rank > m_count ? m_count : rank);
+		uint64_t seen = 0;
+		for( unsigned i=0; i!=Buckets; ++i )
+		{
+			seen += m_counts[i];
+			if( seen >= rank )
+			{
+				uint64_t top = HighestInBucket(i);
+				return top < m_max ? top : m_max;
+			}
+		}
+		return m_max;
+	}
+	//For walking the buckets, e.g. to export them.
+	uint64_t BucketCount(unsigned i) const { return m_counts[i]; }
+	static uint64_t HighestInBucket(unsigned i)
+	{
+		if( i < 2*SubBuckets )//exact
+			return i;
+		unsigned shift = i / SubBuckets - 1;
+		uint64_t mantissa = i % SubBuckets + SubBuckets;
+		return ((mantissa + 1) << shift) - 1;
+	}
+	static unsigned BucketOf(uint64_t ns)
+	{
+		if( ns < SubBuckets )
+			return (unsigned)ns;
+		unsigned msb = HighestBit(ns);
+		if( msb >= MaxBits )
+			return Buckets - 1;
+		unsigned shift = msb - SubBucketBits;
+		return shift * SubBuckets + (unsigned)(ns >> shift);
+	}
+private:
+	static unsigned HighestBit(uint64_t v)
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long i;
+		_BitScanReverse64(&i, v);
+		return (unsigned)i;
+#elif defined(__GNUC__)
+		return 63 - (unsigned)__builtin_clzll(v);
+#else
+		unsigned i = 0;
+		while( v >>= 1 )
+			++i;
+		return i;
+#endif
+	}
+
+	uint64_t m_counts[Buckets];
+	uint64_t m_count;
+	uint64_t m_sum;
+	uint64_t m_min;
+	uint64_t m_max;
+};
+
+//------------------------------------------------------------------------------
+class OisLatency
+{
+public:
+	const OisLatencyHistogram& Applied()        const { return m_applied; }
+	const OisLatencyHistogram& ValuesConsumed() const { return m_valuesConsumed; }
+	const OisLatencyHistogram& EventsConsumed() const { return m_eventsConsumed; }
+	//Values and events that weren't timed until they were consumed, because too many were waiting.
+	uint64_t Dropped() const { return m_dropped; }
+	void Clear()
+	{
+		m_applied.Clear();
+		m_valuesConsumed.Clear();
+		m_eventsConsumed.Clear();
+		m_dropped = 0;
+	}
+
+	//Called by ois_protocol.h
+	void OnRead()           { m_readTime = OIS_TIME_NS(); }
+	void OnValueApplied()   { Apply(m_values); }
+	void OnEventApplied()   { Apply(m_events); }
+	void OnValuesConsumed() { Consume(m_values, m_valuesConsumed); }
+	void OnEventsConsumed() { Consume(m_events, m_eventsConsumed); }
+	void OnClearState()     { m_values.count = m_events.count = 0; }
+private:
+	struct Pending
+	{
+		uint64_t readTimes[OIS_LATENCY_PENDING];
+		unsigned count = 0;
+	};
+	void Apply(Pending& p)
+	{
+		m_applied.Record(OIS_TIME_NS() - m_readTime);
+		if( p.count == OIS_LATENCY_PENDING )
+			++m_dropped;
+		else
+			p.readTimes[p.count++] = m_readTime;
+	}
+	void Consume(Pending& p, OisLatencyHistogram& h)
+	{
+		if( !p.count )
+			return;
+		uint64_t now = OIS_TIME_NS();
+		for( unsigned i=0; i!=p.count; ++i )
+			h.Record(now - p.readTimes[i]);
+		p.count = 0;
+	}
+
+	uint64_t            m_readTime = 0;
+	Pending             m_values;
+	Pending             m_events;
+	uint64_t            m_dropped = 0;
+	OisLatencyHistogram m_applied;
+	OisLatencyHistogram m_valuesConsumed;
+	OisLatencyHistogram m_eventsConsumed;
+};
+
+#endif // OIS_LATENCY_INCLUDED
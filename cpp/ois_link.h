@@ -0,0 +1,116 @@
+#ifndef OIS_LINK_INCLUDED
+#define OIS_LINK_INCLUDED
+//------------------------------------------------------------------------------
+// An estimate of how busy the link under one OIS connection is, so that e.g. a 9600 baud serial port that can't keep
+//  up shows up as a number and a warning, instead of as lag. ois_protocol.h feeds this when OIS_ENABLE_LINK_MODEL is
+//  defined, and OisDevice::Link / OisHost::Link return it.
+// * The capacity comes from the port's baud rate (SerialPort::GetBaud, or IOisPort::Baud), at 10 bits per byte (8N1),
+//   unless SetBaud overrides it. Without one (e.g. websockets), the rates are still measured, but there's no
+//   utilization or queue.
+// * Every byte written goes into a modelled transmit queue, which drains at the capacity as Poll's deltaTime passes.
+//   queueSeconds is how long the last byte written takes to reach the other side.
+// * The link is saturated when that's longer than one frame (OIS_LINK_FRAME_SECONDS, or SetFrameSeconds), or when
+//   bytes arrive at close to the capacity, which means that the other side is probably queueing too. An OIS_WARN is
+//   logged each time a link becomes saturated.
+// The estimate is updated at the start of each Poll, from the traffic of the previous one. Only read it from the
+//  thread that polls the connection.
+//------------------------------------------------------------------------------
+
+#include <cstdint>
+
+//------------------------------------------------------------------------------
+// Define these to change the defaults.
+#ifndef OIS_LINK_FRAME_SECONDS
+const static float OIS_LINK_FRAME_SECONDS = 1.0f/60;//the most output that may be queued
+#endif
+#ifndef OIS_LINK_RATE_SECONDS
+const static float OIS_LINK_RATE_SECONDS = 1.0f;//the rates are averaged over about this long
+#endif
+#ifndef OIS_LINK_SATURATED_UTILIZATION
+const static float OIS_LINK_SATURATED_UTILIZATION = 0.9f;//of the capacity, for received bytes
+#endif
+
+//------------------------------------------------------------------------------
+struct OisLinkEstimate
+{
+	uint32_t baud;              //bits per second, or 0 if unknown
+	float    capacity;          //bytes per second in each direction, or 0 if unknown
+	float    bytesOutPerSecond;
+	float    bytesInPerSecond;
+	float    utilizationOut;    //bytesOutPerSecond / capacity; can go over 1 while the queue grows
+	float    utilizationIn;
+	uint32_t queuedBytes;       //written, but not on the other side yet
+	float    queueSeconds;
+	bool     saturated;
+	uint64_t saturations;       //the number of times that the link became saturated
+};
+
+//------------------------------------------------------------------------------
+class OisLinkModel
+{
+public:
+	//Overrides the port's baud rate, e.g. for a USB serial adapter that's faster than it claims. 0 uses the port's.
+	void     SetBaud(uint32_t baud)           { m_baud = baud; }
+	//0 uses OIS_LINK_FRAME_SECONDS.
+	void     SetFrameSeconds(float seconds)   { m_frameSeconds = seconds; }
+	float    FrameSeconds() const             { return m_frameSeconds > 0 ? m_frameSeconds : OIS_LINK_FRAME_SECONDS; }
+	const OisLinkEstimate& Estimate() const   { return m_estimate; }
+
+	//Used by ois_protocol.h:
+	void OnWrite(unsigned bytes) { m_written += bytes; }
+	void OnRead(unsigned bytes)  { m_read += bytes; }
+	//Returns true if the link has just become saturated.
+	bool OnPoll(float deltaTime, uint32_t portBaud)
+	{
+		OisLinkEstimate& e = m_estimate;
+		e.baud = m_baud ? m_baud : portBaud;
+		e.capacity = e.baud / 10.0f;
+		float queued = m_queued + m_written;//as of the end of the last Poll
+		if( deltaTime > 0 )
+		{
+			float smoothing = deltaTime / (OIS_LINK_RATE_SECONDS + deltaTime);
+			e.bytesOutPerSecond += (m_written / deltaTime - e.bytesOutPerSecond) * smoothing;
+			e.bytesInPerSecond  += (m_read    / deltaTime - e.bytesInPerSecond)  * smoothing;
+			m_written = m_read = 0;
+		}
+		if( !e.capacity )
+		{
+			m_queued = 0;
+			e.utilizationOut = e.utilizationIn = 0;
+			e.queuedBytes = 0;
+			e.queueSeconds = 0;
+			e.saturated = false;
+			return false;
+		}
+		e.utilizationOut = e.bytesOutPerSecond / e.capacity;
+		e.utilizationIn  = e.bytesInPerSecond  / e.capacity;
+		e.queuedBytes = (uint32_t)(queued + 0.5f);
+		e.queueSeconds = queued / e.capacity;
+		if( deltaTime > 0 )
+		{
+			m_queued = queued - e.capacity * deltaTime;
+			if( m_queued < 0 )
+				m_queued = 0;
+		}
+		//Becomes saturated at the limits, and stays that way until comfortably below them, so as not to flicker
+		float frame = FrameSeconds();
+		if( e.saturated )
+			e.saturated = e.queueSeconds > frame * 0.5f || e.utilizationIn > OIS_LINK_SATURATED_UTILIZATION * 0.9f;
+		else if( e.queueSeconds > frame || e.utilizationIn > OIS_LINK_SATURATED_UTILIZATION )
+		{
+			e.saturated = true;
+			e.saturations++;
+			return true;
+		}
+		return false;
+	}
+private:
+	uint32_t        m_baud = 0;
+	float           m_frameSeconds = 0;
+	float           m_queued = 0;//as of the start of the last Poll, after draining
+	uint32_t        m_written = 0;//since the start of the last Poll
+	uint32_t        m_read = 0;
+	OisLinkEstimate m_estimate = OisLinkEstimate();
+};
+
+#endif // OIS_LINK_INCLUDED
@@ -98,6 +98,13 @@
  *           c->m_device.Poll(sb);
  *           c->m_device.PopEvents([](const OisState::Event& e){ printf(e.name.c_str()); });
  *         }
+ *  3.5) Optionally, call `StartThread` on your OisWebHost object to run the web server on its own thread.
+ *       `Poll` then only picks up new / closed connections, so slow HTTP requests can't stall your thread.
+ *       The OisDevice objects are still polled by your thread as above.
+ *  3.6) Optionally, define OIS_WEBBY_DEFLATE and add zlib to your project, to compress websocket traffic for browsers
+ *        that support permessage-deflate (see ois_deflate.h).
+ *  3.7) Optionally, define OIS_ENABLE_STATS to serve per-connection counters at /metrics, for Prometheus.
+ *       Call `AddMetrics` to include devices that aren't websockets, e.g. those on serial ports.
  *
  *
  * 4) To connect to an OIS host (e.g. game) via Serial:
@@ -120,6 +127,16 @@
  *       (N.B. NumericOutputs are for values that are sent from Device -> Host)
  *  4.9) To send named events from the host, inspect the `DeviceEvents` list to see the registered events.
  *       Call `Activate` to trigger a named event on the host.
+ *
+ *
+ * 5) To debug a connection offline, define OIS_ENABLE_CAPTURE, and call `SetCapture` on an OisDevice / OisHost to
+ *     record its traffic (see ois_capture.h). Replay the file into a new object with OisReplayPort (see ois_replay.h).
+ *
+ * 6) To cap the time that a connection can take from your frame, define OIS_ENABLE_POLL_BUDGET, and call e.g.
+ *     `device.PollBudget().SetLimits(0, 200000)` for at most 200us of reading and parsing per Poll (see ois_budget.h).
+ *
+ * 7) To see how close a slow serial link is to its capacity, define OIS_ENABLE_LINK_MODEL, and read `Link().Estimate()`
+ *     on an OisDevice / OisHost for its bytes per second, utilization and projected queueing delay (see ois_link.h).
  *  
  */
 
@@ -139,6 +156,13 @@ const static unsigned OIS_MAX_NAME_LENGTH = 120;
 const static unsigned OIS_MAX_COMMAND_LENGTH = 4   +9       +9       +OIS_MAX_NAME_LENGTH +1;
 #endif
 
+//------------------------------------------------------------------------------
+// When a connection becomes active, its queues reserve room for one change to every value, and this many activations
+// of every event, so that steady-state polling doesn't allocate. Define OIS_EVENT_QUEUE_RESERVE to change it.
+#ifndef OIS_EVENT_QUEUE_RESERVE
+const static unsigned OIS_EVENT_QUEUE_RESERVE = 4;
+#endif
+
 //------------------------------------------------------------------------------
 // If you have your own logging mechanism, define OIS_INFO to pipe informational messages to your log.
 #ifndef OIS_INFO
@@ -150,12 +174,80 @@ const static unsigned OIS_MAX_COMMAND_LENGTH = 4   +9       +9       +OIS_MAX_NA
 #ifndef OIS_WARN
 # ifdef _DEBUG
 #  include <cstdio>
-#  define OIS_WARN( fmt, ... ) printf( fmt, __VA_ARGS__ )
+#  define OIS_WARN( fmt, ... ) printf( fmt, ##__VA_ARGS__ )
 # else
 #  define OIS_WARN( fmt, ... ) do{}while(0)
 # endif
 #endif
 
+//------------------------------------------------------------------------------
+// Define OIS_LOG_LEVEL to compile out messages below a level, whatever OIS_INFO / OIS_WARN are defined as:
+//  0 = no logging, 1 = warnings only, 2 = warnings and informational messages (the default).
+#ifndef OIS_LOG_LEVEL
+# define OIS_LOG_LEVEL 2
+#endif
+#if OIS_LOG_LEVEL < 2
+# undef  OIS_INFO
+# define OIS_INFO( fmt, ... ) do{}while(0)
+#endif
+#if OIS_LOG_LEVEL < 1
+# undef  OIS_WARN
+# define OIS_WARN( fmt, ... ) do{}while(0)
+#endif
+
+//------------------------------------------------------------------------------
+// Define OIS_TIME_NS to use your own clock for the optional features below. It should return a uint64_t in
+//  nanoseconds, from any fixed start.
+#ifndef OIS_TIME_NS
+# include <chrono>
+# define OIS_TIME_NS() (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()
+#endif
+
+//------------------------------------------------------------------------------
+// Define OIS_ENABLE_TRACE to record every value update and event into a binary ring per connection (see ois_trace.h),
+//  instead of formatting an OIS_INFO message for each one. Other messages still go to OIS_INFO.
+#ifdef OIS_ENABLE_TRACE
+# include "ois_trace.h"
+#endif
+
+//------------------------------------------------------------------------------
+// Define OIS_ENABLE_LATENCY to measure how long each received value and event takes to be decoded, and then to be
+//  consumed by the application, into histograms per connection (see ois_latency.h).
+#ifdef OIS_ENABLE_LATENCY
+# include "ois_latency.h"
+#endif
+
+//------------------------------------------------------------------------------
+// Define OIS_ENABLE_STATS to count the bytes and commands in / out, errors and resyncs on each connection (see
+//  ois_stats.h). OisWebHost serves these at /metrics.
+#ifdef OIS_ENABLE_STATS
+# include "ois_stats.h"
+# define OIS_STATS( expr ) m_stats.expr
+#else
+# define OIS_STATS( expr ) do{}while(0)
+#endif
+
+//------------------------------------------------------------------------------
+// Define OIS_ENABLE_CAPTURE to be able to record everything a connection reads and writes into a file (see
+//  ois_capture.h), which can be replayed later with OisReplayPort (see ois_replay.h).
+#ifdef OIS_ENABLE_CAPTURE
+# include "ois_capture.h"
+#endif
+
+//------------------------------------------------------------------------------
+// Define OIS_ENABLE_POLL_BUDGET to be able to cap the bytes and time that each Poll spends on received traffic, and
+//  to time the reading, parsing and sending done by each Poll (see ois_budget.h).
+#ifdef OIS_ENABLE_POLL_BUDGET
+# include "ois_budget.h"
+#endif
+
+//------------------------------------------------------------------------------
+// Define OIS_ENABLE_LINK_MODEL to estimate each connection's link utilization and queueing delay from the port's baud
+//  rate, and to warn when a link is saturated (see ois_link.h).
+#ifdef OIS_ENABLE_LINK_MODEL
+# include "ois_link.h"
+#endif
+
 //------------------------------------------------------------------------------
 // Define OIS_ENABLE_ERROR_LOGGING as 1 to get fully verbose error reporting.
 #ifndef OIS_ENABLE_ERROR_LOGGING
@@ -189,6 +281,13 @@ const static unsigned OIS_MAX_COMMAND_LENGTH = 4   +9       +9       +OIS_MAX_NA
 # include <cstdint>
 #endif 
 
+//------------------------------------------------------------------------------
+// The C library functions used by the implementation (strlen, memmove, roundf, ptrdiff_t, ...).
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
 //------------------------------------------------------------------------------
 // If you want use use your own dynamic array class, define OIS_VECTOR to your own class.
 #ifndef OIS_VECTOR
@@ -229,6 +328,7 @@ const static unsigned OIS_MAX_COMMAND_LENGTH = 4   +9       +9       +OIS_MAX_NA
 //------------------------------------------------------------------------------
 #ifndef OIS_STRING_BUILDER
 # include <stdarg.h>
+# include <cstdio>
 struct OIS_STRING_BUILDER
 {
 	const char* FormatTemp(const char* fmt, ...)//Format a string using the "temp" lifetime.
@@ -247,9 +347,16 @@ struct OIS_STRING_BUILDER
 		va_end( v );
 		return s;
 	}
-	const char* FormatV(OIS_STRING& result, const char* fmt, const va_list& v)//Format a string using a user-controlled lifetime.
-	{
-		int length = _vscprintf( fmt, v ) + 1;
+	const char* FormatV(OIS_STRING& result, const char* fmt, va_list v)//Format a string using a user-controlled lifetime.
+	{
+		va_list measure;
+		va_copy(measure, v);//v can only be used once
+#ifdef _MSC_VER
+		int length = _vscprintf( fmt, measure ) + 1;
+#else
+		int length = vsnprintf( nullptr, 0, fmt, measure ) + 1;
+#endif
+		va_end(measure);
 		result.resize(length);
 		char* buffer = &result[0];
 		vsnprintf(buffer, length, fmt, v);
@@ -311,6 +418,7 @@ public:
 	virtual int  Read(char* buffer, int size) = 0;
 	virtual int  Write(const char* buffer, int size) = 0;
 	virtual const char* Name() { return ""; }
+	virtual int  Baud() { return 0; }//bits per second, or 0 if unknown / not a serial line
 };
 
 # ifdef OIS_SERIALPORT_INCLUDED
@@ -326,12 +434,24 @@ public:
 	int Read(char* buffer, int size)         { return m_port.Read(buffer, size); }
 	int Write(const char* buffer, int size)  { return m_port.Write(buffer, size); }
 	virtual const char* Name()               { return m_port.PortName().c_str(); }
+	int Baud()                               { return m_port.GetBaud(); }
+	SerialPort& Port()                       { return m_port; }
 private:
 	SerialPort m_port;
 };
 # endif
 #endif
 
+#ifdef OIS_ENABLE_LINK_MODEL
+template<class P> int OisPortBaud(P&)  { return 0; }//a custom OIS_PORT
+# ifdef OIS_ENABLE_VIRTUAL_PORT
+inline int OisPortBaud(IOisPort& port) { return port.Baud(); }
+# endif
+# ifdef OIS_SERIALPORT_INCLUDED
+inline int OisPortBaud(SerialPort& port) { return port.GetBaud(); }
+# endif
+#endif
+
 
 //------------------------------------------------------------------------------
 // Generic utilities: Length of fixed C arrays
@@ -376,6 +496,7 @@ public:
 		bool        active;
 		NumericType type;
 		Value       value;
+		bool        queued;//has an entry in the send queue, so further changes before the next Poll don't add another
 	};
 	struct Event
 	{
@@ -489,6 +610,8 @@ protected:
 	void SendData(const uint8_t* cmd, int length);
 	void SendText(const char* cmd, bool includeNullTerminator=false);
 	void SendValue(const NumericValue& v, OIS_STRING_BUILDER& sb, unsigned PAYLOAD_SHIFT, unsigned VAL_1, unsigned VAL_2, unsigned VAL_3, unsigned VAL_4);
+	void LogValue(bool received, const NumericValue& v);
+	void LogEvent(bool received, uint16_t channel, const Event* e);
 	void ConnectAndPoll(OIS_STRING_BUILDER& sb, float deltaTime);
 	bool ExpectState(DeviceStateMask state, const char* cmd, unsigned version);
 	bool CheckState(DeviceStateMask state, const char* cmd, unsigned version);
@@ -510,9 +633,29 @@ protected:
 	float                    m_idleTimer = 0;
 	unsigned                 m_reconnectAttempts = 0;
 	DeviceState              m_connectionState = Handshaking;
+	unsigned                 m_registrationVersion = 0;
 	unsigned                 m_commandLength = 0;
 	char                     m_commandBuffer[OIS_MAX_COMMAND_LENGTH * 2];
 	bool                     m_binary = false;
+#ifdef OIS_ENABLE_TRACE
+	OisTrace                 m_trace;
+	bool WriteTrace(FILE*, OisTraceFileHeader::Side) const;
+#endif
+#ifdef OIS_ENABLE_LATENCY
+	mutable OisLatency       m_latency;//mutable, as reading the received values counts as consuming them
+#endif
+#ifdef OIS_ENABLE_STATS
+	OisStats                 m_stats;
+#endif
+#ifdef OIS_ENABLE_CAPTURE
+	OisCapture*              m_capture = nullptr;
+#endif
+#ifdef OIS_ENABLE_POLL_BUDGET
+	OisPollBudget            m_pollBudget;
+#endif
+#ifdef OIS_ENABLE_LINK_MODEL
+	OisLinkModel             m_link;
+#endif
 
 	OisBase(OIS_PORT& port, const OIS_STRING& name, unsigned gameVersion, const char* gameName)
 		: m_port(port), m_deviceName(name), m_gameVersion(gameVersion), m_gameName(gameName) {}
@@ -536,23 +679,55 @@ public:
 	bool        Connecting()    const { return m_connectionState != Handshaking; }
 	bool        Connected()     const { return m_connectionState == Active; }
 	float       IdleTimer()     const { return m_idleTimer; }
+	//Changes whenever channels are registered / cleared or the device becomes active, so that anything derived from
+	// the DeviceInputs / DeviceOutputs / DeviceEvents lists knows to rebuild.
+	unsigned    RegistrationVersion() const { return m_registrationVersion; }
 	
 	const OIS_VECTOR<NumericValue>& DeviceInputs()  const { return m_numericInputs; }
+#ifdef OIS_ENABLE_LATENCY
+	const OIS_VECTOR<NumericValue>& DeviceOutputs() const { m_latency.OnValuesConsumed(); return m_numericOutputs; }
+#else
 	const OIS_VECTOR<NumericValue>& DeviceOutputs() const { return m_numericOutputs; }
+#endif
 	const OIS_VECTOR<Event>&        DeviceEvents()  const { return m_events; }
 
 	void Poll(OIS_STRING_BUILDER&, float deltaTime);
 
 	template<class T>
-	bool PopEvents(T& fn);//calls fn(const Event&)
+	bool PopEvents(T&& fn);//calls fn(const Event&)
 	bool SetInput(const NumericValue& input, bool value);
 	bool SetInput(const NumericValue& input, int value);
 	bool SetInput(const NumericValue& input, float value);
 	bool SetInput(const NumericValue& input, Value value);
 	bool SetInput(uint16_t inputChannel, Value value);
+#ifdef OIS_ENABLE_TRACE
+	const OisTrace& Trace() const  { return m_trace; }
+	bool WriteTrace(FILE* f) const { return OisBase::WriteTrace(f, OisTraceFileHeader::Host); }
+#endif
+#ifdef OIS_ENABLE_LATENCY
+	const OisLatency& Latency() const { return m_latency; }
+	void ClearLatency()               { m_latency.Clear(); }
+#endif
+#ifdef OIS_ENABLE_STATS
+	const OisStats& Stats() const     { return m_stats; }//may be read from any thread
+	void ClearStats()                 { m_stats.Clear(); }
+#endif
+#ifdef OIS_ENABLE_CAPTURE
+	//Records all traffic into `capture` (opened with OisCaptureFileHeader::Host) until this is called with null.
+	void SetCapture(OisCapture* capture) { OIS_ASSERT(!capture || capture->Side() == OisCaptureFileHeader::Host); m_capture = capture; }
+#endif
+#ifdef OIS_ENABLE_POLL_BUDGET
+	OisPollBudget&       PollBudget()       { return m_pollBudget; }
+	const OisPollBudget& PollBudget() const { return m_pollBudget; }
+#endif
+#ifdef OIS_ENABLE_LINK_MODEL
+	OisLinkModel&       Link()       { return m_link; }
+	const OisLinkModel& Link() const { return m_link; }
+#endif
 private:
 	friend class OisBase<OisDevice>;
 	void ClearState();
+	void ReserveQueues();
 	bool ProcessAscii(char* cmd, OIS_STRING_BUILDER&);
 	int  ProcessBinary(char* start, char* end);
 
@@ -578,8 +753,13 @@ public:
 	bool              Connected()          const { return m_connectionState == Active; }
 	unsigned          GetProtocolVersion() const { return m_protocolVersion; }
 	float             IdleTimer()          const { return m_idleTimer; }
+	unsigned          RegistrationVersion() const { return m_registrationVersion; }//see OisDevice::RegistrationVersion
 
+#ifdef OIS_ENABLE_LATENCY
+	const OIS_VECTOR<NumericValue>& DeviceInputs()  const { m_latency.OnValuesConsumed(); return m_numericInputs; }
+#else
 	const OIS_VECTOR<NumericValue>& DeviceInputs()  const { return m_numericInputs; }
+#endif
 	const OIS_VECTOR<NumericValue>& DeviceOutputs() const { return m_numericOutputs; }
 	const OIS_VECTOR<Event>&        DeviceEvents()  const { return m_events; }
 
@@ -599,6 +779,30 @@ public:
 	bool SetOutput(uint16_t outputChannel, Value value);
 	bool ToggleInput(const NumericValue& input, bool active);
 	bool ToggleInput(uint16_t inputChannel, bool active);
+#ifdef OIS_ENABLE_TRACE
+	const OisTrace& Trace() const  { return m_trace; }
+	bool WriteTrace(FILE* f) const { return OisBase::WriteTrace(f, OisTraceFileHeader::Device); }
+#endif
+#ifdef OIS_ENABLE_LATENCY
+	const OisLatency& Latency() const { return m_latency; }
+	void ClearLatency()               { m_latency.Clear(); }
+#endif
+#ifdef OIS_ENABLE_STATS
+	const OisStats& Stats() const     { return m_stats; }//may be read from any thread
+	void ClearStats()                 { m_stats.Clear(); }
+#endif
+#ifdef OIS_ENABLE_CAPTURE
+	//Records all traffic into `capture` (opened with OisCaptureFileHeader::Device) until this is called with null.
+	void SetCapture(OisCapture* capture) { OIS_ASSERT(!capture || capture->Side() == OisCaptureFileHeader::Device); m_capture = capture; }
+#endif
+#ifdef OIS_ENABLE_POLL_BUDGET
+	OisPollBudget&       PollBudget()       { return m_pollBudget; }
+	const OisPollBudget& PollBudget() const { return m_pollBudget; }
+#endif
+#ifdef OIS_ENABLE_LINK_MODEL
+	OisLinkModel&       Link()       { return m_link; }
+	const OisLinkModel& Link() const { return m_link; }
+#endif
 private:
 	friend class OisBase<OisHost>;
 	
@@ -628,6 +832,7 @@ private:
 	OIS_VECTOR<uint16_t>     m_channelFreeList;
 	
 	void ClearState();
+	void ReserveQueues();
 	bool ProcessAscii(char* cmd, OIS_STRING_BUILDER&);
 	int  ProcessBinary(char* start, char* end);
 	
@@ -657,7 +862,7 @@ template<class T> typename T::value_type* OisState::FindChannel(T& values, Chann
 {
 	if (i.index < values.size())
 	{
-		T::value_type& v = values[i.index];
+		typename T::value_type& v = values[i.index];
 		if (v.channel == i.channel)
 			return &v;
 	}
@@ -669,6 +874,14 @@ template<class T> typename T::value_type* OisState::FindChannel(T& values, Chann
 template<class T>
 void OisBase<T>::SendData(const uint8_t* cmd, int length)
 {
+	OIS_STATS( bytes[OisStats::Out].Add(length) );
+#ifdef OIS_ENABLE_CAPTURE
+	if( m_capture )
+		m_capture->OnWrite((const char*)cmd, length);
+#endif
+#ifdef OIS_ENABLE_LINK_MODEL
+	m_link.OnWrite(length);
+#endif
 	if( 0 >= m_port.Write((char*)cmd, length) )
 	{
 		m_port.Disconnect();
@@ -678,7 +891,16 @@ void OisBase<T>::SendData(const uint8_t* cmd, int length)
 template<class T>
 void OisBase<T>::SendText(const char* cmd, bool includeNullTerminator)
 {
-	if( 0 >= m_port.Write(cmd, (int)strlen(cmd) + (includeNullTerminator ? 1 : 0)) )
+	int length = (int)strlen(cmd) + (includeNullTerminator ? 1 : 0);
+	OIS_STATS( bytes[OisStats::Out].Add(length) );
+#ifdef OIS_ENABLE_CAPTURE
+	if( m_capture )
+		m_capture->OnWrite(cmd, length);
+#endif
+#ifdef OIS_ENABLE_LINK_MODEL
+	m_link.OnWrite(length);
+#endif
+	if( 0 >= m_port.Write(cmd, length) )
 	{
 		m_port.Disconnect();
 	}
@@ -687,6 +909,7 @@ void OisBase<T>::SendText(const char* cmd, bool includeNullTerminator)
 template<class T>
 void OisBase<T>::SendValue(const NumericValue& v, OIS_STRING_BUILDER& sb, unsigned PAYLOAD_SHIFT, unsigned VAL_1, unsigned VAL_2, unsigned VAL_3, unsigned VAL_4)
 {
+	OIS_STATS( Sent(OisStats::Value) );
 	if (m_binary)
 	{
 		uint8_t cmd[5];
@@ -700,14 +923,90 @@ void OisBase<T>::SendValue(const NumericValue& v, OIS_STRING_BUILDER& sb, unsign
 	}
 }
 
+template<class T>
+void OisBase<T>::LogValue(bool received, const NumericValue& v)
+{
+#ifdef OIS_ENABLE_LATENCY
+	if( received )
+		m_latency.OnValueApplied();
+#endif
+#ifdef OIS_ENABLE_TRACE
+	m_trace.Record(received ? OisTraceRecord::ValueIn : OisTraceRecord::ValueOut, v.channel, (uint8_t)v.type, ToRawValue(v.type, v.value));
+#elif OIS_LOG_LEVEL >= 2
+	switch (v.type)
+	{
+	case Boolean:  OIS_INFO("%s %d(%s) = %s",   received ? "<-" : "->", v.channel, v.name.c_str(), v.value.boolean ? "true" : "false"); break;
+	case Number:   OIS_INFO("%s %d(%s) = %d",   received ? "<-" : "->", v.channel, v.name.c_str(), v.value.number);                     break;
+	case Fraction: OIS_INFO("%s %d(%s) = %.2f", received ? "<-" : "->", v.channel, v.name.c_str(), v.value.fraction);                   break;
+	}
+#endif
+}
+
+template<class T>
+void OisBase<T>::LogEvent(bool received, uint16_t channel, const Event* e)
+{
+#ifdef OIS_ENABLE_LATENCY
+	if( received && e )//unknown events aren't buffered for PopEvents
+		m_latency.OnEventApplied();
+#endif
+	if( received && !e )
+		OIS_STATS( unknownChannels.Add() );
+#ifdef OIS_ENABLE_TRACE
+	m_trace.Record(received ? OisTraceRecord::EventIn : OisTraceRecord::EventOut, channel);
+#elif OIS_LOG_LEVEL >= 2
+	OIS_INFO("%s EXC: %d (%s)", received ? "<-" : "->", channel, e ? e->name.c_str() : "INVALID CHANNEL");
+#endif
+}
+
+#ifdef OIS_ENABLE_TRACE
+template<class T>
+bool OisBase<T>::WriteTrace(FILE* f, OisTraceFileHeader::Side side) const
+{
+	uint32_t names = (uint32_t)(m_numericInputs.size() + m_numericOutputs.size() + m_events.size());
+	if( !m_trace.WriteHeader(f, side, names) )
+		return false;
+	for( const NumericValue& v : m_numericInputs )
+		if( !OisTrace::WriteName(f, OisTraceFileName::Input, v.channel, (uint8_t)v.type, v.name.c_str()) )
+			return false;
+	for( const NumericValue& v : m_numericOutputs )
+		if( !OisTrace::WriteName(f, OisTraceFileName::Output, v.channel, (uint8_t)v.type, v.name.c_str()) )
+			return false;
+	for( const Event& e : m_events )
+		if( !OisTrace::WriteName(f, OisTraceFileName::Event, e.channel, 0, e.name.c_str()) )
+			return false;
+	return m_trace.WriteRecords(f);
+}
+#endif
+
 template<class T>
 bool OisBase<T>::ReadCommands()
 {
-	int len = m_port.Read(m_commandBuffer + m_commandLength, OIS_ARRAYSIZE(m_commandBuffer) - m_commandLength);
+	unsigned space = OIS_ARRAYSIZE(m_commandBuffer) - m_commandLength;
+#ifdef OIS_ENABLE_POLL_BUDGET
+	space = m_pollBudget.ReadLimit(space);
+	if (!space)
+		return false;//the rest is read by the next Poll
+#endif
+	int len = m_port.Read(m_commandBuffer + m_commandLength, space);
+#ifdef OIS_ENABLE_POLL_BUDGET
+	m_pollBudget.OnRead(len > 0 ? len : 0);
+#endif
 	if (!len)
 		return false;
 	m_commandLength += len;
 	OIS_ASSERT(m_commandLength <= OIS_ARRAYSIZE(m_commandBuffer));
+	OIS_STATS( bytes[OisStats::In].Add(len) );
+	OIS_STATS( HighWater(OisStats::CommandBuffer, m_commandLength) );
+#ifdef OIS_ENABLE_CAPTURE
+	if( m_capture )
+		m_capture->OnRead(m_commandBuffer + m_commandLength - len, len);
+#endif
+#ifdef OIS_ENABLE_LINK_MODEL
+	m_link.OnRead(len);
+#endif
+#ifdef OIS_ENABLE_LATENCY
+	m_latency.OnRead();
+#endif
 	return true;
 }
 
@@ -725,6 +1024,7 @@ void OisBase<T>::ProcessCommands(OIS_STRING_BUILDER& sb)
 				break;
 			if (commandLength < 0)//not a binary command!
 			{
+				OIS_STATS( handshakeRestarts.Add() );
 				_ClearState();
 				return;
 			}
@@ -747,6 +1047,8 @@ void OisBase<T>::ProcessCommands(OIS_STRING_BUILDER& sb)
 	if (start == m_commandBuffer && end == m_commandBuffer + OIS_ARRAYSIZE(m_commandBuffer))
 	{
 		OIS_WARN("OisDevice command buffer is full without a valid command present! Ending...");
+		OIS_STATS( parseErrors.Add() );
+		OIS_STATS( Sent(OisStats::End) );
 		OIS_INFO("-> END");
 		SendText("END\n");
 		_ClearState();
@@ -762,6 +1064,19 @@ void OisBase<T>::ProcessCommands(OIS_STRING_BUILDER& sb)
 template<class T>
 void OisBase<T>::ConnectAndPoll(OIS_STRING_BUILDER& sb, float deltaTime)
 {
+	OIS_STATS( connectionState.Set(m_connectionState) );
+#ifdef OIS_ENABLE_CAPTURE
+	if( m_capture )
+		m_capture->OnPoll(deltaTime, m_port.IsConnected());
+#endif
+#ifdef OIS_ENABLE_LINK_MODEL
+	if( m_link.OnPoll(deltaTime, (uint32_t)OisPortBaud(m_port)) )
+	{
+		OIS_WARN( "%s: the link is saturated at %u baud (%.0f%% out, %.0f%% in, %.0f ms of output queued)",
+		          m_deviceName.c_str(), m_link.Estimate().baud, m_link.Estimate().utilizationOut * 100,
+		          m_link.Estimate().utilizationIn * 100, m_link.Estimate().queueSeconds * 1000 );
+	}
+#endif
 	if( m_connectionState == Handshaking )
 		m_idleTimer += deltaTime;
 	if (!m_port.IsConnected())
@@ -780,6 +1095,10 @@ void OisBase<T>::ConnectAndPoll(OIS_STRING_BUILDER& sb, float deltaTime)
 		if (!ReadCommands())
 			break;
 		ProcessCommands(sb);
+#ifdef OIS_ENABLE_POLL_BUDGET
+		if (!m_pollBudget.OnParsed())
+			break;//out of time; the rest is read by the next Poll
+#endif
 	}
 
 	if( m_delayedSend452 )
@@ -791,6 +1110,7 @@ void OisBase<T>::ConnectAndPoll(OIS_STRING_BUILDER& sb, float deltaTime)
 			if( m_connectionState == Synchronisation )
 			{
 				SendText("452\r\n");
+				OIS_STATS( Sent(OisStats::Handshake) );
 				OIS_INFO( "-> 452" );
 			}
 		}
@@ -812,11 +1132,15 @@ bool OisBase<T>::ExpectState(DeviceStateMask state, const char* cmd, unsigned ve
 	if (badState)
 	{
 		OIS_WARN("Did not expect command at this time: %s", cmd);
+		OIS_STATS( parseErrors.Add() );
 		if (m_connectionState != Handshaking)
 		{
 			_ClearState();
 			if (m_protocolVersion >= 2)
+			{
+				OIS_STATS( Sent(OisStats::End) );
 				SendText("END\n");
+			}
 		}
 		return false;
 	}
@@ -826,10 +1150,13 @@ bool OisBase<T>::ExpectState(DeviceStateMask state, const char* cmd, unsigned ve
 //------------------------------------------------------------------------------
 
 template<class T>
-bool OisDevice::PopEvents(T& fn)
+bool OisDevice::PopEvents(T&& fn)
 {
 	if (m_eventBuffer.empty())
 		return false;
+#ifdef OIS_ENABLE_LATENCY
+	m_latency.OnEventsConsumed();
+#endif
 	for (ChannelIndex channel : m_eventBuffer)
 	{
 		const Event* e = FindChannel(m_events, channel);
@@ -943,7 +1270,11 @@ bool OisState::SetValueAndEnqueue(const NumericValue& variable, Value value, OIS
 	if (values[index].value.number != value.number)
 	{
 		values[index].value = value;
-		queue.push_back({ variable.channel, (uint16_t)index });
+		if (!values[index].queued)
+		{
+			values[index].queued = true;
+			queue.push_back({ variable.channel, (uint16_t)index });
+		}
 	}
 	return true;
 }
@@ -952,18 +1283,22 @@ bool OisState::SetValueAndEnqueue(const NumericValue& variable, Value value, OIS
 
 void OisDevice::Poll(OIS_STRING_BUILDER& sb, float deltaTime)
 {
+#ifdef OIS_ENABLE_STATS
+	OisStats::PollTimer timer(m_stats);
+#endif
+#ifdef OIS_ENABLE_POLL_BUDGET
+	OisPollBudget::Scope budget(m_pollBudget);
+#endif
 	ConnectAndPoll(sb, deltaTime);
+	OIS_STATS( HighWater(OisStats::SendQueue, m_queuedInputs.size()) );
+	OIS_STATS( HighWater(OisStats::EventQueue, m_eventBuffer.size()) );
 	for (ChannelIndex index : m_queuedInputs)
 	{
-		const NumericValue* v = FindChannel(m_numericInputs, index);
+		NumericValue* v = FindChannel(m_numericInputs, index);
 		if (!v)
 			continue;
-		switch (v->type)
-		{
-		case Boolean:  OIS_INFO("-> %d(%s) = %s",   v->channel, v->name.c_str(), v->value.boolean ? "true" : "false"); break;
-		case Number:   OIS_INFO("-> %d(%s) = %d",   v->channel, v->name.c_str(), v->value.number);                     break;
-		case Fraction: OIS_INFO("-> %d(%s) = %.2f", v->channel, v->name.c_str(), v->value.fraction);                   break;
-		}
+		v->queued = false;
+		LogValue(false, *v);
 		SendValue(*v, sb, SV_PAYLOAD_SHIFT, SV_VAL_1, SV_VAL_2, SV_VAL_3, SV_VAL_4);
 	}
 	m_queuedInputs.clear();
@@ -978,7 +1313,7 @@ int OisDevice::ProcessBinary(char* start, char* end)
 	
 	const char* startString = 0;
 	char strTerminator = '\0';
-	uint32_t payload = (*start);
+	uint32_t payload = (uint8_t)(*start);//char may be signed
 	int command = payload & CL_COMMAND_MASK;
 	int cmdLength = 1;
 	if (payload == CL_SYN_ || payload == CL_451_)//has the device reset and is sending us ASCII commands?
@@ -992,6 +1327,7 @@ int OisDevice::ProcessBinary(char* start, char* end)
 		default:
 		case CL_NUL:
 			OIS_WARN( "Unknown command: 0x%x", payload);
+			OIS_STATS( parseErrors.Add() );
 			break;
 		case CL_ACT:
 		case CL_EXC_0:
@@ -1047,6 +1383,7 @@ int OisDevice::ProcessBinary(char* start, char* end)
 	{
 		case CL_PID:
 		{
+			OIS_STATS( Received(OisStats::Handshake) );
 			ExpectState( 1<<Synchronisation, "PID", 2 );
 			m_pid = *(uint32_t*)(start+1);
 			m_vid = *(uint32_t*)(start+5);
@@ -1057,16 +1394,19 @@ int OisDevice::ProcessBinary(char* start, char* end)
 		}
 		case CL_CMD:
 		{
+			OIS_STATS( Received(OisStats::Registration) );
 			if( !ExpectState( (1<<Synchronisation)|(1<<Active), "CMD", 2 ) )
 				return false;
 			uint16_t channel = *(uint16_t*)(start+1);
 			char* name = start+3;
 			m_events.push_back({channel, OIS_STRING(name)});
+			++m_registrationVersion;
 			OIS_INFO( "<- CMD: %d %s", channel, name );
 			break;
 		}
 		case CL_NIO:
 		{
+			OIS_STATS( Received(OisStats::Registration) );
 			if( !ExpectState( (1<<Synchronisation)|(m_protocolVersion>1?1<<Active:0), "NIO", 2 ) )
 				return false;
 			bool output = payload & CL_N_PAYLOAD_O ? true :false;
@@ -1075,30 +1415,39 @@ int OisDevice::ProcessBinary(char* start, char* end)
 			uint16_t channel = *(uint16_t*)(start+1);
 			char* name = start+3;
 			OIS_VECTOR<NumericValue>& vec = output ? m_numericOutputs : m_numericInputs;
-			vec.push_back({OIS_STRING(name), channel, true, nt});
-			vec.back().value.number = 0;
+			Value value;
+			value.number = 0;
+			vec.push_back({OIS_STRING(name), channel, true, nt, value, false});
+			++m_registrationVersion;
 			OIS_INFO( "<- NIO: %d %s (%s %s)", channel, name, output?"Out":"In", nt==Fraction?"Fraction":(nt==Number?"Number":"Boolean") );
 			break;
 		}
 		case CL_ACT:
 		{
+			OIS_STATS( Received(OisStats::Handshake) );
 			ExpectState( 1<<Synchronisation, "ACT", 2 );
 			m_connectionState = Active;
+			++m_registrationVersion;
+			ReserveQueues();
 			OIS_INFO( "<- ACT" );
 			break;
 		}
 		case CL_TNI:
 		{
+			OIS_STATS( Received(OisStats::Registration) );
 			ExpectState( (1<<Synchronisation) | (1<<Active), "TNI", 2 );
 			uint16_t channel = *(uint16_t*)(start+1);
 			NumericValue* v = FindChannel(m_numericInputs, channel);
 			OIS_INFO( "<- TNI %d (%s)", channel, v?v->name.c_str():"UNKNOWN CHANNEL" );
 			if( v )
 				v->active = (payload & CL_TNI_PAYLOAD_T) ? true: false;
+			else
+				OIS_STATS( unknownChannels.Add() );
 			break;
 		}
 		case CL_DBG:
 		{
+			OIS_STATS( Received(OisStats::Debug) );
 			OIS_INFO( "<- DBG: %s", startString);
 			break;
 		}
@@ -1106,6 +1455,7 @@ int OisDevice::ProcessBinary(char* start, char* end)
 		case CL_EXC_1:
 		case CL_EXC_2:
 		{
+			OIS_STATS( Received(OisStats::Event) );
 			ExpectState( 1<<Active, "EXC", 2 );
 			uint16_t channel = 0;
 			uint16_t extra = (uint16_t)(payload >> CL_PAYLOAD_SHIFT);
@@ -1122,7 +1472,7 @@ int OisDevice::ProcessBinary(char* start, char* end)
 				ptrdiff_t index = e - &m_events.front();
 				m_eventBuffer.push_back({ channel, (uint16_t)index });
 			}
-			OIS_INFO( "<- EXC: %d (%s)", channel, e ? e->name.c_str() : "INVALID CHANNEL" );
+			LogEvent(true, channel, e);
 			break;
 		}
 		case CL_VAL_1:
@@ -1130,6 +1480,7 @@ int OisDevice::ProcessBinary(char* start, char* end)
 		case CL_VAL_3:
 		case CL_VAL_4:
 		{
+			OIS_STATS( Received(OisStats::Value) );
 			if( !ExpectState( 1<<Active, "VAL", 2 ) )
 				return false;
 			int16_t channel = 0;
@@ -1147,19 +1498,18 @@ int OisDevice::ProcessBinary(char* start, char* end)
 			if( v )
 			{
 				v->value = FromRawValue(v->type, value);
-				switch( v->type )
-				{
-				case Boolean:  OIS_INFO( "<- %d(%s) = %s",   channel, v->name.c_str(), v->value.boolean ? "true" : "false" ); break;
-				case Number:   OIS_INFO( "<- %d(%s) = %d",   channel, v->name.c_str(), v->value.number );                     break;
-				case Fraction: OIS_INFO( "<- %d(%s) = %.2f", channel, v->name.c_str(), v->value.fraction );                   break;
-				}
+				LogValue(true, *v);
 			}
 			else
+			{
 				OIS_WARN( "Received key/value message for unregistered channel %d", channel);
+				OIS_STATS( unknownChannels.Add() );
+			}
 			break;
 		}
 		case CL_END:
 		{
+			OIS_STATS( Received(OisStats::End) );
 			OIS_INFO( "<- END");
 			if( m_connectionState != Handshaking )
 				ClearState();
@@ -1182,6 +1532,7 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 	bool isKeyVal = 0 != isdigit(cmd[0]) && type != _451;
 	if (isKeyVal)
 	{
+		OIS_STATS( Received(OisStats::Value) );
 		if (!ExpectState(1 << Active, cmd, 2))
 			return false;
 		const char* payload = ZeroDelimiter(cmd, '=');
@@ -1190,29 +1541,29 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 		if (v)
 		{
 			v->value = FromRawValue(v->type, (int16_t)atoi(payload));
-			switch (v->type)
-			{
-			case Boolean:  OIS_INFO("<- %d(%s) = %s",   channel, v->name.c_str(), v->value.boolean ? "true" : "false"); break;
-			case Number:   OIS_INFO("<- %d(%s) = %d",   channel, v->name.c_str(), v->value.number);                     break;
-			case Fraction: OIS_INFO("<- %d(%s) = %.2f", channel, v->name.c_str(), v->value.fraction);                   break;
-			}
+			LogValue(true, *v);
 		}
 		else
+		{
 			OIS_WARN("Received key/value message for unregistered channel %d", channel);
+			OIS_STATS( unknownChannels.Add() );
+		}
 	}
 	else
 	{
-		char* payload = cmd[3] == '\0' ? "" : cmd + 4;
+		char* payload = cmd[3] == '\0' ? cmd + 3 : cmd + 4;//an empty string, if there's no payload
 		switch (type)
 		{
 			default:
 			{
 				OIS_WARN( "Unknown command: %s", cmd);
+				OIS_STATS( parseErrors.Add() );
 				break;
 			}
 			case _451:
 			case SYN:
 			{
+				OIS_STATS( Received(OisStats::Handshake) );
 				char* mode = ZeroDelimiter(payload, ',');
 				bool binary = *mode == 'B';
 				int version = atoi(payload);
@@ -1237,6 +1588,7 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 					else
 					{
 						OIS_WARN( "Restarting handshake");
+						OIS_STATS( handshakeRestarts.Add() );
 						ClearState();
 					}
 				}
@@ -1263,12 +1615,14 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 						case 1: SendText("ACK\n");        break;
 						case 2: SendText(sb.FormatTemp("ACK=%d,%s\n", m_gameVersion, m_gameName.c_str())); break;
 						}
+						OIS_STATS( Sent(OisStats::Handshake) );
 						OIS_INFO( "-> ACK", version );
 					}
 				}
 				else
 				{
 					OIS_INFO( "-> DEN", version );
+					OIS_STATS( Sent(OisStats::Handshake) );
 					SendText("DEN\n");
 					ClearState();
 				}
@@ -1276,6 +1630,7 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 			}
 			case PID:
 			{
+				OIS_STATS( Received(OisStats::Handshake) );
 				ExpectState(1<<Synchronisation, cmd, 2);
 				char* pid = payload;
 				char* vid = ZeroDelimiter(pid, ',');
@@ -1288,17 +1643,20 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 			}
 			case CMD:
 			{
+				OIS_STATS( Received(OisStats::Registration) );
 				if( !ExpectState( (1<<Synchronisation)|(m_protocolVersion>1?1<<Active:0), cmd, 1 ) )
 					return false;
 				char* name = payload;
 				uint16_t channel = (uint16_t)(0xFFFF & atoi(ZeroDelimiter(payload, ',')));
 				m_events.push_back({channel, OIS_STRING(name)});
+				++m_registrationVersion;
 				OIS_INFO( "<- CMD: %d %s", channel, name );
 				break;
 			}
 			case NIN: case NIF: case NIB:
 			case NON: case NOF: case NOB:
 			{
+				OIS_STATS( Received(OisStats::Registration) );
 				bool output = false;
 				NumericType nt;
 				switch( type )
@@ -1317,13 +1675,16 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 				int channel = atoi(ZeroDelimiter(payload, ','));
 				uint16_t channel16 = (uint16_t)(channel & 0xFFFFU);
 				OIS_VECTOR<NumericValue>& vec = output ? m_numericOutputs : m_numericInputs;
-				vec.push_back({OIS_STRING(name), channel16, true, nt});
-				vec.back().value.number = 0;
+				Value value;
+				value.number = 0;
+				vec.push_back({OIS_STRING(name), channel16, true, nt, value, false});
+				++m_registrationVersion;
 				OIS_INFO( "<- %s: %d %s", cmd, channel16, name );
 				break;
 			}
 			case TNI:
 			{
+				OIS_STATS( Received(OisStats::Registration) );
 				ExpectState( (1<<Synchronisation) | (1<<Active), cmd, 2 );
 				const char* active = ZeroDelimiter(payload, ',');
 				int channel = atoi(payload);
@@ -1331,17 +1692,23 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 				OIS_INFO( "<- TNI %d (%s)", channel, v?v->name.c_str():"UNKNOWN CHANNEL" );
 				if( v )
 					v->active = atoi(active) ? true: false;
+				else
+					OIS_STATS( unknownChannels.Add() );
 			}
 			case ACT:
 			{
+				OIS_STATS( Received(OisStats::Handshake) );
 				ExpectState( 1<<Synchronisation, cmd, 1 );
 				m_connectionState = Active;
+				++m_registrationVersion;
+				ReserveQueues();
 				OIS_INFO( "<- ACT" );
 				break;
 			}
 
 			case EXC:
 			{
+				OIS_STATS( Received(OisStats::Event) );
 				ExpectState( 1<<Active, cmd, 1 );
 				int channel = atoi(payload);
 				Event* e = FindChannel(m_events, channel);
@@ -1350,16 +1717,18 @@ bool OisDevice::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 					ptrdiff_t index = e - &m_events.front();
 					m_eventBuffer.push_back({ (uint16_t)channel, (uint16_t)index });
 				}
-				OIS_INFO( "<- EXC: %d (%s)", channel, e ? e->name.c_str() : "INVALID CHANNEL" );
+				LogEvent(true, (uint16_t)channel, e);
 				break;
 			}
 			case DBG:
 			{
+				OIS_STATS( Received(OisStats::Debug) );
 				OIS_INFO( "<- DBG: %s", payload);
 				break;
 			}
 			case END:
 			{
+				OIS_STATS( Received(OisStats::End) );
 				OIS_INFO( "<- END");
 				if( m_connectionState != Handshaking )
 					ClearState();
@@ -1420,7 +1789,10 @@ bool OisDevice::SetInput(uint16_t channel, Value value)
 void OisDevice::ClearState()
 {
 	if( m_connectionState != Handshaking )
+	{
 		m_idleTimer = 0;
+		OIS_STATS( clearStates.Add() );
+	}
 	m_reconnectAttempts = 0;
 	m_connectionState = Handshaking;
 	m_protocolVersion = 1;
@@ -1435,6 +1807,19 @@ void OisDevice::ClearState()
 	m_queuedInputs.clear();
 	m_events.clear();
 	m_eventBuffer.clear();
+	++m_registrationVersion;
+#ifdef OIS_ENABLE_LATENCY
+	m_latency.OnClearState();
+#endif
+}
+
+//Once every channel is known, make room in the queues so that SetInput, Poll and receiving events don't allocate.
+// Values are only queued once between Polls, but the event buffer grows if more than OIS_EVENT_QUEUE_RESERVE
+// activations of each event arrive between calls to PopEvents.
+void OisDevice::ReserveQueues()
+{
+	m_queuedInputs.reserve(m_numericInputs.size());
+	m_eventBuffer.reserve(m_events.size() * OIS_EVENT_QUEUE_RESERVE);
 }
 
 //------------------------------------------------------------------------------
@@ -1454,10 +1839,12 @@ void OisHost::SendHandshake(OIS_STRING_BUILDER& sb, float deltaTime)
 	if( m_protocolVersion >= 2 )
 		suffix = ",B";
 	SendText(sb.FormatTemp("SYN=%d%s\n", m_protocolVersion, suffix));
+	OIS_STATS( commands[OisStats::Out][OisStats::Handshake].Add(2) );
 }
 
 void OisHost::SendRegistration(OIS_STRING_BUILDER& sb, const NumericValue& v, bool output)
 {
+	OIS_STATS( Sent(OisStats::Registration) );
 	if( m_binary )
 	{
 		uint8_t data[3];
@@ -1515,6 +1902,7 @@ void OisHost::SendUnregistration(OIS_STRING_BUILDER& sb, uint16_t channel, Chann
 
 void OisHost::SendRegistration(OIS_STRING_BUILDER& sb, const Event& e)
 {
+	OIS_STATS( Sent(OisStats::Registration) );
 	if( m_binary )
 	{
 		uint8_t data[3];
@@ -1532,6 +1920,7 @@ void OisHost::SendSync(OIS_STRING_BUILDER& sb)
 {
 	if( m_protocolVersion >= 2 )
 	{
+		OIS_STATS( Sent(OisStats::Handshake) );
 		if( m_binary )
 		{
 			uint8_t data[9];
@@ -1565,6 +1954,7 @@ void OisHost::SendSync(OIS_STRING_BUILDER& sb)
 
 	m_channelChanges.clear();
 	
+	OIS_STATS( Sent(OisStats::Handshake) );
 	if( m_binary )
 	{
 		uint8_t data[1];
@@ -1575,11 +1965,35 @@ void OisHost::SendSync(OIS_STRING_BUILDER& sb)
 		SendText("ACT\n");
 
 	m_connectionState = Active;
+	++m_registrationVersion;
+	ReserveQueues();
+
+	//The game starts with every output at zero, so resend any that were set before it connected
+	if( m_protocolVersion >= 2 )
+	{
+		for( size_t i=0, end=m_numericOutputs.size(); i!=end; ++i )
+		{
+			NumericValue& v = m_numericOutputs[i];
+			if( v.value.number != 0 && !v.queued )
+			{
+				v.queued = true;
+				m_queuedOutputs.push_back({ v.channel, (uint16_t)i });
+			}
+		}
+	}
 }
 
 void OisHost::Poll(OIS_STRING_BUILDER& sb, float deltaTime)
 {
+#ifdef OIS_ENABLE_STATS
+	OisStats::PollTimer timer(m_stats);
+#endif
+#ifdef OIS_ENABLE_POLL_BUDGET
+	OisPollBudget::Scope budget(m_pollBudget);
+#endif
 	ConnectAndPoll(sb, deltaTime);
+	OIS_STATS( HighWater(OisStats::SendQueue, m_queuedOutputs.size() + m_queuedInputToggles.size()) );
+	OIS_STATS( HighWater(OisStats::EventQueue, m_eventBuffer.size()) );
 
 	if( m_connectionState == Handshaking )
 	{
@@ -1643,6 +2057,7 @@ void OisHost::Poll(OIS_STRING_BUILDER& sb, float deltaTime)
 		const NumericValue* v = FindChannel(m_numericInputs, index);
 		if (!v)
 			continue;
+		OIS_STATS( Sent(OisStats::Registration) );
 		if (m_binary)
 		{
 			uint8_t cmd[3];
@@ -1657,15 +2072,11 @@ void OisHost::Poll(OIS_STRING_BUILDER& sb, float deltaTime)
 
 	for (ChannelIndex& index : m_queuedOutputs)
 	{
-		const NumericValue* v = FindChannel(m_numericOutputs, index);
+		NumericValue* v = FindChannel(m_numericOutputs, index);
 		if (!v)
 			continue;
-		switch (v->type)
-		{
-		case Boolean:  OIS_INFO("-> %d(%s) = %s",   v->channel, v->name.c_str(), v->value.boolean ? "true" : "false"); break;
-		case Number:   OIS_INFO("-> %d(%s) = %d",   v->channel, v->name.c_str(), v->value.number);                     break;
-		case Fraction: OIS_INFO("-> %d(%s) = %.2f", v->channel, v->name.c_str(), v->value.fraction);                   break;
-		}
+		v->queued = false;
+		LogValue(false, *v);
 		SendValue(*v, sb, CL_PAYLOAD_SHIFT, CL_VAL_1, CL_VAL_2, CL_VAL_3, CL_VAL_4);
 	}
 	m_queuedOutputs.clear();
@@ -1676,7 +2087,8 @@ void OisHost::Poll(OIS_STRING_BUILDER& sb, float deltaTime)
 		if (!e)
 			continue;
 
-		OIS_INFO("-> EXC: %d (%s)", e->channel, e->name.c_str());
+		LogEvent(false, e->channel, e);
+		OIS_STATS( Sent(OisStats::Event) );
 		if (m_binary)
 		{
 			const unsigned extraBits = 8 - CL_PAYLOAD_SHIFT;
@@ -1720,7 +2132,7 @@ int OisHost::ProcessBinary(char* start, char* end)
 
 	int bufferLength = (int)(end - start);
 	
-	uint32_t payload = (*start);
+	uint32_t payload = (uint8_t)(*start);//char may be signed
 	int command = payload & SV_COMMAND_MASK;
 	int cmdLength = 1;
 	switch (command)
@@ -1728,6 +2140,7 @@ int OisHost::ProcessBinary(char* start, char* end)
 		default:
 		case SV_NUL:
 			OIS_WARN( "Unknown command: 0x%x", payload);
+			OIS_STATS( parseErrors.Add() );
 			break;
 		case SV_END_:
 			break;
@@ -1747,6 +2160,7 @@ int OisHost::ProcessBinary(char* start, char* end)
 		case SV_VAL_3:
 		case SV_VAL_4:
 		{
+			OIS_STATS( Received(OisStats::Value) );
 			if( !ExpectState( 1<<Active, "VAL", 2 ) )
 				return false;
 			int16_t channel = 0;
@@ -1764,19 +2178,18 @@ int OisHost::ProcessBinary(char* start, char* end)
 			if( v )
 			{
 				v->value = FromRawValue(v->type, value);
-				switch( v->type )
-				{
-				case Boolean:  OIS_INFO( "<- %d(%s) = %s",   channel, v->name.c_str(), v->value.boolean ? "true" : "false" ); break;
-				case Number:   OIS_INFO( "<- %d(%s) = %d",   channel, v->name.c_str(), v->value.number );                     break;
-				case Fraction: OIS_INFO( "<- %d(%s) = %.2f", channel, v->name.c_str(), v->value.fraction );                   break;
-				}
+				LogValue(true, *v);
 			}
 			else
+			{
 				OIS_WARN( "Received key/value message for unregistered channel %d", channel);
+				OIS_STATS( unknownChannels.Add() );
+			}
 			break;
 		}
 		case SV_END_:
 		{
+			OIS_STATS( Received(OisStats::End) );
 			OIS_INFO( "<- END");
 			if( m_connectionState != Handshaking )
 				ClearState();
@@ -1805,6 +2218,7 @@ bool OisHost::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 
 	if (isKeyVal)
 	{
+		OIS_STATS( Received(OisStats::Value) );
 		if (!ExpectState(1 << Active, cmd, 2))
 			return false;
 		const char* payload = ZeroDelimiter(cmd, '=');
@@ -1813,15 +2227,13 @@ bool OisHost::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 		if (v)
 		{
 			v->value = FromRawValue(v->type, atoi(payload));
-			switch (v->type)
-			{
-			case Boolean:  OIS_INFO("<- %d(%s) = %s",   channel, v->name.c_str(), v->value.boolean ? "true" : "false"); break;
-			case Number:   OIS_INFO("<- %d(%s) = %d",   channel, v->name.c_str(), v->value.number);                     break;
-			case Fraction: OIS_INFO("<- %d(%s) = %.2f", channel, v->name.c_str(), v->value.fraction);                   break;
-			}
+			LogValue(true, *v);
 		}
 		else
+		{
 			OIS_WARN("Received key/value message for unregistered channel %d", channel);
+			OIS_STATS( unknownChannels.Add() );
+		}
 	}
 	else
 	{
@@ -1831,10 +2243,13 @@ bool OisHost::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 			default:
 			{
 				OIS_WARN( "Unknown command: %s", cmd);
+				OIS_STATS( parseErrors.Add() );
 				break;
 			}
 			case DEN:
 			{
+				OIS_STATS( Received(OisStats::Handshake) );
+				OIS_STATS( handshakeRestarts.Add() );
 				int nextProtocolAttempt;
 				if( m_protocolVersion > 0 )
 					nextProtocolAttempt = m_protocolVersion - 1;
@@ -1847,6 +2262,7 @@ bool OisHost::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 			case _452:
 			case ACK1:
 			{
+				OIS_STATS( Received(OisStats::Handshake) );
 				m_protocolVersion = 1;
 				m_connectionState = Synchronisation;
 				m_idleTimer = 0;
@@ -1854,6 +2270,7 @@ bool OisHost::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 			}
 			case ACK2:
 			{
+				OIS_STATS( Received(OisStats::Handshake) );
 				m_gameName = ZeroDelimiter(payload, ',');
 				m_gameVersion = atoi(payload);
 				m_binary = true;
@@ -1863,6 +2280,7 @@ bool OisHost::ProcessAscii(char* cmd, OIS_STRING_BUILDER& sb)
 			}
 			case END:
 			{
+				OIS_STATS( Received(OisStats::End) );
 				OIS_INFO( "<- END");
 				if( m_connectionState != Handshaking )
 				{ 
@@ -1906,6 +2324,7 @@ uint16_t OisHost::AddEvent(const OIS_STRING& name)
 {
 	uint16_t ch = AddChannel(ChannelChange::Event);
 	m_events.push_back({ch, name});
+	++m_registrationVersion;
 	return ch;
 }
 
@@ -1914,7 +2333,8 @@ uint16_t OisHost::AddInput(const OIS_STRING& name, NumericType type)
 	uint16_t ch = AddChannel(ChannelChange::Input);
 	Value value;
 	value.number = 0;
-	m_numericInputs.push_back({name, ch, true, type, value});
+	m_numericInputs.push_back({name, ch, true, type, value, false});
+	++m_registrationVersion;
 	return ch;
 }
 
@@ -1923,7 +2343,8 @@ uint16_t OisHost::AddOutput(const OIS_STRING& name, NumericType type)
 	uint16_t ch = AddChannel(ChannelChange::Output);
 	Value value;
 	value.number = 0;
-	m_numericOutputs.push_back({name, ch, true, type, value});
+	m_numericOutputs.push_back({name, ch, true, type, value, false});
+	++m_registrationVersion;
 	return ch;
 }
 
@@ -1933,6 +2354,7 @@ bool OisHost::RemoveEvent(uint16_t channel)
 	if( !e )
 		return false;
 	OIS_ERASE_UNORDERED(m_events, *e);
+	++m_registrationVersion;
 	RemoveChannel(channel, ChannelChange::Event);
 	return true;
 }
@@ -1943,6 +2365,7 @@ bool OisHost::RemoveInput(uint16_t channel)
 	if( !e )
 		return false;
 	OIS_ERASE_UNORDERED(m_numericInputs, *e);
+	++m_registrationVersion;
 	RemoveChannel(channel, ChannelChange::Input);
 	return true;
 }
@@ -1953,6 +2376,7 @@ bool OisHost::RemoveOutput(uint16_t channel)
 	if( !e )
 		return false;
 	OIS_ERASE_UNORDERED(m_numericOutputs, *e);
+	++m_registrationVersion;
 	RemoveChannel(channel, ChannelChange::Output);
 	return true;
 }
@@ -2016,7 +2440,10 @@ bool OisHost::ToggleInput(uint16_t channel, bool active)
 void OisHost::ClearState()
 {
 	if( m_connectionState != Handshaking )
+	{
 		m_idleTimer = 0;
+		OIS_STATS( clearStates.Add() );
+	}
 	m_reconnectAttempts = 0;
 	m_connectionState = Handshaking;
 	m_protocolVersion = 0;
@@ -2026,9 +2453,22 @@ void OisHost::ClearState()
 	m_commandLength = 0;
 	m_queuedInputToggles.clear();
 	m_queuedOutputs.clear();
+	for (NumericValue& v : m_numericOutputs)
+		v.queued = false;
 	m_eventBuffer.clear();
 	m_handshakeTimer = 0;
 	m_channelChanges.clear();
+#ifdef OIS_ENABLE_LATENCY
+	m_latency.OnClearState();
+#endif
+}
+
+//As OisDevice::ReserveQueues
+void OisHost::ReserveQueues()
+{
+	m_queuedInputToggles.reserve(m_numericInputs.size());
+	m_queuedOutputs.reserve(m_numericOutputs.size());
+	m_eventBuffer.reserve(m_events.size() * OIS_EVENT_QUEUE_RESERVE);
 }
 
 //------------------------------------------------------------------------------
@@ -0,0 +1,295 @@
+#ifndef OIS_QUEUE_INCLUDED
+#define OIS_QUEUE_INCLUDED
+//------------------------------------------------------------------------------
+// Lock-free containers, used to hand data between threads without blocking either side.
+// Exactly one thread may call the consumer functions (Read/Pop/Acquire). Exactly one thread may call the producer
+//  functions (Write/Push/Publish), except for OisMpscQueue, which any number of threads may push to, and OisSeqlock,
+//  which any number of threads may read from.
+// The rings and queues have a fixed capacity that must be a power of two, and never allocate after construction.
+//------------------------------------------------------------------------------
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#ifndef OIS_CACHE_LINE_SIZE
+#define OIS_CACHE_LINE_SIZE 64
+#endif
+
+//------------------------------------------------------------------------------
+// A stream of bytes. Writes and reads may be partial, so data is not split up into messages.
+template<unsigned N>
+class OisSpscByteRing
+{
+	static_assert( N && (N & (N-1)) == 0, "OisSpscByteRing capacity must be a power of two" );
+public:
+	OisSpscByteRing() {}
+
+	//Producer: copy up to `size` bytes into the ring. Returns the number of bytes copied.
+	unsigned Write(const void* data, unsigned size)
+	{
+		uint32_t head = m_head.load(std::memory_order_relaxed);
+		uint32_t tail = m_tail.load(std::memory_order_acquire);
+		unsigned space = N - (head - tail);
+		if( size > space )
+			size = space;
+		CopyIn(head, (const uint8_t*)data, size);
+		m_head.store(head + size, std::memory_order_release);
+		return size;
+	}
+	//Producer: copy all `size` bytes into the ring, or nothing if they don't fit.
+	bool WriteAll(const void* data, unsigned size)
+	{
+		uint32_t head = m_head.load(std::memory_order_relaxed);
+		uint32_t tail = m_tail.load(std::memory_order_acquire);
+		if( size > N - (head - tail) )
+			return false;
+		CopyIn(head, (const uint8_t*)data, size);
+		m_head.store(head + size, std::memory_order_release);
+		return true;
+	}
+	//Consumer: copy up to `size` bytes out of the ring. Returns the number of bytes copied.
+	unsigned Read(void* data, unsigned size)
+	{
+		uint32_t tail = m_tail.load(std::memory_order_relaxed);
+		uint32_t head = m_head.load(std::memory_order_acquire);
+		unsigned used = head - tail;
+		if( size > used )
+			size = used;
+		uint8_t* out = (uint8_t*)data;
+		unsigned offset = tail & (N-1);
+		unsigned first = N - offset < size ? N - offset : size;
+		memcpy(out, m_data + offset, first);
+		memcpy(out + first, m_data, size - first);
+		m_tail.store(tail + size, std::memory_order_release);
+		return size;
+	}
+	//Either side: a snapshot of the number of readable bytes.
+	unsigned Size() const
+	{
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+	static unsigned Capacity() { return N; }
+private:
+	OisSpscByteRing(const OisSpscByteRing&);
+	OisSpscByteRing& operator=(const OisSpscByteRing&);
+
+	void CopyIn(uint32_t head, const uint8_t* in, unsigned size)
+	{
+		unsigned offset = head & (N-1);
+		unsigned first = N - offset < size ? N - offset : size;
+		memcpy(m_data + offset, in, first);
+		memcpy(m_data, in + first, size - first);
+	}
+
+	alignas(OIS_CACHE_LINE_SIZE) std::atomic<uint32_t> m_head{0};//only written by the producer
+	alignas(OIS_CACHE_LINE_SIZE) std::atomic<uint32_t> m_tail{0};//only written by the consumer
+	alignas(OIS_CACHE_LINE_SIZE) uint8_t m_data[N];
+};
+
+//------------------------------------------------------------------------------
+// A queue of up to N items of type T. T should be cheap to copy, e.g. pointers or small structs.
+template<class T, unsigned N>
+class OisSpscQueue
+{
+	static_assert( N && (N & (N-1)) == 0, "OisSpscQueue capacity must be a power of two" );
+public:
+	OisSpscQueue() {}
+
+	//Producer: returns false if the queue is full.
+	bool Push(const T& item)
+	{
+		uint32_t head = m_head.load(std::memory_order_relaxed);
+		if( head - m_tail.load(std::memory_order_acquire) == N )
+			return false;
+		m_items[head & (N-1)] = item;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+	//Consumer: returns false if the queue is empty.
+	bool Pop(T& item)
+	{
+		uint32_t tail = m_tail.load(std::memory_order_relaxed);
+		if( tail == m_head.load(std::memory_order_acquire) )
+			return false;
+		item = m_items[tail & (N-1)];
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+	//Either side: a snapshot of the number of queued items.
+	unsigned Size() const
+	{
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+	static unsigned Capacity() { return N; }
+private:
+	OisSpscQueue(const OisSpscQueue&);
+	OisSpscQueue& operator=(const OisSpscQueue&);
+
+	alignas(OIS_CACHE_LINE_SIZE) std::atomic<uint32_t> m_head{0};//only written by the producer
+	alignas(OIS_CACHE_LINE_SIZE) std::atomic<uint32_t> m_tail{0};//only written by the consumer
+	alignas(OIS_CACHE_LINE_SIZE) T m_items[N];
+};
+
+//------------------------------------------------------------------------------
+// A queue of up to N items of type T, which any number of producer threads may push to.
+// Each slot has a sequence number that tells producers whether it's free, and tells the consumer whether it's been
+//  filled in yet. A producer that is interrupted between claiming a slot and filling it in holds up the consumer
+//  (but not other producers) until it resumes.
+template<class T, unsigned N>
+class OisMpscQueue
+{
+	static_assert( N && (N & (N-1)) == 0, "OisMpscQueue capacity must be a power of two" );
+public:
+	OisMpscQueue()
+	{
+		for( unsigned i=0; i!=N; ++i )
+			m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	//Any thread: returns false if the queue is full.
+	bool Push(const T& item)
+	{
+		uint32_t head = m_head.load(std::memory_order_relaxed);
+		for(;;)
+		{
+			Slot& slot = m_slots[head & (N-1)];
+			int32_t diff = (int32_t)(slot.sequence.load(std::memory_order_acquire) - head);
+			if( diff < 0 )
+				return false;//the slot still holds an item from the previous lap, which hasn't been popped
+			if( diff == 0 && m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed) )
+			{
+				slot.item = item;
+				slot.sequence.store(head + 1, std::memory_order_release);
+				return true;
+			}
+			if( diff > 0 )
+				head = m_head.load(std::memory_order_relaxed);//another producer claimed this slot first
+		}
+	}
+	//Consumer: returns false if the queue is empty, or the next item is still being written.
+	bool Pop(T& item)
+	{
+		Slot& slot = m_slots[m_tail & (N-1)];
+		if( slot.sequence.load(std::memory_order_acquire) != m_tail + 1 )
+			return false;
+		item = slot.item;
+		slot.sequence.store(m_tail + N, std::memory_order_release);
+		++m_tail;
+		return true;
+	}
+	static unsigned Capacity() { return N; }
+private:
+	OisMpscQueue(const OisMpscQueue&);
+	OisMpscQueue& operator=(const OisMpscQueue&);
+
+	struct Slot
+	{
+		std::atomic<uint32_t> sequence;
+		T item;
+	};
+	alignas(OIS_CACHE_LINE_SIZE) std::atomic<uint32_t> m_head{0};//shared by the producers
+	alignas(OIS_CACHE_LINE_SIZE) uint32_t m_tail = 0;//only used by the consumer
+	alignas(OIS_CACHE_LINE_SIZE) Slot m_slots[N];
+};
+
+//------------------------------------------------------------------------------
+// Hands the most recent version of a T from one producer thread to one consumer thread, without either side waiting.
+// The producer fills in Back() and then calls Publish. The consumer calls Acquire, and then reads Front().
+// Each side owns the T that it's currently using, so it may be read / written freely until it's handed over.
+// Versions that are published faster than they are acquired are skipped.
+template<class T>
+class OisTripleBuffer
+{
+public:
+	OisTripleBuffer() {}
+
+	//Producer: the T to fill in before the next Publish. It may contain an old version, which can be updated in place.
+	T& Back() { return m_items[m_back]; }
+	//Producer: hand Back() over to the consumer, and receive a new Back().
+	void Publish()
+	{
+		m_back = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel) & IndexMask;
+	}
+	//Producer: true if the last Publish hasn't been acquired yet. Can be used to skip producing versions that nobody will see.
+	bool Pending() const
+	{
+		return 0 != (m_middle.load(std::memory_order_relaxed) & Fresh);
+	}
+
+	//Consumer: swap in the most recently published T, if there's a new one. Returns true if Front() changed.
+	bool Acquire()
+	{
+		if( 0 == (m_middle.load(std::memory_order_relaxed) & Fresh) )
+			return false;
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+	//Consumer: the most recently acquired T. Default constructed until something has been published and acquired.
+	const T& Front() const { return m_items[m_front]; }
+private:
+	OisTripleBuffer(const OisTripleBuffer&);
+	OisTripleBuffer& operator=(const OisTripleBuffer&);
+
+	enum { IndexMask = 3, Fresh = 4 };
+	T m_items[3];
+	unsigned m_back = 0;//only used by the producer
+	unsigned m_front = 1;//only used by the consumer
+	alignas(OIS_CACHE_LINE_SIZE) std::atomic<unsigned> m_middle{2};//index of the T in the middle, plus the Fresh flag
+};
+
+//------------------------------------------------------------------------------
+// A T that one producer thread overwrites, and any number of consumer threads copy out, without the producer waiting.
+// The sequence number is odd while a write is in progress; readers retry if it was odd or changed during their copy.
+// T must be trivially copyable. It's stored as atomic words, so that the torn copies which are retried aren't data races.
+template<class T>
+class OisSeqlock
+{
+	static_assert( std::is_trivially_copyable<T>::value, "OisSeqlock requires a trivially copyable type" );
+public:
+	OisSeqlock()
+	{
+		for( auto& w : m_words )
+			w.store(0, std::memory_order_relaxed);
+	}
+
+	//Producer
+	void Write(const T& value)
+	{
+		uint64_t words[NumWords] = {};
+		memcpy(words, &value, sizeof(T));
+		uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+		m_sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for( unsigned i=0; i!=NumWords; ++i )
+			m_words[i].store(words[i], std::memory_order_relaxed);
+		m_sequence.store(sequence + 2, std::memory_order_release);
+	}
+	//Consumers: returns the sequence number of the copied version, which only changes when the producer writes.
+	uint32_t Read(T& value) const
+	{
+		uint64_t words[NumWords];
+		for(;;)
+		{
+			uint32_t before = m_sequence.load(std::memory_order_acquire);
+			for( unsigned i=0; i!=NumWords; ++i )
+				words[i] = m_words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if( (before & 1) == 0 && before == m_sequence.load(std::memory_order_relaxed) )
+			{
+				memcpy(&value, words, sizeof(T));
+				return before;
+			}
+		}
+	}
+private:
+	OisSeqlock(const OisSeqlock&);
+	OisSeqlock& operator=(const OisSeqlock&);
+
+	enum : unsigned { NumWords = (sizeof(T) + 7) / 8 };
+	alignas(OIS_CACHE_LINE_SIZE) std::atomic<uint32_t> m_sequence{0};
+	std::atomic<uint64_t> m_words[NumWords];
+};
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef OIS_REPLAY_INCLUDED
+#define OIS_REPLAY_INCLUDED
+//------------------------------------------------------------------------------
+// An IOisPort that feeds a capture (see ois_capture.h) back into an OisDevice or OisHost: the same kind of object that
+//  recorded it, i.e. a capture opened with OisCaptureFileHeader::Host is replayed into an OisDevice.
+// * AsFastAsPossible: call NextPoll before each Poll, and pass it the deltaTime that NextPoll returns. Each Poll then
+//   reads exactly the bytes that the original Poll did, so the object goes through the same states, and writes the
+//   same bytes in response. That's checked against the bytes captured between the start of the original Poll and the
+//   start of the next one (see Mismatches and MissingWrites), so a difference in one Poll doesn't spread to the rest.
+//   Those bytes can include writes caused by the application's own calls during the original run, e.g. SetInput /
+//   SetOutput / Activate, which the replay doesn't make, so they show up as missing, or as mismatches if the Poll
+//   wrote anything after them.
+// * RealTime: Poll as usual. Bytes become readable once as much time has passed since the first Read / IsConnected
+//   call as had passed when they were captured. Writes aren't checked.
+// Writes are never sent anywhere. Connect / Disconnect do nothing, as the capture decides when the port is connected.
+//
+// Usage:
+//  OisReplayPort port;
+//  port.Open("capture.bin");
+//  OisDevice device(port, "Replay", 1, "Game");
+//  float deltaTime;
+//  while( port.NextPoll(deltaTime) )
+//    device.Poll(sb, deltaTime);
+// Include ois_protocol.h (with OIS_ENABLE_VIRTUAL_PORT) before this file.
+//------------------------------------------------------------------------------
+
+#ifndef OIS_ENABLE_VIRTUAL_PORT
+#error "OisReplayPort uses the IOisPort interface. Define OIS_ENABLE_VIRTUAL_PORT to opt in"
+#endif
+
+#include "ois_capture.h"
+
+class OisReplayPort : public IOisPort
+{
+public:
+	enum Mode
+	{
+		AsFastAsPossible,
+		RealTime,
+	};
+
+	//Loads a capture file into memory.
+	bool Open(const char* path, Mode mode = AsFastAsPossible)
+	{
+		m_file.clear();
+		FILE* fp = fopen(path, "rb");
+		if( !fp )
+			return Open(nullptr, 0, mode);
+		fseek(fp, 0L, SEEK_END);
+		long size = ftell(fp);
+		rewind(fp);
+		m_file.resize(size > 0 ? size : 0);
+		bool ok = size > 0 && (size_t)size == fread(&m_file.front(), 1, size, fp);
+		fclose(fp);
+		if( !ok )
+			m_file.clear();
+		return Open(m_file.empty() ? nullptr : &m_file.front(), m_file.size(), mode);
+	}
+	//Replays a capture that's already in memory (e.g. memory-mapped), which must stay valid while this port is used.
+	bool Open(const void* data, size_t size, Mode mode = AsFastAsPossible)
+	{
+		m_mode = mode;
+		m_connected = false;
+		m_started = false;
+		m_readOffset = 0;
+		m_writeOffset = 0;
+		m_written = 0;
+		m_mismatches = 0;
+		m_firstMismatch = ~(uint64_t)0;
+		m_missing = 0;
+		m_pollsMissingWrites = 0;
+		m_captureWritten = 0;
+		m_polls = 0;
+		bool ok = m_reader.Reset(data, size);
+		m_writes = m_reader;
+		OisCaptureReader all = m_reader;
+		OisCaptureReader::Entry e;
+		while( all.Next(e) )
+			m_captureWritten += e.record->type == OisCaptureRecord::Write ? e.record->length : 0;
+		return ok;
+	}
+	bool Valid() const { return m_reader.Valid(); }
+	const OisCaptureFileHeader* Header() const { return m_reader.Header(); }
+
+	//AsFastAsPossible: skips to the next captured Poll, and returns false if there are none left.
+	bool NextPoll(float& deltaTime)
+	{
+		EndPollWrites();
+		OisCaptureReader::Entry e;
+		while( m_reader.Next(e) )
+		{
+			if( e.record->type != OisCaptureRecord::Poll || e.record->length < sizeof(OisCapturePoll) )
+				continue;
+			OisCapturePoll p;
+			memcpy(&p, e.data, sizeof(p));
+			deltaTime = p.deltaTime;
+			m_connected = p.connected != 0;
+			m_readOffset = 0;
+			m_writes = m_reader;
+			m_writeOffset = 0;
+			++m_polls;
+			return true;
+		}
+		return false;
+	}
+	//True once every record has been replayed.
+	bool Finished() const
+	{
+		OisCaptureReader::Entry e;
+		return !m_reader.Peek(e);
+	}
+	uint64_t Polls() const { return m_polls; }
+	//Bytes written by the replayed object, and how many of them differ from what its Poll wrote in the capture,
+	// including any beyond the end of it. Unless the application wrote during that Poll (see above), a mismatch means
+	// that the object behaved differently, e.g. because of a bug fix, or a change to the protocol.
+	uint64_t Written()       const { return m_written; }
+	uint64_t Mismatches()    const { return m_mismatches; }
+	uint64_t FirstMismatch() const { return m_firstMismatch; }//offset into the written bytes, or ~0
+	//Bytes written in the capture, and how many of them the replayed object didn't write, in the Polls that are over
+	// (i.e. up to the last NextPoll call), and in how many of those Polls. Bytes written before the first Poll count
+	// as missing too.
+	uint64_t CaptureWritten()     const { return m_captureWritten; }
+	uint64_t MissingWrites()      const { return m_missing; }
+	uint64_t PollsMissingWrites() const { return m_pollsMissingWrites; }
+
+	bool IsConnected()
+	{
+		if( m_mode == RealTime )
+			Advance();
+		return m_connected;
+	}
+	void Connect()
+	{
+	}
+	void Disconnect()
+	{
+	}
+	int Read(char* buffer, int size)
+	{
+		if( m_mode == RealTime )
+			Advance();
+		int read = 0;
+		OisCaptureReader::Entry e;
+		while( read < size && m_reader.Peek(e) )
+		{
+			if( e.record->type == OisCaptureRecord::Poll )
+				break;//AsFastAsPossible: the end of this Poll's bytes. RealTime: not due yet
+			if( e.record->type != OisCaptureRecord::Read )
+			{
+				m_reader.Next(e);
+				continue;
+			}
+			if( m_mode == RealTime && e.record->time > Now() )
+				break;
+			uint32_t n = e.record->length - m_readOffset;
+			if( n > (uint32_t)(size - read) )
+				n = (uint32_t)(size - read);
+			memcpy(buffer + read, e.data + m_readOffset, n);
+			read += (int)n;
+			m_readOffset += n;
+			if( m_readOffset == e.record->length )
+			{
+				m_reader.Next(e);
+				m_readOffset = 0;
+			}
+		}
+		return read;
+	}
+	int Write(const char* buffer, int size)
+	{
+		for( int i=0; i!=size; ++i, ++m_written )
+		{
+			if( m_mode != AsFastAsPossible )
+				continue;
+			OisCaptureReader::Entry e;
+			bool match = NextWrite(e) && e.data[m_writeOffset++] == (uint8_t)buffer[i];
+			if( !match )
+			{
+				if( !m_mismatches )
+					m_firstMismatch = m_written;
+				++m_mismatches;
+			}
+		}
+		return size;
+	}
+	virtual const char* Name()
+	{
+		return "Replay";
+	}
+private:
+	//AsFastAsPossible: finds the Write record that holds the next byte that the current Poll wrote in the capture.
+	bool NextWrite(OisCaptureReader::Entry& e)
+	{
+		while( m_writes.Peek(e) && e.record->type != OisCaptureRecord::Poll )
+		{
+			if( e.record->type == OisCaptureRecord::Write && m_writeOffset < e.record->length )
+				return true;
+			m_writes.Next(e);
+			m_writeOffset = 0;
+		}
+		return false;
+	}
+	//Counts the bytes that the current Poll wrote in the capture, but that the replay didn't, as missing.
+	void EndPollWrites()
+	{
+		uint64_t missing = 0;
+		OisCaptureReader::Entry e;
+		while( NextWrite(e) )
+		{
+			missing += e.record->length - m_writeOffset;
+			m_writeOffset = e.record->length;
+		}
+		m_missing += missing;
+		m_pollsMissingWrites += missing ? 1 : 0;
+	}
+	//RealTime: applies the Polls whose time has come.
+	void Advance()
+	{
+		if( !m_started )
+		{
+			m_started = true;
+			m_startTime = OIS_TIME_NS();
+		}
+		uint64_t now = Now();
+		OisCaptureReader::Entry e;
+		while( m_reader.Peek(e) && e.record->time <= now )
+		{
+			if( e.record->type == OisCaptureRecord::Read )
+				break;//still to be read
+			if( e.record->type == OisCaptureRecord::Poll && e.record->length >= sizeof(OisCapturePoll) )
+			{
+				OisCapturePoll p;
+				memcpy(&p, e.data, sizeof(p));
+				m_connected = p.connected != 0;
+				++m_polls;
+			}
+			m_reader.Next(e);
+		}
+	}
+	uint64_t Now() const { return OIS_TIME_NS() - m_startTime; }
+
+	OIS_VECTOR<char> m_file;
+	OisCaptureReader m_reader;//the next record to replay
+	OisCaptureReader m_writes;//AsFastAsPossible: the next of the current Poll's records to compare writes against
+	Mode     m_mode = AsFastAsPossible;
+	bool     m_connected = false;
+	bool     m_started = false;
+	uint64_t m_startTime = 0;
+	uint32_t m_readOffset = 0; //into the current Read record
+	uint32_t m_writeOffset = 0;//into the current Write record
+	uint64_t m_written = 0;
+	uint64_t m_mismatches = 0;
+	uint64_t m_firstMismatch = ~(uint64_t)0;
+	uint64_t m_missing = 0;
+	uint64_t m_pollsMissingWrites = 0;
+	uint64_t m_captureWritten = 0;
+	uint64_t m_polls = 0;
+};
+
+#endif // OIS_REPLAY_INCLUDED
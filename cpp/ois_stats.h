@@ -0,0 +1,247 @@
+#ifndef OIS_STATS_INCLUDED
+#define OIS_STATS_INCLUDED
+//------------------------------------------------------------------------------
+// Counters for the traffic on one OIS connection. ois_protocol.h counts into this when OIS_ENABLE_STATS is defined,
+//  and OisDevice::Stats / OisHost::Stats return it. They're meant for spotting a misbehaving connection in production,
+//  e.g. a controller that floods the link, sends garbage, or keeps dropping back to the handshake.
+// Only the thread that polls the connection writes the counters, but any thread may read them (OisWebHost serves them
+//  at /metrics from its I/O thread). Counting is a relaxed load and store, so is as cheap as a plain increment.
+// OisWriteMetrics formats the stats of any number of connections in the Prometheus text format.
+//------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+
+//------------------------------------------------------------------------------
+class OisStatCounter
+{
+public:
+	uint64_t Get() const     { return m_value.load(std::memory_order_relaxed); }
+	//Writer only:
+	void Add(uint64_t n = 1) { m_value.store(Get() + n, std::memory_order_relaxed); }
+	void Max(uint64_t n)     { if( n > Get() ) m_value.store(n, std::memory_order_relaxed); }
+	void Set(uint64_t n)     { m_value.store(n, std::memory_order_relaxed); }
+private:
+	std::atomic<uint64_t> m_value{0};
+};
+
+//------------------------------------------------------------------------------
+struct OisStats
+{
+	enum Direction
+	{
+		In,
+		Out,
+		NumDirections
+	};
+	enum Command
+	{
+		Handshake,   //451, 452, SYN, ACK, DEN, PID, ACT
+		Registration,//CMD, NIx, NOx, TNI
+		Value,
+		Event,       //EXC
+		Debug,       //DBG
+		End,         //END
+		NumCommands
+	};
+	enum Queue
+	{
+		SendQueue,    //values (and toggles) waiting to be sent
+		EventQueue,   //OisDevice: received events waiting for PopEvents. OisHost: events waiting to be sent
+		CommandBuffer,//bytes of incomplete commands waiting for the rest to arrive
+		NumQueues
+	};
+
+	OisStatCounter bytes[NumDirections];
+	OisStatCounter commands[NumDirections][NumCommands];
+	OisStatCounter parseErrors;      //commands that were unknown, unexpected in the current state, or too long
+	OisStatCounter unknownChannels;  //values, events and toggles for channels that aren't registered
+	OisStatCounter handshakeRestarts;//the other side started a new handshake, or refused ours
+	OisStatCounter clearStates;      //connections that were dropped or reset after the handshake had begun
+	OisStatCounter queueHighWater[NumQueues];
+	OisStatCounter polls;
+	OisStatCounter pollNanoseconds;
+	OisStatCounter pollNanosecondsMax;
+	OisStatCounter connectionState;  //OisState::DeviceState at the start of the last Poll
+
+	void Received(Command c)               { commands[In][c].Add(); }
+	void Sent(Command c)                   { commands[Out][c].Add(); }
+	void HighWater(Queue q, size_t size)   { queueHighWater[q].Max(size); }
+	//Writer only. Readers may see a mix of old and new values while this runs.
+	void Clear()
+	{
+		for( OisStatCounter& c : bytes )
+			c.Set(0);
+		for( auto& direction : commands )
+			for( OisStatCounter& c : direction )
+				c.Set(0);
+		for( OisStatCounter& c : queueHighWater )
+			c.Set(0);
+		parseErrors.Set(0);
+		unknownChannels.Set(0);
+		handshakeRestarts.Set(0);
+		clearStates.Set(0);
+		polls.Set(0);
+		pollNanoseconds.Set(0);
+		pollNanosecondsMax.Set(0);
+	}
+
+	static const char* DirectionName(int d) { return d == In ? "in" : "out"; }
+	static const char* CommandName(int c)
+	{
+		static const char* names[NumCommands] = { "handshake", "registration", "value", "event", "debug", "end" };
+		return names[c];
+	}
+	static const char* QueueName(int q)
+	{
+		static const char* names[NumQueues] = { "send", "event", "command_buffer" };
+		return names[q];
+	}
+
+	//Times a Poll call, from its construction to its destruction. Its two OIS_TIME_NS calls are most of the cost of
+	// OIS_ENABLE_STATS.
+	class PollTimer
+	{
+	public:
+		explicit PollTimer(OisStats& stats) : m_stats(stats), m_start(OIS_TIME_NS()) {}
+		~PollTimer()
+		{
+			uint64_t ns = OIS_TIME_NS() - m_start;
+			m_stats.polls.Add();
+			m_stats.pollNanoseconds.Add(ns);
+			m_stats.pollNanosecondsMax.Max(ns);
+		}
+	private:
+		PollTimer(const PollTimer&);
+		PollTimer& operator=(const PollTimer&);
+		OisStats& m_stats;
+		uint64_t  m_start;
+	};
+};
+
+//------------------------------------------------------------------------------
+// One connection's stats, and the value of its `connection` label.
+struct OisStatsSource
+{
+	const char*     label;
+	const OisStats* stats;
+};
+
+//------------------------------------------------------------------------------
+// Formats the stats of `count` connections in the Prometheus text exposition format (version 0.0.4), by calling
+//  write(const char* text, int length) for each piece of the output.
+template<class Fn>
+class OisMetricsWriter
+{
+public:
+	OisMetricsWriter(Fn& write) : m_write(write) {}
+
+	void Family(const char* name, const char* type, const char* help)
+	{
+		int len = snprintf(m_buffer, sizeof(m_buffer), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+		Write(len);
+	}
+	void Sample(const char* name, const char* connection, const char* key1, const char* value1, const char* key2, const char* value2, uint64_t value)
+	{
+		WriteLabels(name, connection, key1, value1, key2, value2);
+		Write(snprintf(m_buffer, sizeof(m_buffer), "} %llu\n", (unsigned long long)value));
+	}
+	void Sample(const char* name, const char* connection, const char* key1, const char* value1, const char* key2, const char* value2, double value)
+	{
+		WriteLabels(name, connection, key1, value1, key2, value2);
+		Write(snprintf(m_buffer, sizeof(m_buffer), "} %.9g\n", value));
+	}
+private:
+	void WriteLabels(const char* name, const char* connection, const char* key1, const char* value1, const char* key2, const char* value2)
+	{
+		Write(snprintf(m_buffer, sizeof(m_buffer), "%s{connection=\"", name));
+		WriteEscaped(connection);
+		if( key1 )
+			Write(snprintf(m_buffer, sizeof(m_buffer), "\",%s=\"%s", key1, value1));
+		if( key2 )
+			Write(snprintf(m_buffer, sizeof(m_buffer), "\",%s=\"%s", key2, value2));
+		m_write("\"", 1);
+	}
+	//Label values escape backslash, double-quote and line feed (e.g. Windows port paths like \\.\COM10)
+	void WriteEscaped(const char* text)
+	{
+		const char* run = text;
+		for( const char* c = text; ; ++c )
+		{
+			const char* escape = *c == '\\' ? "\\\\" : *c == '"' ? "\\\"" : *c == '\n' ? "\\n" : 0;
+			if( !escape && *c )
+				continue;
+			if( c != run )
+				m_write(run, (int)(c - run));
+			if( !*c )
+				break;
+			m_write(escape, 2);
+			run = c + 1;
+		}
+	}
+	void Write(int len)
+	{
+		if( len > 0 )
+			m_write(m_buffer, len < (int)sizeof(m_buffer) ? len : (int)sizeof(m_buffer) - 1);
+	}
+
+	Fn&  m_write;
+	char m_buffer[256];
+};
+
+template<class Fn>
+void OisWriteMetrics(Fn&& write, const OisStatsSource* sources, unsigned count)
+{
+	OisMetricsWriter<Fn> w(write);
+
+	w.Family("ois_bytes_total", "counter", "Bytes read from (in) and written to (out) the port.");
+	for( unsigned i=0; i!=count; ++i )
+		for( int d=0; d!=OisStats::NumDirections; ++d )
+			w.Sample("ois_bytes_total", sources[i].label, "direction", OisStats::DirectionName(d), 0, 0, sources[i].stats->bytes[d].Get());
+
+	w.Family("ois_commands_total", "counter", "Commands received (in) and sent (out), by type.");
+	for( unsigned i=0; i!=count; ++i )
+		for( int d=0; d!=OisStats::NumDirections; ++d )
+			for( int c=0; c!=OisStats::NumCommands; ++c )
+				w.Sample("ois_commands_total", sources[i].label, "direction", OisStats::DirectionName(d), "command", OisStats::CommandName(c), sources[i].stats->commands[d][c].Get());
+
+	struct Counter
+	{
+		const char* name;
+		const char* help;
+		OisStatCounter OisStats::* counter;
+	} counters[] =
+	{
+		{ "ois_parse_errors_total",       "Commands that were unknown, unexpected in the current state, or too long.", &OisStats::parseErrors },
+		{ "ois_unknown_channel_total",    "Values, events and toggles received for channels that aren't registered.",   &OisStats::unknownChannels },
+		{ "ois_handshake_restarts_total", "Handshakes restarted by the other side, or refused by it.",                  &OisStats::handshakeRestarts },
+		{ "ois_clear_state_total",        "Connections dropped or reset after the handshake had begun.",                &OisStats::clearStates },
+		{ "ois_polls_total",              "Calls to Poll.",                                                             &OisStats::polls },
+	};
+	for( const Counter& c : counters )
+	{
+		w.Family(c.name, "counter", c.help);
+		for( unsigned i=0; i!=count; ++i )
+			w.Sample(c.name, sources[i].label, 0, 0, 0, 0, (sources[i].stats->*c.counter).Get());
+	}
+
+	w.Family("ois_poll_seconds_total", "counter", "Time spent in Poll.");
+	for( unsigned i=0; i!=count; ++i )
+		w.Sample("ois_poll_seconds_total", sources[i].label, 0, 0, 0, 0, sources[i].stats->pollNanoseconds.Get() * 1e-9);
+
+	w.Family("ois_poll_seconds_max", "gauge", "The longest single call to Poll.");
+	for( unsigned i=0; i!=count; ++i )
+		w.Sample("ois_poll_seconds_max", sources[i].label, 0, 0, 0, 0, sources[i].stats->pollNanosecondsMax.Get() * 1e-9);
+
+	w.Family("ois_queue_high_water", "gauge", "The most items a queue has held (bytes, for the command buffer).");
+	for( unsigned i=0; i!=count; ++i )
+		for( int q=0; q!=OisStats::NumQueues; ++q )
+			w.Sample("ois_queue_high_water", sources[i].label, "queue", OisStats::QueueName(q), 0, 0, sources[i].stats->queueHighWater[q].Get());
+
+	w.Family("ois_connection_state", "gauge", "0 = handshaking, 1 = synchronising, 2 = active.");
+	for( unsigned i=0; i!=count; ++i )
+		w.Sample("ois_connection_state", sources[i].label, 0, 0, 0, 0, sources[i].stats->connectionState.Get());
+}
+
+#endif // OIS_STATS_INCLUDED
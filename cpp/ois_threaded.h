@@ -0,0 +1,162 @@
+#ifndef OIS_THREADED_INCLUDED
+#define OIS_THREADED_INCLUDED
+//------------------------------------------------------------------------------
+// Lets a game talk to an OisDevice from its game thread while the serial I/O happens on a separate I/O thread.
+// OisDevice itself must only be used from one thread, as SetInput, PopEvents and DeviceOutputs touch the same data as
+//  Poll. OisThreadedDevice owns that data on the I/O thread, and hands changes between the threads without locks:
+//  * input values set by the game go through an SPSC queue, and are applied just before the next Poll.
+//  * events received from the device go through an SPSC queue to the game.
+//  * output values are published after every Poll into a seqlock, which the game copies out whenever it likes.
+//  * channel names / types are published through a triple buffer, only when they change (see RegistrationVersion).
+// Nothing allocates after construction, except publishing new registrations.
+//
+// Usage:
+//  I/O thread:  threaded.Poll(sb, deltaTime);                       // instead of device.Poll
+//  Game thread: threaded.SetInput(channel, value);                  // instead of device.SetInput
+//               threaded.PopEvents([](uint16_t channel) {...});     // instead of device.PopEvents
+//               threaded.ReadOutputs(outputs);                      // instead of device.DeviceOutputs
+//               if( threaded.AcquireRegistrations() ) ... threaded.Registrations() ...
+// Include ois_protocol.h before this file.
+//------------------------------------------------------------------------------
+
+#include "ois_queue.h"
+
+//------------------------------------------------------------------------------
+// Capacities of the queues between the threads (powers of two), and the number of output values that are published.
+#ifndef OIS_THREADED_QUEUE_SIZE
+#define OIS_THREADED_QUEUE_SIZE 256
+#endif
+#ifndef OIS_THREADED_MAX_OUTPUTS
+#define OIS_THREADED_MAX_OUTPUTS 64
+#endif
+
+class OisThreadedDevice
+{
+public:
+	struct OutputValue
+	{
+		uint16_t              channel;
+		OisState::NumericType type;
+		OisState::Value       value;
+	};
+	//Copied out of the seqlock by ReadOutputs
+	struct Outputs
+	{
+		unsigned    registrationVersion;//matches Registrations().registrationVersion when they describe the same channels
+		bool        connected;
+		unsigned    count;
+		OutputValue values[OIS_THREADED_MAX_OUTPUTS];//in the same order as Registrations().outputs
+
+		const OutputValue* Find(uint16_t channel) const
+		{
+			for( unsigned i=0; i!=count; ++i )
+				if( values[i].channel == channel )
+					return &values[i];
+			return nullptr;
+		}
+	};
+	struct RegistrationList
+	{
+		unsigned                           registrationVersion = 0;
+		OIS_STRING                         deviceName;
+		OIS_VECTOR<OisState::NumericValue> inputs;
+		OIS_VECTOR<OisState::NumericValue> outputs;
+		OIS_VECTOR<OisState::Event>        events;
+	};
+
+	explicit OisThreadedDevice(OisDevice& device) : m_device(device) {}
+
+	//I/O thread: applies the queued inputs, polls the device, and publishes its events and outputs.
+	void Poll(OIS_STRING_BUILDER& sb, float deltaTime)
+	{
+		InputChange change;
+		while( m_inputs.Pop(change) )
+			m_device.SetInput(change.channel, change.value);
+
+		m_device.Poll(sb, deltaTime);
+
+		m_device.PopEvents([this](const OisState::Event& e)
+		{
+			if( !m_events.Push(e.channel) )
+				m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+		});
+
+		unsigned version = m_device.RegistrationVersion();
+		if( version != m_publishedVersion )
+		{
+			RegistrationList& r = m_registrations.Back();
+			r.registrationVersion = version;
+			r.deviceName = m_device.GetDeviceName();
+			r.inputs = m_device.DeviceInputs();
+			r.outputs = m_device.DeviceOutputs();
+			r.events = m_device.DeviceEvents();
+			m_registrations.Publish();
+			m_publishedVersion = version;
+		}
+
+		const OIS_VECTOR<OisState::NumericValue>& outputs = m_device.DeviceOutputs();
+		m_outputScratch.registrationVersion = version;
+		m_outputScratch.connected = m_device.Connected();
+		m_outputScratch.count = outputs.size() < OIS_THREADED_MAX_OUTPUTS ? (unsigned)outputs.size() : OIS_THREADED_MAX_OUTPUTS;
+		for( unsigned i=0; i!=m_outputScratch.count; ++i )
+		{
+			OutputValue& v = m_outputScratch.values[i];
+			v.channel = outputs[i].channel;
+			v.type = outputs[i].type;
+			v.value = outputs[i].value;
+		}
+		m_outputs.Write(m_outputScratch);
+	}
+
+	//Game thread: queues a new value for an input channel. Returns false if the queue is full, in which case the I/O
+	// thread has fallen behind, and the caller may retry later.
+	bool SetInput(uint16_t channel, OisState::Value value)
+	{
+		InputChange change = { channel, value };
+		return m_inputs.Push(change);
+	}
+	//Game thread: calls fn(uint16_t channel) for each event received since the last call. Look the channel up in
+	// Registrations().events for its name.
+	template<class T>
+	bool PopEvents(T&& fn)
+	{
+		bool any = false;
+		uint16_t channel;
+		while( m_events.Pop(channel) )
+		{
+			fn(channel);
+			any = true;
+		}
+		return any;
+	}
+	//Game thread (or any other): copies out the output values as of the last Poll. Returns a number that changes
+	// whenever a Poll publishes new values.
+	uint32_t ReadOutputs(Outputs& out) const { return m_outputs.Read(out); }
+
+	//Game thread: returns true if Registrations() has changed since the last call.
+	bool AcquireRegistrations() { return m_registrations.Acquire(); }
+	const RegistrationList& Registrations() const { return m_registrations.Front(); }
+
+	//Any thread: events that were discarded because the game wasn't popping them quickly enough.
+	uint64_t DroppedEvents() const { return m_droppedEvents.load(std::memory_order_relaxed); }
+private:
+	OisThreadedDevice(const OisThreadedDevice&);
+	OisThreadedDevice& operator=(const OisThreadedDevice&);
+
+	struct InputChange
+	{
+		uint16_t        channel;
+		OisState::Value value;
+	};
+
+	OisDevice& m_device;
+	unsigned   m_publishedVersion = ~0U;//I/O thread
+	Outputs    m_outputScratch;//I/O thread
+	OisSpscQueue<InputChange, OIS_THREADED_QUEUE_SIZE> m_inputs; //game -> I/O
+	OisSpscQueue<uint16_t, OIS_THREADED_QUEUE_SIZE>    m_events; //I/O -> game
+	OisSeqlock<Outputs>                                m_outputs;//I/O -> game
+	OisTripleBuffer<RegistrationList>                  m_registrations;
+	std::atomic<uint64_t>                              m_droppedEvents{0};
+};
+
+#endif // OIS_THREADED_INCLUDED
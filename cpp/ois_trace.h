@@ -0,0 +1,127 @@
+#ifndef OIS_TRACE_INCLUDED
+#define OIS_TRACE_INCLUDED
+//------------------------------------------------------------------------------
+// Binary trace of the value updates and events on one OIS connection. ois_protocol.h records into this instead of
+//  formatting OIS_INFO messages when OIS_ENABLE_TRACE is defined.
+// Recording an entry is a timestamp and a handful of stores into a fixed size ring. Nothing is formatted or allocated,
+//  and once the ring is full the oldest entries are overwritten.
+// OisDevice::WriteTrace / OisHost::WriteTrace save the ring along with the channel names, and
+//  tools/ois_trace_decode.cpp turns a saved trace back into the lines that OIS_INFO would have logged.
+//------------------------------------------------------------------------------
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+//------------------------------------------------------------------------------
+// The number of entries kept per connection. Must be a power of two. Each entry is 16 bytes.
+#ifndef OIS_TRACE_SIZE
+#define OIS_TRACE_SIZE 4096
+#endif
+
+struct OisTraceRecord
+{
+	enum Type : uint8_t
+	{
+		ValueIn,  //value received: "<- channel(name) = value"
+		ValueOut, //value sent:     "-> channel(name) = value"
+		EventIn,  //event received: "<- EXC: channel (name)"
+		EventOut, //event sent:     "-> EXC: channel (name)"
+	};
+	uint64_t time;       //OIS_TIME_NS
+	uint16_t channel;
+	uint8_t  type;       //Type
+	uint8_t  numericType;//OisState::NumericType of a value
+	int32_t  value;      //a value's raw (wire) representation
+};
+static_assert( sizeof(OisTraceRecord) == 16, "OisTraceRecord should be packed into 16 bytes" );
+
+//------------------------------------------------------------------------------
+// Trace file layout, in the byte order of the machine that wrote it:
+//  OisTraceFileHeader
+//  nameCount * { OisTraceFileName, followed by `length` characters }
+//  recordCount * OisTraceRecord, oldest first
+struct OisTraceFileHeader
+{
+	enum { Version = 1 };
+	enum Side : uint8_t
+	{
+		Host,  //written by an OisDevice: values are received from outputs and sent to inputs
+		Device,//written by an OisHost: values are received from inputs and sent to outputs
+	};
+	char     magic[8];//"OISTRACE"
+	uint32_t version;
+	uint8_t  side;
+	uint8_t  padding[3];
+	uint32_t nameCount;
+	uint32_t recordCount;
+	uint64_t totalRecorded;//including entries that were overwritten
+};
+
+struct OisTraceFileName
+{
+	enum Kind : uint8_t { Input, Output, Event };
+	uint16_t channel;
+	uint8_t  kind;
+	uint8_t  numericType;
+	uint32_t length;
+};
+
+class OisTrace
+{
+	static_assert( OIS_TRACE_SIZE && (OIS_TRACE_SIZE & (OIS_TRACE_SIZE-1)) == 0, "OIS_TRACE_SIZE must be a power of two" );
+public:
+	void Record(OisTraceRecord::Type type, uint16_t channel, uint8_t numericType = 0, int32_t value = 0)
+	{
+		OisTraceRecord& r = m_records[m_total++ & (OIS_TRACE_SIZE-1)];
+		r.time = OIS_TIME_NS();
+		r.channel = channel;
+		r.type = type;
+		r.numericType = numericType;
+		r.value = value;
+	}
+	void Clear() { m_total = 0; }
+
+	//The number of entries held.
+	unsigned Size() const { return m_total < OIS_TRACE_SIZE ? (unsigned)m_total : OIS_TRACE_SIZE; }
+	//The number of entries ever recorded, including those that have been overwritten.
+	uint64_t Total() const { return m_total; }
+	//Index 0 is the oldest entry held.
+	const OisTraceRecord& operator[](unsigned i) const { return m_records[(m_total - Size() + i) & (OIS_TRACE_SIZE-1)]; }
+
+	bool WriteHeader(FILE* f, OisTraceFileHeader::Side side, uint32_t nameCount) const
+	{
+		OisTraceFileHeader h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, "OISTRACE", 8);
+		h.version = OisTraceFileHeader::Version;
+		h.side = side;
+		h.nameCount = nameCount;
+		h.recordCount = Size();
+		h.totalRecorded = m_total;
+		return 1 == fwrite(&h, sizeof(h), 1, f);
+	}
+	static bool WriteName(FILE* f, OisTraceFileName::Kind kind, uint16_t channel, uint8_t numericType, const char* name)
+	{
+		OisTraceFileName n;
+		memset(&n, 0, sizeof(n));
+		n.channel = channel;
+		n.kind = kind;
+		n.numericType = numericType;
+		n.length = (uint32_t)strlen(name);
+		return 1 == fwrite(&n, sizeof(n), 1, f) && n.length == fwrite(name, 1, n.length, f);
+	}
+	bool WriteRecords(FILE* f) const
+	{
+		unsigned size = Size();
+		unsigned first = (unsigned)((m_total - size) & (OIS_TRACE_SIZE-1));
+		unsigned firstPart = OIS_TRACE_SIZE - first < size ? OIS_TRACE_SIZE - first : size;
+		return firstPart == fwrite(m_records + first, sizeof(OisTraceRecord), firstPart, f)
+		    && size - firstPart == fwrite(m_records, sizeof(OisTraceRecord), size - firstPart, f);
+	}
+private:
+	OisTraceRecord m_records[OIS_TRACE_SIZE];
+	uint64_t       m_total = 0;
+};
+
+#endif
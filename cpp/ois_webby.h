@@ -10,12 +10,44 @@
 #define OIS_WEBBY_INFO(...) 
 #endif
 
+#include "ois_queue.h"
+#include <thread>
+#include <chrono>
+#include <map>
+#ifdef OIS_ENABLE_STATS
+#include <mutex>
+#endif
+
+//------------------------------------------------------------------------------
+// Define OIS_WEBBY_DEFLATE to compress websocket traffic with permessage-deflate (RFC 7692), for browsers that offer it.
+// This requires zlib. See OisWebHost::SetCompression.
+#ifdef OIS_WEBBY_DEFLATE
+#include "ois_deflate.h"
+#endif
+
+//------------------------------------------------------------------------------
+// The size of the byte rings that carry data between a websocket and its OisDevice. Must be a power of two.
+// Data that doesn't fit is held in an overflow buffer on the writing side and is never dropped.
+#ifndef OIS_WEBSOCKET_RING_SIZE
+#define OIS_WEBSOCKET_RING_SIZE 16384
+#endif
+
+//------------------------------------------------------------------------------
+// The most files that are kept in memory for pattern whitelist entries. Beyond this, the oldest is dropped.
+#ifndef OIS_WEB_MAX_PATTERN_ASSETS
+#define OIS_WEB_MAX_PATTERN_ASSETS 64
+#endif
+
+//------------------------------------------------------------------------------
+// The OisDevice side of this port (Read/Write) is used by whichever thread polls the device.
+// The socket side is only used by OisWebHost, on the thread that is running webby.
+// These are linked by a pair of SPSC rings, so the two sides may be on different threads.
 class OisWebsocketPort : public IOisPort
 {
 public:
 	bool IsConnected()
 	{
-		return true;
+		return m_open.load(std::memory_order_relaxed);
 	}
 	void Connect()
 	{
@@ -26,43 +58,58 @@ public:
 	int Read(char* buffer, int size)
 	{
 		OIS_ASSERT( size >= 0 );
-		if( readBuffer.empty() || size <= 0 )
+		FlushWrites();
+		if( size <= 0 )
 			return 0;
-		Frame& f = readBuffer.back();
-		OIS_ASSERT( f.cursor <= (int)f.data.size() );
-		int remaining = (int)f.data.size() - f.cursor;
-		int toCopy = min(size, remaining);
-		memcpy(buffer, &f.data.front() + f.cursor, toCopy);
-		f.cursor += toCopy;
-		if( toCopy == remaining )
-		{
-			readBuffer.pop_back();
-		}
-		return toCopy;
+		return (int)m_rx.Read(buffer, size);
 	}
 	int Write(const char* buffer, int size)
 	{
 		OIS_ASSERT( size >= 0 );
 		if( size <= 0 )
 			return -1;
-		writeBuffer.push_back({ {}, size });
-		writeBuffer.back().data.resize(size);
-		memcpy(&writeBuffer.back().data.front(), buffer, size);
+		FlushWrites();
+		unsigned written = m_txOverflow.empty() ? m_tx.Write(buffer, size) : 0;
+		if( written != (unsigned)size )
+			m_txOverflow.insert(m_txOverflow.end(), buffer + written, buffer + size);
 		return size;
 	}
 	virtual const char* Name()
 	{
 		return "Websocket";
 	}
-	
-	struct Frame
+private:
+	friend class OisWebHost;
+	typedef OisSpscByteRing<OIS_WEBSOCKET_RING_SIZE> Ring;
+
+	void FlushWrites()
 	{
-		OIS_VECTOR<uint8_t> data;
-		int cursor;
-	};
+		if( m_txOverflow.empty() )
+			return;
+		unsigned written = m_tx.Write(&m_txOverflow.front(), (unsigned)m_txOverflow.size());
+		m_txOverflow.erase(m_txOverflow.begin(), m_txOverflow.begin() + written);
+	}
+	//Socket side:
+	void Receive(const uint8_t* data, unsigned size)
+	{
+		FlushReceived();
+		unsigned written = m_rxOverflow.empty() ? m_rx.Write(data, size) : 0;
+		if( written != size )
+			m_rxOverflow.insert(m_rxOverflow.end(), data + written, data + size);
+	}
+	void FlushReceived()
+	{
+		if( m_rxOverflow.empty() )
+			return;
+		unsigned written = m_rx.Write(&m_rxOverflow.front(), (unsigned)m_rxOverflow.size());
+		m_rxOverflow.erase(m_rxOverflow.begin(), m_rxOverflow.begin() + written);
+	}
 
-	OIS_VECTOR<Frame> readBuffer;
-	OIS_VECTOR<Frame> writeBuffer;
+	Ring m_rx;//socket -> device
+	Ring m_tx;//device -> socket
+	OIS_VECTOR<uint8_t> m_rxOverflow;//only touched by the socket side
+	OIS_VECTOR<char>    m_txOverflow;//only touched by the device side
+	std::atomic<bool>   m_open{true};//cleared by the socket side when the websocket closes or the peer stops responding
 };
 
 class OisWebsocketConnection
@@ -72,10 +119,37 @@ public:
 		: m_device(m_port, name, gameVersion, gameName)
 	{
 	}
+#ifdef OIS_WEBBY_DEFLATE
+	~OisWebsocketConnection()
+	{
+		delete m_deflate;
+	}
+	bool IsCompressed() const { return m_deflate != nullptr; }
+#else
+	bool IsCompressed() const { return false; }
+#endif
+	//Smoothed websocket ping round trip time in seconds, or a negative value if no pong has been received yet.
+	float RoundTripTime() const { return m_rtt.load(std::memory_order_relaxed); }
+
 	OisWebsocketPort m_port;
 	OisDevice m_device;
 	std::vector<const char*> m_eventLog;
-	bool abort = false;
+	std::atomic<bool> abort{false};
+	uint64_t m_userData = 0;//free for the application to use, e.g. as a key into its own tables
+private:
+	friend class OisWebHost;
+	std::atomic<float> m_rtt{-1.0f};
+#ifdef OIS_ENABLE_STATS
+	char m_metricsLabel[24];//e.g. "websocket/3", set before the connection is published
+#endif
+	double m_lastReceived = 0;//keepalive state, only touched by the webby side
+	double m_lastPing = 0;
+#ifdef OIS_WEBBY_DEFLATE
+	OisWebsocketDeflate* m_deflate = nullptr;//compression state, only touched by the webby side
+	OIS_VECTOR<uint8_t> m_message;//fragments of an incoming compressed message
+	bool m_compressedMessage = false;
+	char m_extensions[128];
+#endif
 };
 
 #include "webby/webby.h"
@@ -87,25 +161,48 @@ struct OisWebWhitelist
 	bool isPattern;
 };
 
+//------------------------------------------------------------------------------
+// Files served by OisWebHost are kept in memory, so that reloading a controller page doesn't touch the disk.
+// Exact whitelist entries are loaded when the host is created, pattern entries are loaded on first request, up to
+//  OIS_WEB_MAX_PATTERN_ASSETS of them. Files that don't exist aren't remembered, so they're found once they appear.
+// If a file named `path.gz` exists next to an asset, it is served instead of the original to clients that accept gzip.
+struct OisWebAsset
+{
+	OIS_STRING       path;
+	OIS_VECTOR<char> data;
+	OIS_VECTOR<char> gzip;
+	char             etag[20];//strong ETags: quoted 64bit FNV-1a hash of each representation
+	char             etagGzip[20];
+	const char*      contentType;
+	bool             pattern;//loaded for a pattern whitelist entry, rather than an exact one
+};
+
 class OisWebHost
 {
 public:
 	template<unsigned N>
 	OisWebHost(unsigned gameVersion, const char* gameName, const OisWebWhitelist(&files)[N], bool allowIndex, unsigned short port = 8080)
+		: OisWebHost(gameVersion, gameName, files, N, allowIndex, port)
+	{
+	}
+	//`files` must outlive the host. If `bindAddress` is null, the server binds to this machine's address.
+	OisWebHost(unsigned gameVersion, const char* gameName, const OisWebWhitelist* files, unsigned numFiles, bool allowIndex, unsigned short port = 8080, const char* bindAddress = 0)
 		: m_gameName(gameName)
 		, m_gameVersion(gameVersion)
 		, m_files(files)
-		, m_numFiles(N)
+		, m_numFiles(numFiles)
 		, m_allowIndex(allowIndex)
 		, m_port(port)
 	{
+#ifdef _WIN32
 		WORD wsa_version = MAKEWORD(2, 2);
 		WSADATA wsa_data;
 		if( 0 != WSAStartup( wsa_version, &wsa_data ) )
 			return;
+#endif
 		
 		WebbyServerConfig config = {};
-		config.bind_address = 0;//"127.0.0.1";
+		config.bind_address = bindAddress;
 		config.listening_port = port;
 		config.flags = WEBBY_SERVER_WEBSOCKETS;
 		config.connection_max = 4;
@@ -118,6 +215,7 @@ public:
 		config.ws_closed = &webby_ws_closed;
 		config.ws_frame = &webby_ws_frame;
 		config.ws_poll = &webby_ws_poll;
+		config.ws_pong = &webby_ws_pong;
 #ifdef _DEBUG
 		config.flags |= WEBBY_SERVER_LOG_DEBUG;
 		config.log = &webby_log;
@@ -127,20 +225,91 @@ public:
 		m_memory.resize(size);
 		m_webby = WebbyServerInit( &config, &m_memory.front(), size );
 
-		m_ip = config.bind_address;
+		m_ip = config.bind_address ? config.bind_address : "";
+
+		for( unsigned i=0; i!=numFiles; ++i )
+		{
+			if( !files[i].isPattern )
+				FindAsset(files[i].path, false);
+		}
 	}
 	~OisWebHost()
 	{
+		StopThread();
+		if( m_webby )
+			WebbyServerShutdown( m_webby );
+		while( !m_eventOverflow.empty() || m_events.Size() )
+		{
+			FlushEvents();
+			PollEvents();
+		}
+		for( auto& a : m_assets )
+			delete a.second;
+#ifdef _WIN32
 		WSACleanup();
+#endif
 	}
 
+	//Runs webby (unless it is running on its own thread) and applies any new / closed connections to the Connections list.
 	void Poll()
 	{
-		if( m_webby )
-			WebbyServerUpdate( m_webby );
+		if( m_webby && !m_thread.joinable() )
+			UpdateServer();
+		PollEvents();
+	}
+	//Sends whatever the devices have written since the last Poll, without waiting for the next one.
+	//Doesn't add or remove connections, so it's safe to call while holding on to the Connections list.
+	void Flush()
+	{
+		if( m_webby && !m_thread.joinable() )
+			UpdateServer();
 	}
+	//The sockets that Poll services, so that an event-driven application can wait in select() / poll() until one of
+	// them is ready instead of polling on a fixed interval (see WebbyServerGetSockets). Not available when threaded.
+	int GetSockets(size_t* sockets, int* wantWrite, int maxSockets) const
+	{
+		if( !m_webby || m_thread.joinable() )
+			return 0;
+		return WebbyServerGetSockets(m_webby, sockets, wantWrite, maxSockets);
+	}
+
+	//Optionally move all socket I/O and HTTP file serving onto a dedicated thread, so that it can't stall the thread calling Poll.
+	//Bytes are exchanged with each OisWebsocketConnection through lock-free rings, and new / closed connections are
+	// delivered through a lock-free queue that is applied during Poll. The OisDevice objects are still polled by your thread.
+	//Call SetCacheControl before starting the thread. `sleepMicroseconds` is how long the thread waits between webby updates.
+	bool StartThread(unsigned sleepMicroseconds = 1000)
+	{
+		if( !m_webby || m_thread.joinable() )
+			return false;
+		m_threadQuit = false;
+		m_thread = std::thread([this, sleepMicroseconds]()
+		{
+			while( !m_threadQuit.load(std::memory_order_relaxed) )
+			{
+				UpdateServer();
+				std::this_thread::sleep_for(std::chrono::microseconds(sleepMicroseconds));
+			}
+		});
+		return true;
+	}
+	void StopThread()
+	{
+		if( !m_thread.joinable() )
+			return;
+		m_threadQuit = true;
+		m_thread.join();
+	}
+	bool IsThreaded() const { return m_thread.joinable(); }
 	
 	const OIS_VECTOR<OisWebsocketConnection*>& Connections() const { return m_connections; }
+	//Optionally be told when a connection is added to / about to be removed from the Connections list.
+	//Called from within Poll, so that applications can track connections without searching the list every frame.
+	typedef void (*ConnectionCallback)(OisWebsocketConnection&, bool added, void* user);
+	void SetConnectionCallback(ConnectionCallback callback, void* user)
+	{
+		m_connectionCallback = callback;
+		m_connectionCallbackUser = user;
+	}
 	bool Disconnect(const OisDevice& d)
 	{
 		auto it = std::find_if(m_connections.begin(), m_connections.end(), [&d](OisWebsocketConnection* item)
@@ -154,9 +323,101 @@ public:
 		return true;
 	}
 
+#ifdef OIS_ENABLE_STATS
+	//Every websocket connection's OisDevice::Stats is served at /metrics, in the Prometheus text format.
+	//AddMetrics also serves the stats of a connection that isn't a websocket, e.g. a serial OisDevice, labelled with
+	// `name` (such as its port path). `stats` must stay valid until it is removed. Both may be called from any thread.
+	void AddMetrics(const char* name, const OisStats& stats)
+	{
+		std::lock_guard<std::mutex> lock(m_metricsMutex);
+		m_metrics.push_back({ OIS_STRING(name), &stats });
+	}
+	void RemoveMetrics(const OisStats& stats)
+	{
+		std::lock_guard<std::mutex> lock(m_metricsMutex);
+		m_metrics.erase(std::remove_if(m_metrics.begin(), m_metrics.end(), [&stats](const MetricsSource& m)
+		{
+			return m.stats == &stats;
+		}), m_metrics.end());
+	}
+#endif
+
 	const OIS_STRING& GetBindAddress() const { return m_ip; }
+	//False if the server couldn't be started, e.g. because the port is in use.
+	bool IsListening() const { return m_webby != nullptr; }
+
+	//Websocket keepalive: a ping is sent to each controller every `pingInterval` seconds, which also measures RoundTripTime.
+	//Connections that haven't sent anything (including pongs) for `timeout` seconds are closed, so that a controller
+	// that silently goes away (e.g. a sleeping tablet) is removed quickly rather than waiting for TCP to give up.
+	//Zero disables either feature. Call before StartThread.
+	void SetKeepAlive(float pingInterval, float timeout)
+	{
+		m_pingInterval = pingInterval;
+		m_peerTimeout = timeout;
+	}
+
+#ifdef OIS_WEBBY_DEFLATE
+	//Enable or disable permessage-deflate for new connections. Messages smaller than `threshold` bytes are sent uncompressed.
+	//While the compression context is kept between messages (the default), even tiny value updates shrink by about half
+	// (see bench/bench_ws_deflate.cpp), so everything is compressed by default. If clients ask for server_no_context_takeover,
+	// messages under ~32 bytes can grow when compressed and a threshold avoids that. Call before StartThread.
+	void SetCompression(bool enabled, unsigned threshold = 0)
+	{
+		m_compression = enabled;
+		m_compressionThreshold = threshold;
+	}
+#endif
+
+	//The Cache-Control header sent with every file. The default forces browsers to revalidate using the ETag,
+	// which is answered with a body-less 304 response if the file hasn't changed.
+	void SetCacheControl(const char* cacheControl) { m_cacheControl = cacheControl; }
+	//Discard all cached files, so that they're reloaded from disk on their next request.
+	//If webby is running on its own thread, this happens on that thread during its next update.
+	void ReloadAssets()
+	{
+		m_reloadAssets = true;
+		if( !m_thread.joinable() )
+			UpdateAssets();
+	}
 private:
+	struct ConnectionEvent
+	{
+		OisWebsocketConnection* connection;
+		bool added;
+	};
+
 	OIS_VECTOR<OisWebsocketConnection*> m_connections;
+	ConnectionCallback m_connectionCallback = nullptr;
+	void* m_connectionCallbackUser = nullptr;
+	OisSpscQueue<ConnectionEvent, 64> m_events;//webby -> Poll
+	OIS_VECTOR<ConnectionEvent> m_eventOverflow;//events that didn't fit in m_events. Only touched by the webby side
+	OIS_VECTOR<uint8_t> m_frameBuffer;//only touched by the webby side
+	std::thread m_thread;
+	std::atomic<bool> m_threadQuit{false};
+	std::atomic<bool> m_reloadAssets{false};
+	std::map<OIS_STRING, OisWebAsset*> m_assets;//by path
+	OIS_VECTOR<OisWebAsset*> m_patternAssets;//oldest first
+#ifdef OIS_ENABLE_STATS
+	struct MetricsSource
+	{
+		OIS_STRING      label;
+		const OisStats* stats;
+	};
+	std::mutex m_metricsMutex;//guards m_metrics, which is added to by the application and read by the webby side
+	OIS_VECTOR<MetricsSource> m_metrics;
+	OIS_VECTOR<OisWebsocketConnection*> m_liveConnections;//only touched by the webby side, unlike m_connections
+	unsigned m_connectionCount = 0;
+	OIS_STRING m_metricsText;
+#endif
+	const char* m_cacheControl = "no-cache";
+	float m_pingInterval = 1.0f;
+	float m_peerTimeout = 5.0f;
+#ifdef OIS_WEBBY_DEFLATE
+	bool m_compression = true;
+	unsigned m_compressionThreshold = 0;
+	OIS_VECTOR<uint8_t> m_inflateBuffer;//only touched by the webby side
+	OIS_VECTOR<uint8_t> m_deflateBuffer;
+#endif
 	OIS_VECTOR<char> m_memory;
 	OIS_STRING m_ip;
 	WebbyServer* m_webby = nullptr;
@@ -167,6 +428,67 @@ private:
 	int m_port;
 	bool m_allowIndex;
 	
+	//Everything below here runs on the webby side: either inside Poll, or on the I/O thread.
+	void UpdateServer()
+	{
+		UpdateAssets();
+		WebbyServerUpdate( m_webby );
+		FlushEvents();
+	}
+	void UpdateAssets()
+	{
+		if( !m_reloadAssets.exchange(false) )
+			return;
+		for( auto& a : m_assets )
+			delete a.second;
+		m_assets.clear();
+		m_patternAssets.clear();
+		for( unsigned i=0; i!=m_numFiles; ++i )
+		{
+			if( !m_files[i].isPattern )
+				FindAsset(m_files[i].path, false);
+		}
+	}
+	void PushEvent(OisWebsocketConnection* connection, bool added)
+	{
+		FlushEvents();
+		ConnectionEvent e = { connection, added };
+		if( !m_eventOverflow.empty() || !m_events.Push(e) )
+			m_eventOverflow.push_back(e);
+	}
+	void FlushEvents()
+	{
+		size_t i = 0;
+		for( size_t end = m_eventOverflow.size(); i != end && m_events.Push(m_eventOverflow[i]); ++i ) {}
+		m_eventOverflow.erase(m_eventOverflow.begin(), m_eventOverflow.begin() + i);
+	}
+	//Runs on the Poll side. A connection is only deleted once the webby side has finished with it.
+	void PollEvents()
+	{
+		ConnectionEvent e;
+		while( m_events.Pop(e) )
+		{
+			if( e.added )
+			{
+				m_connections.push_back( e.connection );
+				if( m_connectionCallback )
+					m_connectionCallback( *e.connection, true, m_connectionCallbackUser );
+			}
+			else
+			{
+				if( m_connectionCallback )
+					m_connectionCallback( *e.connection, false, m_connectionCallbackUser );
+				m_connections.erase( std::find(m_connections.begin(), m_connections.end(), e.connection) );
+				delete e.connection;
+			}
+		}
+	}
+
+	static double Now()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
 	static void webby_log(const char* text)
 	{
 		OIS_WEBBY_INFO( "Webby: %s", text);
@@ -175,6 +497,10 @@ private:
 	static int webby_dispatch(struct WebbyConnection* connection)
 	{
 		OisWebHost& self = *(OisWebHost*)connection->user_host_data;
+#ifdef OIS_ENABLE_STATS
+		if (0 == strcmp(connection->request.uri, "/metrics"))
+			return self.ServeMetrics(connection);
+#endif
 		if (!self.m_numFiles)
 			return 1;
 
@@ -185,13 +511,17 @@ private:
 
 		OIS_STRING_BUILDER sb;
 		const char* whitelistedPath = 0;
+		bool pattern = false;
 		for (unsigned i = 0, end = self.m_numFiles; i != end && !whitelistedPath; ++i)
 		{
 			const OisWebWhitelist& f = self.m_files[i];
 			if (f.isPattern)
 			{
 				if (0 == strncmp(uri, f.request, strlen(f.request)))
+				{
 					whitelistedPath = sb.FormatTemp("%s%s", f.path, uri);
+					pattern = true;
+				}
 			}
 			else if (0 == strcmp(uri, f.request))
 					whitelistedPath = f.path;
@@ -239,23 +569,35 @@ R"(	<li><a href="http://%s:%d%s">%s</a></li>
 		}
 		else
 		{
-			FILE* fp;
-			if (whitelistedPath && (fp = fopen(whitelistedPath, "rb")))
+			const OisWebAsset* asset = whitelistedPath ? self.FindAsset(whitelistedPath, pattern) : 0;
+			if (asset)
 			{
-				fseek(fp, 0L, SEEK_END);
-				long size = ftell(fp);
-				rewind(fp);
-				if (WebbyBeginResponse(connection, 200, size, 0, 0))
+				bool gzip = !asset->gzip.empty() && AcceptsGzip(WebbyFindHeader(connection, "Accept-Encoding"));
+				const OIS_VECTOR<char>& data = gzip ? asset->gzip : asset->data;
+				const char* etag = gzip ? asset->etagGzip : asset->etag;
+				WebbyHeader headers[] =
 				{
-					fclose(fp);
-					return -1;
+					{ "ETag",             etag },
+					{ "Cache-Control",    self.m_cacheControl },
+					{ "Vary",             "Accept-Encoding" },
+					{ "Content-Type",     asset->contentType },
+					{ "Content-Encoding", "gzip" },
+				};
+				const char* ifNoneMatch = WebbyFindHeader(connection, "If-None-Match");
+				if (ifNoneMatch && (strstr(ifNoneMatch, etag) || 0 == strcmp(ifNoneMatch, "*")))
+				{
+					if (WebbyBeginResponse(connection, 304, 0, headers, 3))
+						return -1;
+				}
+				else
+				{
+					int size = (int)data.size();
+					if (WebbyBeginResponse(connection, 200, size, headers, gzip ? 5 : 4))
+						return -1;
+					if (size)
+						WebbyWrite(connection, &data.front(), size);
 				}
-				std::vector<char> data(size);
-				char* buffer = &data.front();
-				fread(buffer, 1, size, fp);
-				WebbyWrite(connection, buffer, size);
 				WebbyEndResponse(connection);
-				fclose(fp);
 			}
 			else
 			{
@@ -268,6 +610,127 @@ R"(	<li><a href="http://%s:%d%s">%s</a></li>
 		}
 		return 0;
 	}
+#ifdef OIS_ENABLE_STATS
+	//The websocket connections are only deleted by PollEvents after they've been removed from m_liveConnections, and
+	// the counters are atomic, so this is safe on the I/O thread while the application polls the devices.
+	int ServeMetrics(struct WebbyConnection* connection)
+	{
+		OIS_VECTOR<OisStatsSource> sources;
+		for( const OisWebsocketConnection* c : m_liveConnections )
+			sources.push_back({ c->m_metricsLabel, &c->m_device.Stats() });
+		m_metricsText.clear();
+		{
+			std::lock_guard<std::mutex> lock(m_metricsMutex);
+			for( const MetricsSource& m : m_metrics )
+				sources.push_back({ m.label.c_str(), m.stats });
+			OisWriteMetrics([this](const char* text, int length) { m_metricsText.append(text, length); }, sources.empty() ? nullptr : &sources.front(), (unsigned)sources.size());
+		}
+		WebbyHeader headers[] =
+		{
+			{ "Content-Type",  "text/plain; version=0.0.4; charset=utf-8" },
+			{ "Cache-Control", "no-cache" },
+		};
+		int size = (int)m_metricsText.size();
+		if (WebbyBeginResponse(connection, 200, size, headers, 2))
+			return -1;
+		if (size)
+			WebbyWrite(connection, m_metricsText.c_str(), size);
+		WebbyEndResponse(connection);
+		return 0;
+	}
+#endif
+	//Returns null if the file doesn't exist.
+	const OisWebAsset* FindAsset(const char* path, bool pattern)
+	{
+		auto found = m_assets.find(path);
+		if( found != m_assets.end() )
+			return found->second;
+		OisWebAsset* a = new OisWebAsset;
+		if( !LoadFile(path, a->data) )
+		{
+			OIS_WEBBY_INFO( "[asset] %s: not found", path);
+			delete a;
+			return 0;
+		}
+		a->path = path;
+		a->contentType = ContentType(path);
+		a->pattern = pattern;
+		OIS_STRING_BUILDER sb;
+		LoadFile(sb.FormatTemp("%s.gz", path), a->gzip);
+		MakeETag(a->data, a->etag);
+		MakeETag(a->gzip, a->etagGzip);
+		OIS_WEBBY_INFO( "[asset] %s: %s (%d bytes, %d gzipped)", path, a->etag, (int)a->data.size(), (int)a->gzip.size());
+		if( pattern )
+		{
+			if( m_patternAssets.size() >= OIS_WEB_MAX_PATTERN_ASSETS )
+			{
+				OisWebAsset* oldest = m_patternAssets.front();
+				m_patternAssets.erase(m_patternAssets.begin());
+				m_assets.erase(oldest->path);
+				delete oldest;
+			}
+			m_patternAssets.push_back(a);
+		}
+		m_assets[a->path] = a;
+		return a;
+	}
+	static void MakeETag(const OIS_VECTOR<char>& data, char(&etag)[20])
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for( char c : data )
+			hash = (hash ^ (uint8_t)c) * 1099511628211ULL;
+		snprintf(etag, sizeof(etag), "\"%08x%08x\"", (unsigned)(hash >> 32), (unsigned)hash);
+	}
+	static bool LoadFile(const char* path, OIS_VECTOR<char>& data)
+	{
+		FILE* fp = fopen(path, "rb");
+		if( !fp )
+			return false;
+		fseek(fp, 0L, SEEK_END);
+		long size = ftell(fp);
+		rewind(fp);
+		data.resize(size > 0 ? size : 0);
+		bool ok = size >= 0 && (size == 0 || (size_t)size == fread(&data.front(), 1, size, fp));
+		fclose(fp);
+		if( !ok )
+			data.clear();
+		return ok;
+	}
+	static const char* ContentType(const char* path)
+	{
+		static const char* types[][2] =
+		{
+			{ ".html", "text/html; charset=utf-8" },
+			{ ".js",   "application/javascript" },
+			{ ".json", "application/json" },
+			{ ".css",  "text/css" },
+			{ ".png",  "image/png" },
+			{ ".jpg",  "image/jpeg" },
+			{ ".map",  "application/json" },
+		};
+		size_t len = strlen(path);
+		for( auto& t : types )
+		{
+			size_t extLen = strlen(t[0]);
+			if( len >= extLen && 0 == strcmp(path + len - extLen, t[0]) )
+				return t[1];
+		}
+		return "application/octet-stream";
+	}
+	static bool AcceptsGzip(const char* acceptEncoding)
+	{
+		const char* gzip = acceptEncoding ? strstr(acceptEncoding, "gzip") : 0;
+		if( !gzip )
+			return false;
+		const char* q = gzip + 4;
+		while( *q == ' ' )
+			++q;
+		if( *q != ';' )
+			return true;
+		q = strstr(q, "q=");
+		return !q || atof(q+2) > 0;//"gzip;q=0" means not acceptable
+	}
+
 	static int webby_ws_connect(struct WebbyConnection* connection)
 	{
 		OIS_WEBBY_INFO( "[webby_ws_connect] method:%s", connection->request.method);
@@ -286,8 +749,31 @@ R"(	<li><a href="http://%s:%d%s">%s</a></li>
 		if( 0==strcmp(connection->request.uri, "/input") )
 		{
 			OisWebsocketConnection* oisConnection = new OisWebsocketConnection("WebSocket", self.m_gameVersion, self.m_gameName);
+			oisConnection->m_lastReceived = oisConnection->m_lastPing = Now();
 			connection->user_data = oisConnection;
-			self.m_connections.push_back( oisConnection );
+#ifdef OIS_WEBBY_DEFLATE
+			OisDeflateParams params;
+			const char* offer = WebbyFindHeader(connection, "Sec-WebSocket-Extensions");
+			if( self.m_compression && offer && params.Negotiate(offer, oisConnection->m_extensions, sizeof(oisConnection->m_extensions)) )
+			{
+				oisConnection->m_deflate = new OisWebsocketDeflate(params);
+				if( oisConnection->m_deflate->IsValid() )
+				{
+					OIS_WEBBY_INFO( "[webby_ws_connect] compression: %s", oisConnection->m_extensions);
+					WebbySetWebSocketExtensions(connection, oisConnection->m_extensions);
+				}
+				else
+				{
+					delete oisConnection->m_deflate;
+					oisConnection->m_deflate = nullptr;
+				}
+			}
+#endif
+#ifdef OIS_ENABLE_STATS
+			snprintf(oisConnection->m_metricsLabel, sizeof(oisConnection->m_metricsLabel), "websocket/%u", ++self.m_connectionCount);
+			self.m_liveConnections.push_back( oisConnection );
+#endif
+			self.PushEvent( oisConnection, true );
 			handled = true;
 		}
 		return handled?0:1;
@@ -301,39 +787,130 @@ R"(	<li><a href="http://%s:%d%s">%s</a></li>
 		OIS_WEBBY_INFO( "[webby_ws_closed] url:%s", connection->request.uri);
 		OisWebHost& self = *(OisWebHost*)connection->user_host_data;
 		OisWebsocketConnection* oisConnection = (OisWebsocketConnection*)connection->user_data;
-		self.m_connections.erase( std::find(self.m_connections.begin(), self.m_connections.end(), oisConnection) );
 		connection->user_data = 0;
-		delete oisConnection;
+		if( oisConnection )
+		{
+			oisConnection->m_port.m_open = false;
+#ifdef OIS_ENABLE_STATS
+			self.m_liveConnections.erase( std::find(self.m_liveConnections.begin(), self.m_liveConnections.end(), oisConnection) );
+#endif
+			self.PushEvent( oisConnection, false );
+		}
 	}
 	static int webby_ws_frame(struct WebbyConnection* connection, const struct WebbyWsFrame* frame)
 	{
 		OIS_WEBBY_INFO( "[webby_ws_frame] url:%s", connection->request.uri);
+		OisWebHost& self = *(OisWebHost*)connection->user_host_data;
 		OisWebsocketConnection* oisConnection = (OisWebsocketConnection*)connection->user_data;
+		bool compressed = 0 != (frame->flags & WEBBY_WSF_RSV1);
+#ifdef OIS_WEBBY_DEFLATE
+		if( frame->opcode != WEBBY_WS_OP_CONTINUATION )
+			oisConnection->m_compressedMessage = compressed;//only the first frame of a message has RSV1 set
+		compressed = oisConnection->m_compressedMessage;
+		if( compressed && !oisConnection->m_deflate )
+			return 1;
+#else
+		if( compressed )
+			return 1;//RSV1 is only valid if an extension was negotiated
+#endif
 		int size = frame->payload_length;
-		if( size <= 0 )
+		if( size <= 0 && !compressed )
 			return 0;
-		OIS_VECTOR<uint8_t> buffer;
+#ifdef OIS_WEBBY_DEFLATE
+		if( compressed && oisConnection->m_message.size() + (size > 0 ? size : 0) > OIS_DEFLATE_MAX_MESSAGE )
+		{
+			OIS_WEBBY_INFO( "[webby_ws_frame] compressed message too long, closing");
+			return 1;
+		}
+#endif
+		OIS_VECTOR<uint8_t>& buffer = self.m_frameBuffer;
 		buffer.resize(size);
-		int r = WebbyRead( connection, &buffer.front(), size );
-		if( r == 0 )
+		int r = size > 0 ? WebbyRead( connection, &buffer.front(), size ) : 0;
+		if( r != 0 )
+			return r;
+		oisConnection->m_lastReceived = Now();
+#ifdef OIS_WEBBY_DEFLATE
+		if( compressed )
 		{
-			OIS_VECTOR<OisWebsocketPort::Frame>& portBuffer = oisConnection->m_port.readBuffer;
-			portBuffer.push_back({});
-			std::swap(portBuffer.back().data, buffer);
+			OIS_VECTOR<uint8_t>& message = oisConnection->m_message;
+			message.insert(message.end(), buffer.begin(), buffer.end());
+			if( 0 == (frame->flags & WEBBY_WSF_FIN) )
+				return 0;
+			OIS_VECTOR<uint8_t>& inflated = self.m_inflateBuffer;
+			inflated.clear();
+			bool ok = oisConnection->m_deflate->Decompress(message.empty() ? nullptr : &message.front(), (unsigned)message.size(), inflated);
+			message.clear();
+			if( !ok )
+			{
+				OIS_WEBBY_INFO( "[webby_ws_frame] invalid compressed message, closing");
+				return 1;
+			}
+			if( !inflated.empty() )
+				oisConnection->m_port.Receive(&inflated.front(), (unsigned)inflated.size());
+			return 0;
 		}
-		return r;
+#endif
+		oisConnection->m_port.Receive(&buffer.front(), (unsigned)size);
+		return 0;
+	}
+	static void webby_ws_pong(struct WebbyConnection* connection, const unsigned char* payload, int size)
+	{
+		OisWebsocketConnection* oisConnection = (OisWebsocketConnection*)connection->user_data;
+		double now = Now();
+		oisConnection->m_lastReceived = now;
+		double sent;
+		if( size != sizeof(sent) )
+			return;//not one of our pings
+		memcpy(&sent, payload, sizeof(sent));
+		float sample = (float)(now - sent);
+		if( sample < 0 )
+			return;
+		float rtt = oisConnection->m_rtt.load(std::memory_order_relaxed);
+		rtt = rtt < 0 ? sample : rtt + (sample - rtt) * 0.125f;//same smoothing factor as TCP's SRTT
+		oisConnection->m_rtt.store(rtt, std::memory_order_relaxed);
 	}
 	static int webby_ws_poll(struct WebbyConnection* connection)
 	{
+		OisWebHost& self = *(OisWebHost*)connection->user_host_data;
 		OisWebsocketConnection* oisConnection = (OisWebsocketConnection*)connection->user_data;
-		OIS_VECTOR<OisWebsocketPort::Frame>& portBuffer = oisConnection->m_port.writeBuffer;
-		for( OisWebsocketPort::Frame& f : portBuffer )
+		OisWebsocketPort& port = oisConnection->m_port;
+		port.FlushReceived();
+
+		double now = Now();
+		if( self.m_peerTimeout > 0 && now - oisConnection->m_lastReceived > self.m_peerTimeout )
+		{
+			OIS_WEBBY_INFO( "[webby_ws_poll] no response for %.1fs, closing", (float)(now - oisConnection->m_lastReceived));
+			return 1;
+		}
+		if( self.m_pingInterval > 0 && now - oisConnection->m_lastPing >= self.m_pingInterval )
 		{
-			WebbyBeginSocketFrame( connection, WEBBY_WS_OP_BINARY_FRAME );
-			WebbyWrite( connection, &f.data.front(), f.data.size() );
+			oisConnection->m_lastPing = now;
+			WebbySendPing( connection, &now, sizeof(now) );
+		}
+
+		//Everything written by the device since the last poll is sent as a single binary frame. The protocol is a byte stream, so frame boundaries don't matter.
+		OIS_VECTOR<uint8_t>& buffer = self.m_frameBuffer;
+		buffer.resize(OisWebsocketPort::Ring::Capacity());
+		unsigned size = port.m_tx.Read(&buffer.front(), (unsigned)buffer.size());
+		if( size )
+		{
+			const uint8_t* payload = &buffer.front();
+			int opcode = WEBBY_WS_OP_BINARY_FRAME;
+#ifdef OIS_WEBBY_DEFLATE
+			if( oisConnection->m_deflate && size >= self.m_compressionThreshold )
+			{
+				OIS_VECTOR<uint8_t>& compressed = self.m_deflateBuffer;
+				if( !oisConnection->m_deflate->Compress(payload, size, compressed) )
+					return 1;//the compression context is now unusable
+				payload = compressed.empty() ? payload : &compressed.front();
+				size = (unsigned)compressed.size();
+				opcode |= WEBBY_WS_RSV1;
+			}
+#endif
+			WebbyBeginSocketFrame( connection, opcode );
+			WebbyWrite( connection, payload, size );
 			WebbyEndSocketFrame( connection );
 		}
-		portBuffer.clear();
 
 		return oisConnection->abort ? 1 : 0;
 	}
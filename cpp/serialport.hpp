@@ -30,11 +30,19 @@ public:
 	void PurgeReadBuffer();
 	int  Read(char* buffer, int size);
 	int  Write(const char* buffer, int size);
+#ifndef WIN32
+	//For waiting on the port with select() / poll(). -1 when disconnected.
+	int  FileDescriptor() const { return m_handle; }
+#endif
 private:
 	SerialPort( const SerialPort& );
 	SerialPort& operator=( const SerialPort& );
 
+#ifdef WIN32
 	void* m_handle;
+#else
+	int m_handle;
+#endif
 	int m_baud = 0;
 	OIS_STRING m_portName;
 };
@@ -351,8 +359,226 @@ int SerialPort::Write(const char* buffer, int bufferSize)
 
 
 #else//WIN32
-#error Requires porting to this platform...
-#endif
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+//Reads the first line of a small sysfs file, e.g. a USB device's product name
+static bool ReadSysfsLine(const char* path, char* out, int size)
+{
+	FILE* f = fopen(path, "r");
+	if( !f )
+		return false;
+	bool ok = fgets(out, size, f) != 0;
+	fclose(f);
+	if( ok )
+		out[strcspn(out, "\r\n")] = '\0';
+	return ok && out[0];
+}
+
+void SerialPort::EnumerateSerialPorts(OIS_PORT_LIST& results, OIS_STRING_BUILDER& sb, int minPort)
+{
+	//USB CDC (e.g. Arduino Leonardo / Micro), USB-serial adaptors (e.g. Arduino Uno clones), on-board UARTs and bluetooth
+	static const char* const prefixes[] = { "ttyACM", "ttyUSB", "ttyAMA", "rfcomm" };
+	DIR* dir = opendir("/dev");
+	if( !dir )
+		return;
+	size_t first = results.size();
+	while( dirent* entry = readdir(dir) )
+	{
+		const char* device = entry->d_name;
+		const char* prefix = 0;
+		for( const char* p : prefixes )
+			if( 0 == strncmp(device, p, strlen(p)) )
+				prefix = p;
+		if( !prefix )
+			continue;
+		const char* number = device + strlen(prefix);
+		if( !*number || strspn(number, "0123456789") != strlen(number) )
+			continue;
+		unsigned port = (unsigned)atoi(number);
+		if( (int)port < minPort )
+			continue;
+
+		OIS_STRING name;
+		char product[128];
+		if( ReadSysfsLine(sb.FormatTemp("/sys/class/tty/%s/device/../product", device), product, sizeof(product)) ||   //ttyACM: device is the USB interface
+		    ReadSysfsLine(sb.FormatTemp("/sys/class/tty/%s/device/../../product", device), product, sizeof(product)) ) //ttyUSB: device is the usb-serial port
+			name = product;
+		else
+			name = device;
+		OIS_STRING path;
+		sb.Format(path, "/dev/%s", device);
+		results.push_back({port, path, name});
+	}
+	closedir(dir);
+	std::sort(results.begin() + first, results.end(), [](const ::PortName& a, const ::PortName& b) { return a.path < b.path; });
+}
+
+SerialPort::SerialPort() 
+	: m_handle(-1)
+{}
+
+void SerialPort::Connect(const char* portName)
+{
+	m_portName = portName;
+	Connect();
+}
+
+void SerialPort::Connect()
+{
+	const char* portName = m_portName.c_str();
+	Disconnect();
+	m_handle = open(portName, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if( m_handle >= 0 )
+		SetBaud(9600);
+	else
+	{
+		OIS_WARN("ERROR opening serial port %s : %s", portName, strerror(errno));
+	}
+}
+
+void SerialPort::SetBaud(int baud, bool purge)
+{
+	termios serialParameters = {};
+	if( tcgetattr(m_handle, &serialParameters) != 0 )
+	{
+		OIS_WARN("failed to get current serial parameters");
+		return Disconnect();
+	}
+
+	m_baud = baud;
+	speed_t speed;
+	switch(baud)
+	{
+	case 110:    speed = B110;	break;
+	case 300:    speed = B300;	break;
+	case 600:    speed = B600;	break;
+	case 1200:   speed = B1200;	break;
+	case 2400:   speed = B2400;	break;
+	case 4800:   speed = B4800;	break;
+	default: m_baud = 9600;
+	case 9600:   speed = B9600;	break;
+	case 19200:  speed = B19200;	break;
+	case 38400:  speed = B38400;	break;
+	case 57600:  speed = B57600;	break;
+	case 115200: speed = B115200;	break;
+	case 230400: speed = B230400;	break;
+	}
+
+	if( cfgetospeed(&serialParameters) == speed && !purge )
+		return;
+
+	//8 data bits, one stop bit, no parity, no flow control, and no line editing / translation
+	cfmakeraw(&serialParameters);
+	serialParameters.c_cflag |= CLOCAL | CREAD;
+	serialParameters.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+	//The port is non-blocking: Read returns whatever is available, like the Windows version
+	serialParameters.c_cc[VMIN]  = 0;
+	serialParameters.c_cc[VTIME] = 0;
+	cfsetispeed(&serialParameters, speed);
+	cfsetospeed(&serialParameters, speed);
+
+	if( tcsetattr(m_handle, TCSANOW, &serialParameters) != 0 )
+	{
+		OIS_WARN("could not set Serial port parameters");
+		return Disconnect();
+	}
+	int dtr = TIOCM_DTR;//matches DTR_CONTROL_ENABLE on Windows
+	ioctl(m_handle, TIOCMBIS, &dtr);
+	if( purge )
+		tcflush(m_handle, TCIOFLUSH);
+}
+
+bool SerialPort::IsConnected()
+{
+	if( m_handle < 0 )
+		return false;
+	//An unplugged USB device leaves the descriptor open, but reports a hang-up
+	pollfd p = { m_handle, 0, 0 };
+	if( poll(&p, 1, 0) > 0 && (p.revents & (POLLHUP | POLLERR | POLLNVAL)) )
+	{
+		Disconnect();
+		return false;
+	}
+	return true;
+}
+
+void SerialPort::Disconnect()
+{
+	if( m_handle >= 0 )
+	{
+		close(m_handle);
+		m_handle = -1;
+	}
+}
+
+void SerialPort::PurgeReadBuffer()
+{
+	if( m_handle >= 0 )
+		tcflush(m_handle, TCIFLUSH);
+}
+
+int SerialPort::Read(char* buffer, int bufferSize)
+{
+	if( m_handle < 0 || bufferSize <= 0 )
+		return 0;
+
+	//With VMIN = 0, an empty port reads 0 bytes rather than failing with EAGAIN. Hang-ups are detected by IsConnected.
+	ssize_t bytesRead = read(m_handle, buffer, bufferSize);
+	if( bytesRead >= 0 )
+		return (int)bytesRead;
+	if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+		Disconnect();
+	return 0;
+}
+
+int SerialPort::Write(const char* buffer, int bufferSize)
+{
+	if( m_handle < 0 || bufferSize <= 0 )
+		return false;
+
+	//The port is non-blocking for the sake of Read, but writes block like the Windows version's: until everything is
+	// sent, or for at most 50ms plus 10ms per byte (its COMMTIMEOUTS). A full transmit buffer (a saturated link) then
+	// slows the caller down, rather than truncating commands or looking like an error.
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(50 + 10 * (int64_t)bufferSize);
+	int bytesSent = 0;
+	while( bytesSent < bufferSize )
+	{
+		ssize_t n = write(m_handle, buffer + bytesSent, bufferSize - bytesSent);
+		if( n > 0 )
+		{
+			bytesSent += (int)n;
+			continue;
+		}
+		if( n < 0 && errno == EINTR )
+			continue;
+		if( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK )
+		{
+			Disconnect();
+			return -1;
+		}
+		auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		if( left <= 0 )
+			break;//timed out; as on Windows, the caller sees a short write
+		pollfd p = { m_handle, POLLOUT, 0 };
+		if( poll(&p, 1, (int)left) < 0 && errno != EINTR )
+		{
+			Disconnect();
+			return -1;
+		}
+	}
+	return bytesSent;
+}
+
+#endif//WIN32
 #endif//OIS_SERIALPORT_IMPL
 #endif // OIS_SERIALPORT_INCLUDED
 
@@ -0,0 +1,793 @@
+//------------------------------------------------------------------------------
+// Analyzes a capture saved by OisCapture (see ois_capture.h) without replaying it. Both directions of the connection
+//  are decoded with the same framing rules as OisDevice / OisHost, the channel registry is rebuilt from the
+//  registration commands, and it reports:
+//  * the bytes each direction spent on each type of command (grouped as in OisStats),
+//  * per channel: updates, mean and peak updates per second, bytes, and a histogram of the values,
+//  * how many value bytes a deadband (not sending changes of up to N raw units; hundredths for fractions) or batching
+//    (sending only the last value of a channel in each window of N milliseconds) would have saved.
+// A raw dump of the bytes sent in one direction (e.g. from a serial port sniffer) can be analyzed with --raw, minus
+//  the rates and batching, which need timestamps.
+// The registry is every registration seen in the capture, so channels keep their names across reconnections.
+//
+// Usage: ois_analyze capture.bin [--deadband 1] [--batch-ms 10] [--top 10]
+//        ois_analyze --raw game|controller stream.bin [--deadband 1] [--top 10]
+// Build e.g.:  c++ -O2 -std=c++11 ois_analyze.cpp -o ois_analyze
+//------------------------------------------------------------------------------
+#define OIS_NO_SERIAL_PORT
+#define OIS_ENABLE_VIRTUAL_PORT
+#define OIS_PROTOCOL_IMPL
+#include "../ois_protocol.h"
+#include "../ois_capture.h"
+#include "../ois_stats.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+enum Stream
+{
+	ToGame,      //read by the OisDevice: the controller's commands
+	ToController,//read by the OisHost: the game's commands
+	NumStreams
+};
+static const char* StreamName(int s) { return s == ToGame ? "controller -> game" : "game -> controller"; }
+
+//OisStats::Command, plus bytes that no command could be decoded from
+enum { Unknown = OisStats::NumCommands, NumCommandTypes };
+static const char* CommandTypeName(int c) { return c == Unknown ? "unknown" : OisStats::CommandName(c); }
+
+//------------------------------------------------------------------------------
+struct Channel
+{
+	enum Kind
+	{
+		Event, //CMD: controller -> game
+		Input, //NIx: game -> controller
+		Output,//NOx: controller -> game
+		NumKinds
+	};
+	//Histogram buckets by sign and bit length: [0] = -32768, ... [15] = -1, [16] = 0, [17] = 1, [18] = 2..3, ... [31] = 16384..32767
+	enum { NumBuckets = 32, ZeroBucket = 16 };
+
+	//Updated by every value, so kept together
+	uint64_t updates = 0;
+	uint64_t bytes = 0;
+	uint64_t second = ~(uint64_t)0;
+	uint64_t secondUpdates = 0;
+	uint64_t window = ~(uint64_t)0;
+	uint64_t repeatBytes = 0;
+	uint64_t deadbandBytes = 0;
+	uint64_t batchBytes = 0;
+	int16_t  min = 0;
+	int16_t  max = 0;
+	int16_t  last = 0;
+	int16_t  lastSent = 0;//by the simulated deadband
+	bool     hasValue = false;
+
+	uint8_t     kind = Event;
+	uint8_t     type = OisState::Number;
+	bool        registered = false;
+	uint16_t    channel = 0;
+	uint64_t    peakPerSecond = 0;
+	uint32_t    histogram[NumBuckets] = {};
+	std::string name;
+};
+
+static int BitLength(uint16_t u)
+{
+	struct Table
+	{
+		uint8_t bits[256];
+		Table() { for( int i=0; i!=256; ++i ) { int n = 0; while( i >> n ) ++n; bits[i] = (uint8_t)n; } }
+	};
+	static const Table t;
+	return u >> 8 ? 8 + t.bits[u >> 8] : t.bits[u];
+}
+static int Bucket(int16_t v)
+{
+	return v >= 0 ? Channel::ZeroBucket + BitLength((uint16_t)v) : Channel::ZeroBucket - BitLength((uint16_t)(-(int)v));
+}
+static void BucketRange(int b, int& lo, int& hi)
+{
+	if( b == Channel::ZeroBucket )
+		lo = hi = 0;
+	else if( b > Channel::ZeroBucket )
+	{
+		lo = 1 << (b - Channel::ZeroBucket - 1);
+		hi = (1 << (b - Channel::ZeroBucket)) - 1;
+	}
+	else
+	{
+		lo = -((1 << (Channel::ZeroBucket - b)) - 1);
+		hi = -(1 << (Channel::ZeroBucket - b - 1));
+		lo = lo < -32768 ? -32768 : lo;
+	}
+}
+
+//------------------------------------------------------------------------------
+class Analyzer
+{
+public:
+	struct Options
+	{
+		int      deadband = 1;
+		uint64_t batchNanoseconds = 10000000;
+		bool     timed = true;
+	};
+
+	Analyzer(const Options& o) : m_options(o)
+	{
+		for( auto& kind : m_index )
+			kind.assign(65536, -1);
+	}
+
+	Channel& Find(int kind, uint16_t channel)
+	{
+		int32_t& i = m_index[kind][channel];
+		if( i < 0 )
+		{
+			i = (int32_t)m_channels.size();
+			m_channels.push_back(Channel());
+			m_channels.back().kind = (uint8_t)kind;
+			m_channels.back().channel = channel;
+		}
+		return m_channels[i];
+	}
+	void Register(int kind, uint16_t channel, const char* name, OisState::NumericType type)
+	{
+		Channel& c = Find(kind, channel);
+		c.name = name;
+		c.type = (uint8_t)type;
+		c.registered = true;
+	}
+	//The time of the bytes that are about to be decoded
+	void SetTime(uint64_t time)
+	{
+		if( m_options.timed )
+		{
+			m_second = time / 1000000000;
+			m_window = time / m_options.batchNanoseconds;
+		}
+	}
+	void Update(Channel& c, int bytes)
+	{
+		++c.updates;
+		c.bytes += bytes;
+		if( m_second != c.second )
+		{
+			c.peakPerSecond = std::max(c.peakPerSecond, c.secondUpdates);
+			c.second = m_second;
+			c.secondUpdates = 0;
+		}
+		++c.secondUpdates;
+	}
+	void Value(int kind, uint16_t channel, int16_t value, int bytes)
+	{
+		Channel& c = Find(kind, channel);
+		Update(c, bytes);
+		++c.histogram[Bucket(value)];
+		if( !c.hasValue )
+		{
+			c.hasValue = true;
+			c.min = c.max = c.lastSent = value;
+		}
+		else
+		{
+			c.min = std::min(c.min, value);
+			c.max = std::max(c.max, value);
+			if( value == c.last )
+				c.repeatBytes += bytes;
+			if( std::abs((int)value - (int)c.lastSent) <= m_options.deadband )
+				c.deadbandBytes += bytes;
+			else
+				c.lastSent = value;
+		}
+		c.last = value;
+		//Of several updates in one window, only the last would be sent
+		if( m_window == c.window )
+			c.batchBytes += bytes;
+		c.window = m_window;
+	}
+	void Event(uint16_t channel, int bytes)
+	{
+		Update(Find(Channel::Event, channel), bytes);
+	}
+	void Count(int stream, int command, size_t bytes)
+	{
+		++m_commands[stream][command];
+		m_bytes[stream][command] += bytes;
+	}
+	void CountValue(int stream, size_t bytes, bool binary)
+	{
+		Count(stream, OisStats::Value, bytes);
+		++m_valueSizes[stream][binary ? bytes : 0];
+	}
+
+	const Options&        Settings() const { return m_options; }
+	std::vector<Channel>& Channels()       { return m_channels; }
+	uint64_t Bytes(int stream, int command) const    { return m_bytes[stream][command]; }
+	uint64_t Commands(int stream, int command) const { return m_commands[stream][command]; }
+	uint64_t ValueSize(int stream, int size) const   { return m_valueSizes[stream][size]; }
+private:
+	Options                  m_options;
+	uint64_t                 m_second = 0;
+	uint64_t                 m_window = 0;
+	std::vector<int32_t>     m_index[Channel::NumKinds];
+	std::vector<Channel>     m_channels;
+	uint64_t                 m_bytes[NumStreams][NumCommandTypes] = {};
+	uint64_t                 m_commands[NumStreams][NumCommandTypes] = {};
+	uint64_t                 m_valueSizes[NumStreams][6] = {};//[0] = ASCII, [2..5] = binary VAL_1..4
+};
+
+//------------------------------------------------------------------------------
+// Frames one direction of a connection the way its receiver does: ASCII lines until the handshake switches to binary,
+//  and commands that are split across reads are joined up again.
+class StreamDecoder : OisState
+{
+public:
+	StreamDecoder(Analyzer& a, Stream s)
+		: m_analyzer(a)
+		, m_stream(s)
+		, m_commandMask(s == ToGame ? (uint32_t)CL_COMMAND_MASK : (uint32_t)SV_COMMAND_MASK)
+		, m_valueCommand(s == ToGame ? (uint32_t)CL_VAL_1 : (uint32_t)SV_VAL_1)
+		, m_payloadShift(s == ToGame ? (uint32_t)CL_PAYLOAD_SHIFT : (uint32_t)SV_PAYLOAD_SHIFT)
+		, m_valueKind(s == ToGame ? Channel::Output : Channel::Input)
+	{
+	}
+
+	void SetPeer(StreamDecoder* peer) { m_peer = peer; }
+	void Reset()
+	{
+		m_binary = false;
+		m_carryLength = 0;
+	}
+	void Feed(const uint8_t* data, size_t size, uint64_t time)
+	{
+		m_analyzer.SetTime(time);
+		size_t pos = 0;
+		//Finish the command that the last Feed ended in the middle of, then decode the rest in place
+		while( m_carryLength && pos < size )
+		{
+			size_t carried = m_carryLength;
+			size_t take = std::min(size - pos, sizeof(m_carry) - carried);
+			memcpy(m_carry + carried, data + pos, take);
+			size_t used = Decode(m_carry, carried + take);
+			if( used )
+			{
+				OIS_ASSERT( used > carried );
+				pos += used - carried;
+				m_carryLength = 0;
+			}
+			else
+			{
+				pos += take;
+				m_carryLength = carried + take;
+				Overflow();
+			}
+		}
+		pos += Decode(data + pos, size - pos);
+		OIS_ASSERT( !m_carryLength || pos == size );
+		size_t rest = size - pos;
+		if( rest >= sizeof(m_carry) )
+		{
+			m_analyzer.Count(m_stream, Unknown, rest);
+			return;
+		}
+		memcpy(m_carry + m_carryLength, data + pos, rest);
+		m_carryLength += rest;
+		Overflow();
+	}
+	//Bytes of a command that was cut off by the end of the capture
+	size_t Pending() const { return m_carryLength; }
+private:
+	//The receiver gives up on a command that doesn't fit in its buffer
+	void Overflow()
+	{
+		if( m_carryLength == sizeof(m_carry) )
+		{
+			m_analyzer.Count(m_stream, Unknown, m_carryLength);
+			m_carryLength = 0;
+		}
+	}
+	size_t Decode(const uint8_t* data, size_t size)
+	{
+		size_t pos = 0;
+		while( pos < size )
+		{
+			size_t len;
+			if( m_binary )
+			{
+				//Values are nearly all of the traffic once connected, so skip the general decoder for them
+				uint32_t payload = data[pos];
+				uint32_t valueSize = (payload & m_commandMask) - m_valueCommand;//VAL_1..4 -> 0..3
+				if( valueSize < 4 )
+				{
+					len = valueSize + 2;
+					if( size - pos < len )
+						break;
+					Value(valueSize, payload >> m_payloadShift, data + pos, len);
+					pos += len;
+					continue;
+				}
+				len = m_stream == ToGame ? BinaryToGame(data + pos, size - pos) : BinaryToController();
+			}
+			else
+				len = Ascii(data + pos, size - pos);
+			if( !len )
+				break;
+			pos += len;
+		}
+		return pos;
+	}
+
+	//As OisDevice::ProcessBinary
+	size_t BinaryToGame(const uint8_t* start, size_t size)
+	{
+		uint32_t payload = start[0];
+		int command = payload & CL_COMMAND_MASK;
+		size_t cmdLength = 1;
+		bool hasString = false;
+		if( payload == CL_SYN_ || payload == CL_451_ )
+		{
+			const uint8_t* nl = (const uint8_t*)memchr(start, '\n', size);
+			if( !nl )
+				return 0;
+			if( nl - start >= 3 && 0 == memcmp(start, payload == CL_SYN_ ? "SYN" : "451", 3) )
+			{
+				//The controller restarted the handshake. OisDevice drops the rest of the read, and goes back to ASCII.
+				m_binary = false;
+				m_analyzer.Count(m_stream, OisStats::Handshake, size);
+				if( m_peer )
+					m_peer->Reset();
+				return size;
+			}
+		}
+		switch( command )
+		{
+		default:
+		case CL_NUL:
+			m_analyzer.Count(m_stream, Unknown, 1);
+			return 1;
+		case CL_ACT:
+			m_analyzer.Count(m_stream, OisStats::Handshake, 1);
+			return 1;
+		case CL_EXC_0: break;
+		case CL_CMD:
+		case CL_NIO:   cmdLength += 2; hasString = true; break;
+		case CL_DBG:   hasString = true; break;
+		case CL_PID:   cmdLength += 8; hasString = true; break;
+		case CL_EXC_1: cmdLength += 1; break;
+		case CL_TNI:
+		case CL_EXC_2: cmdLength += 2; break;
+		}
+		const char* name = (const char*)start + cmdLength;
+		if( hasString )
+		{
+			if( cmdLength >= size )
+				return 0;
+			const void* nul = memchr(name, '\0', size - cmdLength);
+			if( !nul )
+				return 0;
+			cmdLength = (const uint8_t*)nul - start + 1;
+		}
+		if( size < cmdLength )
+			return 0;
+
+		uint32_t extra = payload >> CL_PAYLOAD_SHIFT;
+		switch( command )
+		{
+		case CL_PID:
+			m_analyzer.Count(m_stream, OisStats::Handshake, cmdLength);
+			break;
+		case CL_DBG:
+			m_analyzer.Count(m_stream, OisStats::Debug, cmdLength);
+			break;
+		case CL_CMD:
+			m_analyzer.Count(m_stream, OisStats::Registration, cmdLength);
+			m_analyzer.Register(Channel::Event, Read16(start+1), name, Number);
+			break;
+		case CL_NIO:
+		{
+			m_analyzer.Count(m_stream, OisStats::Registration, cmdLength);
+			NumericType nt = payload & CL_N_PAYLOAD_F ? Fraction : (payload & CL_N_PAYLOAD_N ? Number : Boolean);
+			m_analyzer.Register(payload & CL_N_PAYLOAD_O ? Channel::Output : Channel::Input, Read16(start+1), name, nt);
+			break;
+		}
+		case CL_TNI:
+			m_analyzer.Count(m_stream, OisStats::Registration, cmdLength);
+			break;
+		case CL_EXC_0:
+		case CL_EXC_1:
+		case CL_EXC_2:
+		{
+			m_analyzer.Count(m_stream, OisStats::Event, cmdLength);
+			uint16_t channel = command == CL_EXC_0 ? (uint16_t)extra : command == CL_EXC_1 ? (uint16_t)(start[1] | (extra << 8)) : Read16(start+1);
+			m_analyzer.Event(channel, (int)cmdLength);
+			break;
+		}
+		}
+		return cmdLength;
+	}
+
+	//As OisHost::ProcessBinary, which only expects values
+	size_t BinaryToController()
+	{
+		m_analyzer.Count(m_stream, Unknown, 1);
+		return 1;
+	}
+
+	//VAL_1..4 (size 0..3), which are laid out the same way in both directions
+	void Value(uint32_t size, uint32_t extra, const uint8_t* start, size_t cmdLength)
+	{
+		int16_t value;
+		uint16_t channel;
+		switch( size )
+		{
+		default:
+		case 0: value = (int16_t)extra;                  channel = start[1];                              break;
+		case 1: value = (int16_t)(start[1]|(extra<<8));  channel = start[2];                              break;
+		case 2: value = (int16_t)Read16(start+1);        channel = (uint16_t)(start[3]|(extra<<8));       break;
+		case 3: value = (int16_t)Read16(start+1);        channel = Read16(start+3);                       break;
+		}
+		m_analyzer.CountValue(m_stream, cmdLength, true);
+		m_analyzer.Value(m_valueKind, channel, value, (int)cmdLength);
+	}
+
+	//As OisDevice::ProcessAscii / OisHost::ProcessAscii
+	size_t Ascii(const uint8_t* start, size_t size)
+	{
+		const uint8_t* nl = (const uint8_t*)memchr(start, '\n', size);
+		if( !nl )
+			return 0;
+		size_t cmdLength = nl - start + 1;
+		char cmd[OIS_MAX_COMMAND_LENGTH];
+		if( cmdLength > sizeof(cmd) )
+		{
+			m_analyzer.Count(m_stream, Unknown, cmdLength);
+			return cmdLength;
+		}
+		memcpy(cmd, start, cmdLength - 1);
+		cmd[cmdLength - 1] = '\0';
+		if( !cmd[0] )
+		{
+			m_analyzer.Count(m_stream, Unknown, cmdLength);
+			return cmdLength;
+		}
+		uint32_t type = cmd[1] && cmd[2] ? OIS_FOURCC(cmd) : 0;
+		if( m_stream == ToController && cmd[0] == '4' && cmd[1] == '5' && cmd[2] == '2' && cmd[3] == '\r' )
+			type = _452;
+		if( isdigit((uint8_t)cmd[0]) && type != _451 && type != _452 )
+		{
+			char* payload = ZeroDelimiter(cmd, '=');
+			m_analyzer.CountValue(m_stream, cmdLength, false);
+			m_analyzer.Value(m_stream == ToGame ? Channel::Output : Channel::Input, (uint16_t)atoi(cmd), (int16_t)atoi(payload), (int)cmdLength);
+			return cmdLength;
+		}
+		char* payload = cmd[3] == '\0' ? cmd + 3 : cmd + 4;
+		int group = Unknown;
+		if( m_stream == ToGame )
+		{
+			switch( type )
+			{
+			case _451:
+			case SYN:
+			{
+				group = OisStats::Handshake;
+				char* mode = ZeroDelimiter(payload, ',');
+				int version = atoi(payload);
+				m_binary = version == 2 && *mode == 'B';
+				//The controller only starts a handshake after resetting, so its side is back to ASCII too
+				if( m_peer )
+					m_peer->Reset();
+				break;
+			}
+			case PID:
+			case ACT:
+				group = OisStats::Handshake;
+				break;
+			case CMD:
+			{
+				group = OisStats::Registration;
+				char* name = payload;
+				int channel = atoi(ZeroDelimiter(payload, ','));
+				m_analyzer.Register(Channel::Event, (uint16_t)channel, name, Number);
+				break;
+			}
+			case NIN: case NIF: case NIB:
+			case NON: case NOF: case NOB:
+			{
+				group = OisStats::Registration;
+				bool output = type == NON || type == NOF || type == NOB;
+				NumericType nt = type == NIN || type == NON ? Number : (type == NIF || type == NOF ? Fraction : Boolean);
+				char* name = payload;
+				int channel = atoi(ZeroDelimiter(payload, ','));
+				m_analyzer.Register(output ? Channel::Output : Channel::Input, (uint16_t)channel, name, nt);
+				break;
+			}
+			case TNI:
+				group = OisStats::Registration;
+				break;
+			case EXC:
+				group = OisStats::Event;
+				m_analyzer.Event((uint16_t)atoi(payload), (int)cmdLength);
+				break;
+			case DBG:
+				group = OisStats::Debug;
+				break;
+			case END:
+				group = OisStats::End;
+				break;
+			}
+		}
+		else
+		{
+			switch( type )
+			{
+			case ACK2:
+				m_binary = true;
+				//fall through
+			case ACK1:
+			case _452:
+			case DEN:
+				group = OisStats::Handshake;
+				break;
+			case END:
+				group = OisStats::End;
+				m_binary = false;
+				break;
+			}
+		}
+		m_analyzer.Count(m_stream, group, cmdLength);
+		return cmdLength;
+	}
+
+	static uint16_t Read16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+	Analyzer&            m_analyzer;
+	Stream               m_stream;
+	uint32_t             m_commandMask;
+	uint32_t             m_valueCommand;
+	uint32_t             m_payloadShift;
+	int                  m_valueKind;
+	StreamDecoder*       m_peer = nullptr;
+	bool                 m_binary = false;
+	uint8_t              m_carry[OIS_MAX_COMMAND_LENGTH];
+	size_t               m_carryLength = 0;
+};
+
+//------------------------------------------------------------------------------
+static double Percent(uint64_t part, uint64_t whole) { return whole ? 100.0 * part / whole : 0.0; }
+
+static void PrintValue(const Channel& c, int raw)
+{
+	if( c.type == OisState::Fraction )
+		printf("%.2f", raw / 100.0);
+	else
+		printf("%d", raw);
+}
+
+static void Report(Analyzer& a, double seconds, int top)
+{
+	const Analyzer::Options& o = a.Settings();
+	printf("\n%-20s %12s", "bytes by command", "total");
+	for( int c=0; c!=NumCommandTypes; ++c )
+		printf(" %12s", CommandTypeName(c));
+	printf("\n");
+	for( int s=0; s!=NumStreams; ++s )
+	{
+		uint64_t total = 0;
+		for( int c=0; c!=NumCommandTypes; ++c )
+			total += a.Bytes(s, c);
+		printf("%-20s %12llu", StreamName(s), (unsigned long long)total);
+		for( int c=0; c!=NumCommandTypes; ++c )
+			printf(" %11.1f%%", Percent(a.Bytes(s, c), total));
+		printf("\n%-20s %12s", "", "commands");
+		for( int c=0; c!=NumCommandTypes; ++c )
+			printf(" %12llu", (unsigned long long)a.Commands(s, c));
+		printf("\n");
+	}
+	printf("\n%-20s %12s %12s %12s %12s %12s\n", "values by encoding", "ascii", "2 bytes", "3 bytes", "4 bytes", "5 bytes");
+	for( int s=0; s!=NumStreams; ++s )
+		printf("%-20s %12llu %12llu %12llu %12llu %12llu\n", StreamName(s), (unsigned long long)a.ValueSize(s, 0),
+		       (unsigned long long)a.ValueSize(s, 2), (unsigned long long)a.ValueSize(s, 3), (unsigned long long)a.ValueSize(s, 4), (unsigned long long)a.ValueSize(s, 5));
+
+	std::vector<Channel>& channels = a.Channels();
+	std::sort(channels.begin(), channels.end(), [](const Channel& x, const Channel& y) { return x.bytes != y.bytes ? x.bytes > y.bytes : x.channel < y.channel; });
+	uint64_t valueBytes = 0, repeatBytes = 0, deadbandBytes = 0, batchBytes = 0;
+	for( const Channel& c : channels )
+	{
+		if( c.kind == Channel::Event )
+			continue;
+		valueBytes += c.bytes;
+		repeatBytes += c.repeatBytes;
+		deadbandBytes += c.deadbandBytes;
+		batchBytes += c.batchBytes;
+	}
+
+	static const char* kinds[] = { "event", "input", "output" };
+	static const char* types[] = { "bool", "number", "fraction" };
+	printf("\n%-6s %5s %-24s %-8s %10s %9s %9s %12s %6s %9s %9s %9s\n", "kind", "chan", "name", "type", "updates", "per sec", "peak/sec", "bytes", "share", "repeats", "deadband", "batching");
+	uint64_t totalBytes = 0;
+	for( const Channel& c : channels )
+		totalBytes += c.bytes;
+	for( const Channel& c : channels )
+	{
+		if( !c.updates && c.registered )
+			continue;
+		std::string name = c.registered ? c.name : "(unregistered)";
+		if( name.size() > 24 )
+			name = name.substr(0, 21) + "...";
+		printf("%-6s %5u %-24s %-8s %10llu", kinds[c.kind], c.channel, name.c_str(), c.kind == Channel::Event ? "" : types[c.type], (unsigned long long)c.updates);
+		if( o.timed && seconds > 0 )
+			printf(" %9.1f %9llu", c.updates / seconds, (unsigned long long)std::max(c.peakPerSecond, c.secondUpdates));
+		else
+			printf(" %9s %9s", "-", "-");
+		printf(" %12llu %5.1f%%", (unsigned long long)c.bytes, Percent(c.bytes, totalBytes));
+		if( c.kind == Channel::Event )
+			printf("\n");
+		else if( o.timed )
+			printf(" %8.1f%% %8.1f%% %8.1f%%\n", Percent(c.repeatBytes, c.bytes), Percent(c.deadbandBytes, c.bytes), Percent(c.batchBytes, c.bytes));
+		else
+			printf(" %8.1f%% %8.1f%% %9s\n", Percent(c.repeatBytes, c.bytes), Percent(c.deadbandBytes, c.bytes), "-");
+	}
+
+	printf("\nOf %llu value bytes:\n", (unsigned long long)valueBytes);
+	printf("  %12llu (%.1f%%) repeated the channel's previous value\n", (unsigned long long)repeatBytes, Percent(repeatBytes, valueBytes));
+	printf("  %12llu (%.1f%%) would be saved by a deadband of %d raw units\n", (unsigned long long)deadbandBytes, Percent(deadbandBytes, valueBytes), o.deadband);
+	if( o.timed )
+		printf("  %12llu (%.1f%%) would be saved by batching each channel every %.1f ms\n", (unsigned long long)batchBytes, Percent(batchBytes, valueBytes), o.batchNanoseconds / 1e6);
+
+	int shown = 0;
+	for( const Channel& c : channels )
+	{
+		if( c.kind == Channel::Event || !c.updates )
+			continue;
+		if( shown++ == top )
+			break;
+		printf("\n%s %u (%s) values, min ", kinds[c.kind], c.channel, c.registered ? c.name.c_str() : "unregistered");
+		PrintValue(c, c.min);
+		printf(", max ");
+		PrintValue(c, c.max);
+		printf(":\n");
+		uint32_t most = *std::max_element(c.histogram, c.histogram + Channel::NumBuckets);
+		for( int b=0; b!=Channel::NumBuckets; ++b )
+		{
+			if( !c.histogram[b] )
+				continue;
+			int lo, hi;
+			BucketRange(b, lo, hi);
+			printf("  ");
+			if( c.type == OisState::Fraction )
+				printf("%9.2f .. %-9.2f", lo / 100.0, hi / 100.0);
+			else
+				printf("%9d .. %-9d", lo, hi);
+			printf(" %10u ", c.histogram[b]);
+			for( int i=0, n=(int)(40ULL * c.histogram[b] / most); i < n || i == 0; ++i )
+				printf("#");
+			printf("\n");
+		}
+	}
+}
+
+static bool ReadFile(const char* path, std::vector<uint8_t>& out)
+{
+	FILE* f = fopen(path, "rb");
+	if( !f )
+		return false;
+	fseek(f, 0L, SEEK_END);
+	long size = ftell(f);
+	rewind(f);
+	out.resize(size > 0 ? size : 0);
+	bool ok = size >= 0 && (size_t)size == (out.empty() ? 0 : fread(&out.front(), 1, out.size(), f));
+	fclose(f);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	Analyzer::Options options;
+	const char* path = nullptr;
+	int raw = -1;
+	int top = 10;
+	bool valid = true;
+	for( int i=1; i<argc && valid; ++i )
+	{
+		if( 0 == strcmp(argv[i], "--raw") && i+1 < argc )
+		{
+			++i;
+			raw = 0 == strcmp(argv[i], "game") ? ToGame : 0 == strcmp(argv[i], "controller") ? ToController : -1;
+			valid = raw >= 0;
+		}
+		else if( 0 == strcmp(argv[i], "--deadband") && i+1 < argc )
+			options.deadband = atoi(argv[++i]);
+		else if( 0 == strcmp(argv[i], "--batch-ms") && i+1 < argc )
+			options.batchNanoseconds = (uint64_t)(atof(argv[++i]) * 1e6);
+		else if( 0 == strcmp(argv[i], "--top") && i+1 < argc )
+			top = atoi(argv[++i]);
+		else if( argv[i][0] != '-' && !path )
+			path = argv[i];
+		else
+			valid = false;
+	}
+	if( !valid || !path || options.batchNanoseconds == 0 )
+	{
+		fprintf(stderr, "Usage: %s capture.bin [--deadband 1] [--batch-ms 10] [--top 10]\n", argv[0]);
+		fprintf(stderr, "       %s --raw game|controller stream.bin [--deadband 1] [--top 10]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<uint8_t> file;
+	if( !ReadFile(path, file) )
+	{
+		fprintf(stderr, "Can't read %s\n", path);
+		return 1;
+	}
+	options.timed = raw < 0;
+	Analyzer analyzer(options);
+	StreamDecoder toGame(analyzer, ToGame), toController(analyzer, ToController);
+	toGame.SetPeer(&toController);
+	StreamDecoder* decoders[NumStreams] = { &toGame, &toController };
+
+	auto start = std::chrono::steady_clock::now();
+	double seconds = 0;
+	uint64_t polls = 0;
+	if( raw >= 0 )
+	{
+		decoders[raw]->Feed(file.empty() ? nullptr : &file.front(), file.size(), 0);
+		printf("%s: %llu bytes %s\n", path, (unsigned long long)file.size(), StreamName(raw));
+	}
+	else
+	{
+		OisCaptureReader reader(file.empty() ? nullptr : &file.front(), file.size());
+		if( !reader.Valid() )
+		{
+			fprintf(stderr, "%s is not an OIS capture (version %d)\n", path, OisCaptureFileHeader::Version);
+			return 1;
+		}
+		//Reads are the bytes that the capturing side received
+		bool game = reader.Header()->side == OisCaptureFileHeader::Host;
+		StreamDecoder* received = decoders[game ? ToGame : ToController];
+		StreamDecoder* sent     = decoders[game ? ToController : ToGame];
+		OisCaptureReader::Entry e;
+		uint64_t lastTime = 0;
+		bool connected = false;
+		while( reader.Next(e) )
+		{
+			lastTime = e.record->time;
+			switch( e.record->type )
+			{
+			case OisCaptureRecord::Read:  received->Feed(e.data, e.record->length, e.record->time); break;
+			case OisCaptureRecord::Write: sent->Feed(e.data, e.record->length, e.record->time);     break;
+			case OisCaptureRecord::Poll:
+			{
+				++polls;
+				OisCapturePoll p;
+				memcpy(&p, e.data, std::min((size_t)e.record->length, sizeof(p)));
+				//A Poll that finds the port closed clears the connection
+				if( connected && !p.connected )
+				{
+					toGame.Reset();
+					toController.Reset();
+				}
+				connected = p.connected != 0;
+				break;
+			}
+			}
+		}
+		seconds = lastTime / 1e9;
+		printf("%s: written by the %s, %.3f seconds, %llu polls, %llu bytes\n", path, game ? "game (OisDevice)" : "controller (OisHost)",
+		       seconds, (unsigned long long)polls, (unsigned long long)file.size());
+		if( reader.Offset() != file.size() )
+			printf("Warning: the capture is truncated after %llu bytes\n", (unsigned long long)reader.Offset());
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Decoded in %.3f seconds (%.0f MB/s)\n", elapsed, elapsed > 0 ? file.size() / elapsed / 1e6 : 0.0);
+	for( StreamDecoder* d : decoders )
+		if( d->Pending() )
+			printf("Warning: %llu bytes %s are an incomplete command\n", (unsigned long long)d->Pending(), StreamName(d == &toGame ? ToGame : ToController));
+
+	Report(analyzer, seconds, top);
+	return 0;
+}
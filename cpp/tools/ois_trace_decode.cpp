@@ -0,0 +1,112 @@
+//------------------------------------------------------------------------------
+// Turns a trace saved by OisDevice::WriteTrace / OisHost::WriteTrace (see ois_trace.h) into readable log lines,
+//  matching the messages that OIS_INFO receives when tracing is disabled. Each line is prefixed with the time in
+//  seconds since the first entry.
+//
+// Usage: ois_trace_decode trace.bin [--no-time]
+// Build e.g.:  c++ -O2 -std=c++11 ois_trace_decode.cpp -o ois_trace_decode
+//------------------------------------------------------------------------------
+#define OIS_NO_SERIAL_PORT
+#define OIS_ENABLE_VIRTUAL_PORT
+#include "../ois_protocol.h"
+#include "../ois_trace.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct Name
+{
+	OisTraceFileName info;
+	std::string      name;
+};
+
+static const Name* Find(const std::vector<Name>& names, uint8_t kind, uint16_t channel)
+{
+	for( const Name& n : names )
+		if( n.info.kind == kind && n.info.channel == channel )
+			return &n;
+	return nullptr;
+}
+
+static void PrintValue(const char* direction, const OisTraceRecord& r, const Name* n)
+{
+	const char* name = n ? n->name.c_str() : "UNKNOWN CHANNEL";
+	switch( r.numericType )
+	{
+	case OisState::Boolean:  printf("%s %d(%s) = %s\n",   direction, r.channel, name, r.value ? "true" : "false"); break;
+	case OisState::Number:   printf("%s %d(%s) = %d\n",   direction, r.channel, name, r.value);                    break;
+	case OisState::Fraction: printf("%s %d(%s) = %.2f\n", direction, r.channel, name, r.value / 100.0f);           break;
+	default:                 printf("%s %d(%s) = ?%d\n",  direction, r.channel, name, r.value);                    break;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if( argc < 2 )
+	{
+		fprintf(stderr, "Usage: %s trace.bin [--no-time]\n", argv[0]);
+		return 1;
+	}
+	bool showTime = !(argc > 2 && 0 == strcmp(argv[2], "--no-time"));
+	FILE* f = fopen(argv[1], "rb");
+	if( !f )
+	{
+		fprintf(stderr, "Can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	OisTraceFileHeader h;
+	if( 1 != fread(&h, sizeof(h), 1, f) || 0 != memcmp(h.magic, "OISTRACE", 8) || h.version != OisTraceFileHeader::Version )
+	{
+		fprintf(stderr, "%s is not an OIS trace (version %d)\n", argv[1], OisTraceFileHeader::Version);
+		return 1;
+	}
+	std::vector<Name> names(h.nameCount);
+	for( Name& n : names )
+	{
+		if( 1 != fread(&n.info, sizeof(n.info), 1, f) || n.info.length > 65536 )
+		{
+			fprintf(stderr, "Truncated channel names\n");
+			return 1;
+		}
+		n.name.resize(n.info.length);
+		if( n.info.length && n.info.length != fread(&n.name[0], 1, n.info.length, f) )
+		{
+			fprintf(stderr, "Truncated channel names\n");
+			return 1;
+		}
+	}
+	std::vector<OisTraceRecord> records(h.recordCount);
+	size_t read = records.empty() ? 0 : fread(&records.front(), sizeof(OisTraceRecord), records.size(), f);
+	fclose(f);
+	if( read != records.size() )
+		fprintf(stderr, "Warning: trace is truncated after %u of %u entries\n", (unsigned)read, h.recordCount);
+	if( h.totalRecorded > h.recordCount )
+		printf("(%llu earlier entries were overwritten)\n", (unsigned long long)(h.totalRecorded - h.recordCount));
+
+	//The trace only knows which side wrote it; values received by the host side are the device's outputs, etc.
+	uint8_t received = h.side == OisTraceFileHeader::Host ? OisTraceFileName::Output : OisTraceFileName::Input;
+	uint8_t sent     = h.side == OisTraceFileHeader::Host ? OisTraceFileName::Input  : OisTraceFileName::Output;
+	for( size_t i=0; i!=read; ++i )
+	{
+		const OisTraceRecord& r = records[i];
+		if( showTime )
+			printf("%12.6f ", (r.time - records[0].time) / 1e9);
+		switch( r.type )
+		{
+		case OisTraceRecord::ValueIn:  PrintValue("<-", r, Find(names, received, r.channel)); break;
+		case OisTraceRecord::ValueOut: PrintValue("->", r, Find(names, sent, r.channel));     break;
+		case OisTraceRecord::EventIn:
+		case OisTraceRecord::EventOut:
+		{
+			const Name* n = Find(names, OisTraceFileName::Event, r.channel);
+			printf("%s EXC: %d (%s)\n", r.type == OisTraceRecord::EventIn ? "<-" : "->", r.channel, n ? n->name.c_str() : "INVALID CHANNEL");
+			break;
+		}
+		default:
+			printf("unknown entry type %d\n", r.type);
+			break;
+		}
+	}
+	return 0;
+}
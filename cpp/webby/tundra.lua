@@ -36,6 +36,11 @@ Build {
 			Sources = { "demo.c", "webby.c" },
 			Libs = { { "ws2_32.lib"; Config = "win64-msvc" } },
 		}
+		local bench_unmask = Program {
+			Name = "webbybench_unmask",
+			Sources = { "bench_unmask.c" },
+			Libs = { { "ws2_32.lib"; Config = "win64-msvc" } },
+		}
 		Default(demo)
 	end,
 }
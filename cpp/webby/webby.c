@@ -10,6 +10,19 @@
 #include <stdio.h>
 #include <ctype.h>
 
+#if defined(__AVX2__)
+#define WB_AVX2 1
+#define WB_VECTOR_ALIGN 32
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WB_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifndef WB_VECTOR_ALIGN
+#define WB_VECTOR_ALIGN 16
+#endif
+
 #if defined(__PS3__)
 #include "webby_ps3.h"
 #elif defined(__XBOX__)
@@ -30,8 +43,6 @@ static const size_t continue_header_len = sizeof(continue_header) - 1;
 static const char websocket_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 static const size_t websocket_guid_len = sizeof(websocket_guid) - 1;
 
-static const unsigned char websocket_pong[] = { 0x80, WEBBY_WS_OP_PONG, 0x00 };
-
 static const struct WebbyHeader plain_text_headers[] =
 {
   { "Content-Type", "text/plain" },
@@ -87,6 +98,7 @@ struct WebbyConnectionPrv
   struct WebbyWsFrame       ws_frame;
   unsigned char             ws_opcode;
   int                       blocking_count; /* number of times blocking has been requested */
+  const char*               ws_extensions;  /* Sec-WebSocket-Extensions response header, or NULL */
 };
 
 struct WebbyServer
@@ -515,8 +527,12 @@ WebbyServerInit(struct WebbyServerConfig *config, void *memory, size_t memory_si
 
     if( !config->bind_address || !config->bind_address[0] )
     {
+      /* Windows resolves "" to this machine; elsewhere fall back to every interface */
       struct hostent* localHost = gethostbyname("");
-      config->bind_address = inet_ntoa(*(struct in_addr *)*localHost->h_addr_list);
+      if (localHost && localHost->h_addr_list && localHost->h_addr_list[0])
+        config->bind_address = inet_ntoa(*(struct in_addr *)*localHost->h_addr_list);
+      else
+        config->bind_address = "0.0.0.0";
     }
 
     dbg(server, "binding to %s:%d", config->bind_address, config->listening_port);
@@ -600,6 +616,7 @@ static void reset_connection(struct WebbyServer *srv, struct WebbyConnectionPrv
   if( fresh )
 	  conn->public_data.user_data = 0;
   conn->blocking_count        = 0;
+  conn->ws_extensions         = NULL;
 }
 
 static int wb_on_incoming(struct WebbyServer *srv)
@@ -760,6 +777,21 @@ static int send_fully(webby_socket_t socket, const unsigned char *buffer, int si
   return 0;
 }
 
+static size_t make_websocket_header(unsigned char buffer[10], unsigned char opcode, int payload_len, int fin);
+
+/* Send a complete, unfragmented control frame. The socket must be in blocking mode. */
+static int send_control_frame(struct WebbyConnectionPrv *conn, unsigned char opcode, const void *payload, int len)
+{
+  unsigned char header[10];
+  size_t header_size = make_websocket_header(header, opcode, len, 1);
+
+  if (0 != send_fully(conn->socket, header, (int) header_size))
+    return -1;
+  if (len > 0 && 0 != send_fully(conn->socket, (const unsigned char*) payload, len))
+    return -1;
+  return 0;
+}
+
 
 static int wb_setup_request(struct WebbyServer *srv, struct WebbyConnectionPrv *connection, int request_size)
 {
@@ -922,7 +954,8 @@ static int send_websocket_upgrade(struct WebbyServer *srv, struct WebbyConnectio
   struct sha1 sha;
   unsigned char digest[20];
   char output_digest[64];
-  struct WebbyHeader headers[3];
+  struct WebbyHeader headers[4];
+  int header_count = 3;
   struct WebbyConnection *conn = &connection->public_data;
 
   if (0 == (srv->config.flags & WEBBY_SERVER_WEBSOCKETS))
@@ -970,7 +1003,14 @@ static int send_websocket_upgrade(struct WebbyServer *srv, struct WebbyConnectio
   headers[2].name  = "Sec-WebSocket-Accept";
   headers[2].value = output_digest;
 
-  WebbyBeginResponse(&connection->public_data, 101, 0, headers, WB_ARRAY_SIZE(headers));
+  if (connection->ws_extensions)
+  {
+    headers[3].name  = "Sec-WebSocket-Extensions";
+    headers[3].value = connection->ws_extensions;
+    ++header_count;
+  }
+
+  WebbyBeginResponse(&connection->public_data, 101, 0, headers, header_count);
   WebbyEndResponse(&connection->public_data);
   return 0;
 }
@@ -998,6 +1038,11 @@ static int scan_websocket_frame(const struct WebbyBuffer *buf, struct WebbyWsFra
     flags |= WEBBY_WSF_FIN;
   }
 
+  if (header0 & 0x40)
+  {
+    flags |= WEBBY_WSF_RSV1;
+  }
+
   if (header1 & 0x80)
   {
     flags |= WEBBY_WSF_MASKED;
@@ -1257,13 +1302,34 @@ static void wb_update_client(struct WebbyServer *srv, struct WebbyConnectionPrv*
             return;
 
           case WEBBY_WS_OP_PING:
-            dbg(srv, "received websocket ping request");
-            if (0 != send_fully(connection->socket, websocket_pong, sizeof websocket_pong))
+          case WEBBY_WS_OP_PONG:
+          {
+            /* Control frame payloads are at most 125 bytes. A ping's payload
+             * is echoed back in the pong. */
+            unsigned char payload[125];
+            int payload_len = connection->ws_frame.payload_length;
+            if (payload_len > (int) sizeof payload)
+              payload_len = (int) sizeof payload;
+            if (0 != WebbyRead(&connection->public_data, payload, payload_len))
             {
               connection->flags &= ~WB_ALIVE;
               return;
             }
+            if (WEBBY_WS_OP_PING == connection->ws_frame.opcode)
+            {
+              dbg(srv, "received websocket ping request");
+              if (0 != send_control_frame(connection, WEBBY_WS_OP_PONG, payload, payload_len))
+              {
+                connection->flags &= ~WB_ALIVE;
+                return;
+              }
+            }
+            else if (srv->config.ws_pong)
+            {
+              (*srv->config.ws_pong)(&connection->public_data, payload, payload_len);
+            }
             break;
+          }
 
           default:
             /* Dispatch frame to user handler. */
@@ -1394,6 +1460,36 @@ WebbyServerUpdate(struct WebbyServer *srv)
   }
 }
 
+int
+WebbyServerGetSockets(struct WebbyServer *srv, size_t *sockets, int *want_write, int max_sockets)
+{
+  int i, count = 0;
+
+  /* Must match the sets built by WebbyServerUpdate */
+  if (srv->connection_count < srv->config.connection_max)
+  {
+    if (count < max_sockets)
+    {
+      sockets[count] = (size_t) srv->socket;
+      if (want_write)
+        want_write[count] = 0;
+    }
+    ++count;
+  }
+
+  for (i = 0; i < srv->connection_count; ++i, ++count)
+  {
+    if (count < max_sockets)
+    {
+      sockets[count] = (size_t) srv->connections[i].socket;
+      if (want_write)
+        want_write[count] = srv->connections[i].state == WBC_SEND_CONTINUE;
+    }
+  }
+
+  return count;
+}
+
 static int wb_flush(struct WebbyBuffer *buf, webby_socket_t socket)
 {
   if (buf->used > 0)
@@ -1611,6 +1707,31 @@ WebbyEndSocketFrame(struct WebbyConnection *conn_pub)
   return make_connection_nonblocking(conn);
 }
 
+void
+WebbySetWebSocketExtensions(struct WebbyConnection *conn_pub, const char *extensions)
+{
+  struct WebbyConnectionPrv *conn = (struct WebbyConnectionPrv *) conn_pub;
+  conn->ws_extensions = extensions;
+}
+
+int
+WebbySendPing(struct WebbyConnection *conn_pub, const void *payload, size_t len)
+{
+  struct WebbyConnectionPrv *conn = (struct WebbyConnectionPrv *) conn_pub;
+  int err;
+
+  if (len > 125)
+    return -1;
+
+  if (0 != (err = make_connection_blocking(conn)))
+    return err;
+
+  if (0 != send_control_frame(conn, WEBBY_WS_OP_PING, payload, (int) len))
+    conn->flags &= ~WB_ALIVE;
+
+  return make_connection_nonblocking(conn);
+}
+
 static int read_buffered_data(int *data_left, struct WebbyBuffer* buffer, char **dest_ptr, size_t *dest_len)
 {
   int offset, read_size;
@@ -1633,6 +1754,67 @@ static int read_buffered_data(int *data_left, struct WebbyBuffer* buffer, char *
   return read_size;
 }
 
+/* XOR websocket payload data with the frame's mask key. `phase` is the offset
+ * of data[0] within the frame payload, so that a payload which is read in
+ * several pieces stays lined up with the 4 byte key.
+ *
+ * The bulk of the data is processed 32/16/4 bytes at a time using a copy of the
+ * key that has been rotated to match the phase. A short scalar head aligns the
+ * pointer for the vector loop and a scalar tail mops up the last few bytes. */
+static void wb_unmask(unsigned char *data, size_t len, const unsigned char mask[4], size_t phase)
+{
+  unsigned char rotated[4];
+  unsigned int mask_word;
+  size_t head, i;
+
+  /* Scalar head: bring data up to vector alignment */
+  head = (size_t) ((WB_VECTOR_ALIGN - ((size_t) data & (WB_VECTOR_ALIGN - 1))) & (WB_VECTOR_ALIGN - 1));
+  if (head > len)
+    head = len;
+  for (i = 0; i < head; ++i)
+    data[i] ^= mask[(phase + i) & 3];
+  data += head;
+  len -= head;
+  phase += head;
+
+  for (i = 0; i < 4; ++i)
+    rotated[i] = mask[(phase + i) & 3];
+  memcpy(&mask_word, rotated, 4);
+
+  i = 0;
+#if WB_AVX2
+  {
+    __m256i key = _mm256_set1_epi32((int) mask_word);
+    for (; i + 32 <= len; i += 32)
+    {
+      __m256i v = _mm256_load_si256((const __m256i*) (data + i));
+      _mm256_store_si256((__m256i*) (data + i), _mm256_xor_si256(v, key));
+    }
+  }
+#endif
+#if WB_SSE2
+  {
+    __m128i key = _mm_set1_epi32((int) mask_word);
+    for (; i + 16 <= len; i += 16)
+    {
+      __m128i v = _mm_load_si128((const __m128i*) (data + i));
+      _mm_store_si128((__m128i*) (data + i), _mm_xor_si128(v, key));
+    }
+  }
+#endif
+  for (; i + 4 <= len; i += 4)
+  {
+    unsigned int word;
+    memcpy(&word, data + i, 4);
+    word ^= mask_word;
+    memcpy(data + i, &word, 4);
+  }
+
+  /* Scalar tail */
+  for (; i < len; ++i)
+    data[i] ^= rotated[i & 3];
+}
+
 int WebbyRead(struct WebbyConnection *conn, void *ptr_, size_t len)
 {
   struct WebbyConnectionPrv* conn_prv = (struct WebbyConnectionPrv*) conn;
@@ -1671,15 +1853,8 @@ int WebbyRead(struct WebbyConnection *conn, void *ptr_, size_t len)
   if ((conn_prv->flags & WB_WEBSOCKET) && (conn_prv->ws_frame.flags & WEBBY_WSF_MASKED))
   {
     /* XOR outgoing data with websocket ofuscation key */
-    int i;
     int end_pos = conn_prv->body_bytes_read;
-    const unsigned char *mask = conn_prv->ws_frame.mask_key;
-    ptr = (char*) ptr_; /* start over */
-    for (i = start_pos; i < end_pos; ++i)
-    {
-      unsigned char byte = *ptr;
-      *ptr++ = byte ^ mask[i & 3];
-    }
+    wb_unmask((unsigned char*) ptr_, (size_t) (end_pos - start_pos), conn_prv->ws_frame.mask_key, (size_t) start_pos);
   }
 
   return 0;
@@ -70,13 +70,18 @@ enum
   WEBBY_WS_OP_BINARY_FRAME    = 2,
   WEBBY_WS_OP_CLOSE           = 8,
   WEBBY_WS_OP_PING            = 9,
-  WEBBY_WS_OP_PONG            = 10
+  WEBBY_WS_OP_PONG            = 10,
+
+  /* Can be combined with the opcode passed to WebbyBeginSocketFrame() to set
+   * the RSV1 bit, which marks a compressed message under permessage-deflate. */
+  WEBBY_WS_RSV1               = 0x40
 };
 
 enum
 {
   WEBBY_WSF_FIN               = 1 << 0,
-  WEBBY_WSF_MASKED            = 1 << 1
+  WEBBY_WSF_MASKED            = 1 << 1,
+  WEBBY_WSF_RSV1              = 1 << 2  /* e.g. a compressed message under permessage-deflate */
 };
 
 struct WebbyWsFrame
@@ -164,6 +169,12 @@ struct WebbyServerConfig
    * Return non-zero to close the connection.
    */
   int (*ws_frame)(struct WebbyConnection *connection, const struct WebbyWsFrame *frame);
+
+  /*
+   * Optional. Called when a WebSocket pong frame is received, e.g. in reply to
+   * WebbySendPing(). The payload is at most 125 bytes.
+   */
+  void (*ws_pong)(struct WebbyConnection *connection, const unsigned char *payload, int payload_len);
 };
 
 /* Returns the amount of memory needed for the specified config. */
@@ -181,6 +192,16 @@ WebbyServerInit(struct WebbyServerConfig *config, void *memory, size_t memory_si
 void
 WebbyServerUpdate(struct WebbyServer *srv);
 
+/* Describe the sockets that WebbyServerUpdate services, so that an application
+ * can sleep in its own select() / poll() until the server has work to do,
+ * rather than calling WebbyServerUpdate on a fixed interval. Up to
+ * max_sockets handles are written to `sockets` (SOCKETs on Windows, file
+ * descriptors elsewhere). If `want_write` is not NULL, it receives 1 for each
+ * socket that is waiting to become writable and 0 otherwise.
+ * Returns the total number of sockets, which may be more than max_sockets. */
+int
+WebbyServerGetSockets(struct WebbyServer *srv, size_t *sockets, int *want_write, int max_sockets);
+
 /* Shutdown the server and close all sockets. */
 void
 WebbyServerShutdown(struct WebbyServer *srv);
@@ -253,6 +274,25 @@ WebbyBeginSocketFrame(struct WebbyConnection *conn, int websocket_opcode);
 int
 WebbyEndSocketFrame(struct WebbyConnection *conn);
 
+/* Set the value of the Sec-WebSocket-Extensions header that is sent when a
+ * connection is upgraded to a websocket, to accept an extension that the client
+ * offered. Only valid during the ws_connect callback. The string must remain
+ * valid until the ws_connected callback.
+ *
+ * Webby doesn't implement any extensions itself: the user is responsible for
+ * handling the RSV bits that the extension uses (see WEBBY_WSF_RSV1 and
+ * WEBBY_WS_RSV1). */
+void
+WebbySetWebSocketExtensions(struct WebbyConnection *conn, const char *extensions);
+
+/* Send a websocket ping frame. The client replies with a pong frame carrying
+ * the same payload, which is passed to the ws_pong callback. The payload can be
+ * at most 125 bytes.
+ *
+ * Returns zero on success, non-zero on error. */
+int
+WebbySendPing(struct WebbyConnection *conn, const void *payload, size_t len);
+
 #ifdef __cplusplus
 }
 #endif